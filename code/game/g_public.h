@@ -79,6 +79,16 @@ typedef struct {
 } sharedEntity_t;
 
 
+// one trace of a G_TRACE_BATCH call, the arguments of G_TRACE / G_TRACECAPSULE
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    int         passEntityNum;
+    int         contentmask;
+    qboolean    capsule;
+} traceRequest_t;
+
+
 
 //===============================================================
 
@@ -433,7 +443,16 @@ typedef enum {
     G_GT_RUNFRAME,
     G_GT_START,
     G_GT_SENDEVENT,
-    G_GT_SHUTDOWN
+    G_GT_SHUTDOWN,
+
+    G_TRACE_BATCH,  // ( trace_t *results, const traceRequest_t *requests, int numRequests );
+    // same results as one G_TRACE / G_TRACECAPSULE per request, but requests
+    // close to each other share the search for entities to clip against
+
+    G_G2_COLLISIONDETECT_MULTI, // ( CollisionRecord_t *collRecMaps, void *ghoul2, const vec3_t angles, const vec3_t position,
+    //   int frameNumber, int entNum, vec3_t *rayStarts, vec3_t *rayEnds, int numRays, vec3_t scale, int traceFlags, int useLod );
+    // same results as one G_G2_COLLISIONDETECT per ray, MAX_G2_COLLISIONS records each,
+    // but the model is posed and skinned once for all of them
 
 } gameImport_t;
 
@@ -56,8 +56,9 @@ void SetPlaneSignbits (cplane_t *out) {
 clipMap_t   cmBSPs[MAX_CLIPMAP_BSP];    // Clipmap of the main BSP and any sub-BSPs.
 clipMap_t   *cmg = &cmBSPs[0];          // The clipmap of the main BSP.
 
-int         c_pointcontents;
-int         c_traces, c_brush_traces, c_patch_traces;
+// per thread, so concurrent traces don't fight over the cache line
+Q_THREAD_LOCAL int  c_pointcontents;
+Q_THREAD_LOCAL int  c_traces, c_brush_traces, c_patch_traces;
 
 int         totalSubModels;             // Total amount of models present in the world.
 
@@ -66,6 +67,10 @@ byte        *cmod_base;
 #ifndef BSPC
 cvar_t      *cm_noAreas;
 cvar_t      *cm_noCurves;
+cvar_t      *cm_flatNodes;
+cvar_t      *cm_simdBrushes;
+cvar_t      *cm_patchCache;
+cvar_t      *cm_terrainGrid;
 cvar_t      *cm_playerCurveClip;
 #endif
 
@@ -218,6 +223,85 @@ void CMod_LoadNodes(clipMap_t *cm, lump_t *l)
 
 }
 
+/*
+=================
+CMod_FlattenNode_r
+
+Stores a node and then everything in front of and behind it,
+returns where it went.
+=================
+*/
+static int CMod_FlattenNode_r(clipMap_t *cm, int nodeNum, int *numFlat)
+{
+    cNode_t     *in;
+    cFlatNode_t *out;
+    int         flatNum;
+    int         j;
+
+    if (nodeNum < 0)
+        return nodeNum;     // leafs keep their numbers
+
+    if (nodeNum >= cm->numNodes || *numFlat == cm->numNodes)
+        Com_Error (ERR_DROP, "CMod_FlattenNodes: nodes don't form a tree");
+
+    in = cm->nodes + nodeNum;
+    flatNum = (*numFlat)++;
+
+    out = cm->flatNodes + flatNum;
+    VectorCopy (in->plane->normal, out->normal);
+    out->dist = in->plane->dist;
+    out->type = in->plane->type;
+    out->nodeNum = nodeNum;
+
+    for (j=0 ; j<2 ; j++)
+    {
+        out->children[j] = CMod_FlattenNode_r(cm, in->children[j], numFlat);
+    }
+
+    return flatNum;
+}
+
+/*
+=================
+CMod_FlattenNodes
+
+Builds flatNodes and checks it against the nodes it came from.
+=================
+*/
+void CMod_FlattenNodes(clipMap_t *cm)
+{
+    cFlatNode_t *flat;
+    cNode_t     *node;
+    int         numFlat;
+    int         i, j, child;
+
+    cm->flatNodes = Hunk_Alloc( cm->numNodes * sizeof( *cm->flatNodes ), h_high );
+
+    numFlat = 0;
+    CMod_FlattenNode_r(cm, 0, &numFlat);
+
+    for (i=0, flat=cm->flatNodes ; i<numFlat ; i++, flat++)
+    {
+        node = cm->nodes + flat->nodeNum;
+
+        if (!VectorCompare (flat->normal, node->plane->normal) || flat->dist != node->plane->dist
+            || flat->type != node->plane->type)
+            Com_Error (ERR_DROP, "CMod_FlattenNodes: node %i has the wrong plane", flat->nodeNum);
+
+        for (j=0 ; j<2 ; j++)
+        {
+            child = flat->children[j];
+            if (child >= 0)
+                child = cm->flatNodes[child].nodeNum;
+            if (child != node->children[j])
+                Com_Error (ERR_DROP, "CMod_FlattenNodes: node %i has the wrong children", flat->nodeNum);
+        }
+    }
+
+    if (numFlat != cm->numNodes)
+        Com_DPrintf ("CMod_FlattenNodes: %i of %i nodes are not in the tree\n", cm->numNodes - numFlat, cm->numNodes);
+}
+
 /*
 =================
 CM_BoundBrush
@@ -236,6 +320,54 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+#if idx64
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the side planes of every brush into rows
+of normal[0], normal[1], normal[2] and dist
+=================
+*/
+static void CMod_LoadBrushPlanes( clipMap_t *cm )
+{
+    cbrush_t    *b;
+    cplane_t    *plane;
+    float       *rows;
+    int         i, j, k, padded, total;
+
+    total = 0;
+    for ( i = 0, b = cm->brushes ; i < cm->numBrushes ; i++, b++ ) {
+        total += 4 * PADDED_SIDES( b->numsides );
+    }
+
+    rows = Hunk_Alloc( total * sizeof( *rows ), h_high );
+
+    for ( i = 0, b = cm->brushes ; i < cm->numBrushes ; i++, b++ ) {
+        padded = PADDED_SIDES( b->numsides );
+        b->sidePlanes = rows;
+
+        for ( j = 0 ; j < padded ; j++ ) {
+            if ( j < b->numsides ) {
+                plane = b->sides[j].plane;
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    rows[k * padded + j] = plane->normal[k];
+                }
+                rows[3 * padded + j] = plane->dist;
+            } else {
+                // the trace is always behind this one
+                for ( k = 0 ; k < 3 ; k++ ) {
+                    rows[k * padded + j] = 0.0f;
+                }
+                rows[3 * padded + j] = PADDING_PLANE_DIST;
+            }
+        }
+
+        rows += 4 * padded;
+    }
+}
+#endif
+
 /*
 =================
 CMod_LoadBrushes
@@ -247,6 +379,7 @@ void CMod_LoadBrushes(clipMap_t *cm, lump_t *l)
     dbrush_t    *in;
     cbrush_t    *out;
     int         i, count;
+    int         checkIndex;
 
     in = (void *)(cmod_base + l->fileofs);
     if (l->filelen % sizeof(*in)) {
@@ -258,8 +391,10 @@ void CMod_LoadBrushes(clipMap_t *cm, lump_t *l)
     cm->numBrushes = count;
 
     out = cm->brushes;
+    checkIndex = CM_AllocCheckIndexes( count );
 
     for ( i=0 ; i<count ; i++, out++, in++ ) {
+        out->checkIndex = checkIndex + i;
         out->sides = cm->brushsides + LittleLong(in->firstSide);
         out->numsides = LittleLong(in->numSides);
 
@@ -272,6 +407,9 @@ void CMod_LoadBrushes(clipMap_t *cm, lump_t *l)
         CM_BoundBrush( out );
     }
 
+#if idx64
+    CMod_LoadBrushPlanes( cm );
+#endif
 }
 
 /*
@@ -490,23 +628,104 @@ void CMod_LoadVisibility(clipMap_t *cm, lump_t *l)
 //==================================================================
 
 
+unsigned CM_LumpChecksum(lump_t *lump) {
+    return LittleLong (Com_BlockChecksum (cmod_base + lump->fileofs, lump->filelen));
+}
+
 /*
 =================
-CMod_LoadPatches
+CMod_GeneratePatches
 =================
 */
 #define MAX_PATCH_VERTS     1024
-void CMod_LoadPatches(clipMap_t *cm, lump_t *surfs, lump_t *verts)
+static void CMod_GeneratePatches(clipMap_t *cm, lump_t *surfs, lump_t *verts)
+{
+    drawVert_t      *dv, *dv_p;
+    dsurface_t      *in;
+    cPatchPoints_t  *patches;
+    vec3_t          *points, *p;
+    struct patchCollide_s   **pcs;
+    int             numPatches, numPoints;
+    int             i, j, n;
+    int             c;
+
+    in = (void *)(cmod_base + surfs->fileofs);
+    dv = (void *)(cmod_base + verts->fileofs);
+
+    numPatches = numPoints = 0;
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+
+        c = LittleLong( in[i].patchWidth ) * LittleLong( in[i].patchHeight );
+        if ( c > MAX_PATCH_VERTS ) {
+            Com_Error( ERR_DROP, "ParseMesh: MAX_PATCH_VERTS" );
+        }
+        numPatches++;
+        numPoints += c;
+    }
+
+    if ( !numPatches ) {
+        return;
+    }
+
+    // load the full drawverts of every patch, so they
+    // can all be generated at once
+    patches = Hunk_AllocateTempMemory( numPatches * sizeof( *patches ) );
+    points = Hunk_AllocateTempMemory( numPoints * sizeof( *points ) );
+    pcs = Hunk_AllocateTempMemory( numPatches * sizeof( *pcs ) );
+
+    p = points;
+    for ( i = 0, n = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+
+        patches[n].width = LittleLong( in[i].patchWidth );
+        patches[n].height = LittleLong( in[i].patchHeight );
+        patches[n].points = p;
+        c = patches[n].width * patches[n].height;
+
+        dv_p = dv + LittleLong( in[i].firstVert );
+        for ( j = 0 ; j < c ; j++, dv_p++, p++ ) {
+            (*p)[0] = LittleFloat( dv_p->xyz[0] );
+            (*p)[1] = LittleFloat( dv_p->xyz[1] );
+            (*p)[2] = LittleFloat( dv_p->xyz[2] );
+        }
+        n++;
+    }
+
+    // create the internal facet structures
+    CM_GeneratePatchCollides( numPatches, patches, pcs );
+
+    for ( i = 0, n = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( cm->surfaces[i] ) {
+            cm->surfaces[i]->pc = pcs[n++];
+        }
+    }
+
+    Hunk_FreeTempMemory( pcs );
+    Hunk_FreeTempMemory( points );
+    Hunk_FreeTempMemory( patches );
+}
+
+/*
+=================
+CMod_LoadPatches
+=================
+*/
+void CMod_LoadPatches(clipMap_t *cm, const char *name, lump_t *surfs, lump_t *verts)
 {
-    drawVert_t  *dv, *dv_p;
     dsurface_t  *in;
     int         count;
-    int         i, j;
-    int         c;
+    int         i;
     cPatch_t    *patch;
-    vec3_t      points[MAX_PATCH_VERTS];
-    int         width, height;
     int         shaderNum;
+#ifndef BSPC
+    unsigned    checksums[2];
+    unsigned    key;
+#endif
 
     in = (void *)(cmod_base + surfs->fileofs);
     if (surfs->filelen % sizeof(*in))
@@ -514,8 +733,7 @@ void CMod_LoadPatches(clipMap_t *cm, lump_t *surfs, lump_t *verts)
     cm->numSurfaces = count = surfs->filelen / sizeof(*in);
     cm->surfaces = Hunk_Alloc( cm->numSurfaces * sizeof( cm->surfaces[0] ), h_high );
 
-    dv = (void *)(cmod_base + verts->fileofs);
-    if (verts->filelen % sizeof(*dv))
+    if (verts->filelen % sizeof(drawVert_t))
         Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 
     // scan through all the surfaces, but only load patches,
@@ -527,37 +745,38 @@ void CMod_LoadPatches(clipMap_t *cm, lump_t *surfs, lump_t *verts)
         // FIXME: check for non-colliding patches
 
         cm->surfaces[ i ] = patch = Hunk_Alloc( sizeof( *patch ), h_high );
-
-        // load the full drawverts onto the stack
-        width = LittleLong( in->patchWidth );
-        height = LittleLong( in->patchHeight );
-        c = width * height;
-        if ( c > MAX_PATCH_VERTS ) {
-            Com_Error( ERR_DROP, "ParseMesh: MAX_PATCH_VERTS" );
-        }
-
-        dv_p = dv + LittleLong( in->firstVert );
-        for ( j = 0 ; j < c ; j++, dv_p++ ) {
-            points[j][0] = LittleFloat( dv_p->xyz[0] );
-            points[j][1] = LittleFloat( dv_p->xyz[1] );
-            points[j][2] = LittleFloat( dv_p->xyz[2] );
-        }
+        patch->checkIndex = CM_AllocCheckIndexes( 1 );
 
         shaderNum = LittleLong( in->shaderNum );
         patch->contents = cm->shaders[shaderNum].contentFlags;
         patch->surfaceFlags = cm->shaders[shaderNum].surfaceFlags;
+    }
 
-        // create the internal facet structure
-        patch->pc = CM_GeneratePatchCollide( width, height, points );
+#ifdef BSPC
+    CMod_GeneratePatches(cm, surfs, verts);
+#else
+    if ( !cm_patchCache->integer ) {
+        CMod_GeneratePatches(cm, surfs, verts);
+        return;
     }
-}
 
-//==================================================================
+    // the facets only depend on the patch control points
+    checksums[0] = CM_LumpChecksum(surfs);
+    checksums[1] = CM_LumpChecksum(verts);
+    key = LittleLong(Com_BlockChecksum(checksums, sizeof(checksums)));
 
-unsigned CM_LumpChecksum(lump_t *lump) {
-    return LittleLong (Com_BlockChecksum (cmod_base + lump->fileofs, lump->filelen));
+    if ( CM_ReadPatchCache(cm, name, key) ) {
+        Com_DPrintf("Patch collision read from the cache\n");
+        return;
+    }
+
+    CMod_GeneratePatches(cm, surfs, verts);
+    CM_WritePatchCache(cm, name, key);
+#endif
 }
 
+//==================================================================
+
 unsigned CM_Checksum(dheader_t *header) {
     unsigned checksums[16];
     checksums[0] = CM_LumpChecksum(&header->lumps[LUMP_SHADERS]);
@@ -575,6 +794,28 @@ unsigned CM_Checksum(dheader_t *header) {
     return LittleLong(Com_BlockChecksum(checksums, 11 * 4));
 }
 
+/*
+==================
+CM_EndLoadPhase
+
+Adds the time since the last phase to the load time breakdown.
+==================
+*/
+static int      cm_phaseTime;
+static char     cm_loadPhases[MAX_STRING_CHARS];
+
+static void CM_EndLoadPhase(const char *phase)
+{
+    char    text[64];
+    int     now;
+
+    // not va, the map name may be in its buffers
+    now = Sys_Milliseconds();
+    Com_sprintf(text, sizeof(text), ", %s %i", phase, now - cm_phaseTime);
+    Q_strcat(cm_loadPhases, sizeof(cm_loadPhases), text);
+    cm_phaseTime = now;
+}
+
 /*
 ==================
 CM_LoadBSPFile
@@ -596,6 +837,10 @@ static qboolean CM_LoadBSPFile(clipMap_t *cm, const char *name, int *checksum)
     int             i;
     dheader_t       header;
     int             length;
+    int             start;
+
+    start = cm_phaseTime = Sys_Milliseconds();
+    cm_loadPhases[0] = 0;
 
     //
     // load the file
@@ -626,19 +871,29 @@ static qboolean CM_LoadBSPFile(clipMap_t *cm, const char *name, int *checksum)
 
     cmod_base = (byte *)buf.i;
 
+    CM_EndLoadPhase("read");
+
     // load into heap
     CMod_LoadShaders(cm, &header.lumps[LUMP_SHADERS]);
     CMod_LoadLeafs(cm, &header.lumps[LUMP_LEAFS]);
     CMod_LoadLeafBrushes(cm, &header.lumps[LUMP_LEAFBRUSHES]);
     CMod_LoadLeafSurfaces(cm, &header.lumps[LUMP_LEAFSURFACES]);
     CMod_LoadPlanes(cm, &header.lumps[LUMP_PLANES]);
+    CM_EndLoadPhase("leafs");
     CMod_LoadBrushSides(cm, &header.lumps[LUMP_BRUSHSIDES]);
     CMod_LoadBrushes(cm, &header.lumps[LUMP_BRUSHES]);
     CMod_LoadSubmodels(cm, &header.lumps[LUMP_MODELS]);
+    CM_EndLoadPhase("brushes");
     CMod_LoadNodes(cm, &header.lumps[LUMP_NODES]);
+    CMod_FlattenNodes(cm);
+    CM_EndLoadPhase("nodes");
     CMod_LoadEntityString(cm, &header.lumps[LUMP_ENTITIES]);
     CMod_LoadVisibility(cm, &header.lumps[LUMP_VISIBILITY]);
-    CMod_LoadPatches(cm, &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS]);
+    CM_EndLoadPhase("vis");
+    CMod_LoadPatches(cm, name, &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS]);
+    CM_EndLoadPhase("patches");
+
+    Com_DPrintf("%s: collision loaded in %i msec%s\n", name, Sys_Milliseconds() - start, cm_loadPhases);
 
     // Increment the total amount of sub-models loaded across loaded clipmap BSPs.
     totalSubModels += cm->numSubModels;
@@ -668,6 +923,10 @@ void CM_LoadMap(const char *name, int *checksum)
 #ifndef BSPC
     cm_noAreas = Cvar_Get("cm_noAreas", "0", CVAR_CHEAT);
     cm_noCurves = Cvar_Get("cm_noCurves", "0", CVAR_CHEAT);
+    cm_flatNodes = Cvar_Get("cm_flatNodes", "1", 0);
+    cm_simdBrushes = Cvar_Get("cm_simdBrushes", "1", 0);
+    cm_patchCache = Cvar_Get("cm_patchCache", "1", 0);
+    cm_terrainGrid = Cvar_Get("cm_terrainGrid", "1", 0);
     cm_playerCurveClip = Cvar_Get("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT);
 #endif
 
@@ -764,6 +1023,10 @@ void CM_ClearMap( void ) {
     Com_Memset( &cmBSPs, 0, sizeof( cmBSPs ) );
     CM_ClearLevelPatches();
 
+    // Stamps left behind by earlier traces are all older
+    // than the next checkcount, so the slots can be reused.
+    cm_numCheckIndexes = 0;
+
     // Reset total model count.
     totalSubModels = 0;
 }
@@ -869,6 +1132,7 @@ void CM_InitBoxHull (void)
     box_planes = &cmg->planes[cmg->numPlanes];
 
     box_brush = &cmg->brushes[cmg->numBrushes];
+    box_brush->checkIndex = CM_AllocCheckIndexes( 1 );
     box_brush->numsides = 6;
     box_brush->sides = cmg->brushsides + cmg->numBrushSides;
     box_brush->contents = CONTENTS_BODY;
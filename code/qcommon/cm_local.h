@@ -39,6 +39,17 @@ typedef struct {
     int         children[2];        // negative numbers are leafs
 } cNode_t;
 
+// the nodes again, in depth first order with the plane stored inline, so
+// the front child of a node is usually on the same cache line and a step
+// down the tree doesn't have to go through the plane array
+typedef struct {
+    vec3_t      normal;
+    float       dist;
+    int         type;               // as in cplane_t
+    int         children[2];        // indexes into flatNodes, negative numbers are leafs
+    int         nodeNum;            // the same node in nodes
+} cFlatNode_t;
+
 typedef struct {
     int         cluster;
     int         area;
@@ -62,18 +73,24 @@ typedef struct {
     int         shaderNum;
 } cbrushside_t;
 
+// brush sides are tested four at a time, the extra
+// planes behind everything never matter to a trace
+#define PADDED_SIDES(n)     ( ( (n) + 3 ) & ~3 )
+#define PADDING_PLANE_DIST  1e30f
+
 typedef struct cbrush_s {
     int         shaderNum;      // the shader that determined the contents
     int         contents;
     vec3_t      bounds[2];
     int         numsides;
     cbrushside_t    *sides;
-    int         checkcount;     // to avoid repeated testings
+    float       *sidePlanes;    // side normals and dists as four rows of PADDED_SIDES, or NULL
+    int         checkIndex;     // into the per-thread check stamps
     cTerrain_t  *terrain;
 } cbrush_t;
 
 typedef struct {
-    int         checkcount;             // to avoid repeated testings
+    int         checkIndex;             // into the per-thread check stamps
     int         surfaceFlags;
     int         contents;
     struct patchCollide_s   *pc;
@@ -83,6 +100,9 @@ typedef struct {
 typedef struct {
     int         floodnum;
     int         floodvalid;
+
+    int         bitsVersion;            // connectivity version of bits, 0 if not written yet
+    byte        bits[MAX_MAP_AREA_BYTES];   // CM_WriteAreaBits result for this area
 } cArea_t;
 
 typedef struct {
@@ -99,6 +119,7 @@ typedef struct {
 
     int         numNodes;
     cNode_t     *nodes;
+    cFlatNode_t *flatNodes;
 
     int         numLeafs;
     cLeaf_t     *leafs;
@@ -131,7 +152,7 @@ typedef struct {
     cPatch_t    **surfaces;         // non-patches will be NULL
 
     int         floodvalid;
-    int         checkcount;                 // incremented on each trace
+    int         lastFloodnum;   // highest floodnum handed out so far
 
     cTerrain_t  *terrains[MAX_TERRAINS];
     int         numTerrains;
@@ -144,10 +165,16 @@ typedef struct {
 
 extern  clipMap_t   *cmg;                   // The clipmap of the main BSP.
 
-extern  int         c_pointcontents;
-extern  int         c_traces, c_brush_traces, c_patch_traces;
+extern  int         cm_numCheckIndexes;
+
+extern  Q_THREAD_LOCAL int   c_pointcontents;
+extern  Q_THREAD_LOCAL int   c_traces, c_brush_traces, c_patch_traces;
 extern  cvar_t      *cm_noAreas;
 extern  cvar_t      *cm_noCurves;
+extern  cvar_t      *cm_flatNodes;
+extern  cvar_t      *cm_simdBrushes;
+extern  cvar_t      *cm_patchCache;
+extern  cvar_t      *cm_terrainGrid;
 extern  cvar_t      *cm_playerCurveClip;
 
 // cm_load.c
@@ -178,6 +205,8 @@ typedef struct {
     qboolean    isPoint;        // optimized case
     trace_t     trace;          // returned from trace call
     sphere_t    sphere;         // sphere for oriendted capsule collision
+    int         *checkStamps;   // this thread's stamps, [checkIndex] == checkcount if already tested
+    int         checkcount;     // unique to this trace
 } traceWork_t;
 
 typedef struct {
@@ -192,6 +221,8 @@ typedef struct leafList_s {
     int     *list;
     vec3_t  bounds[2];
     int     lastLeaf;       // for overflows where each leaf can't be stored individually
+    int     *checkStamps;   // only used by CM_StoreBrushes
+    int     checkcount;
     void    (*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
@@ -209,10 +240,22 @@ qboolean CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const ve
 
 // cm_patch.c
 
+typedef struct {
+    int         width;
+    int         height;
+    vec3_t      *points;            // packed as concatenated rows
+} cPatchPoints_t;
+
 struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t *points );
+void CM_GeneratePatchCollides( int count, const cPatchPoints_t *patches, struct patchCollide_s **out );
+void QDECL CM_PatchError( int code, const char *fmt, ... ) __attribute__ ((noreturn, format(printf, 2, 3)));
 void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 qboolean CM_PositionTestInPatchCollide( traceWork_t *tw, const struct patchCollide_s *pc );
 void CM_ClearLevelPatches( void );
+#ifndef BSPC
+qboolean CM_ReadPatchCache( clipMap_t *cm, const char *mapName, unsigned key );
+void CM_WritePatchCache( const clipMap_t *cm, const char *mapName, unsigned key );
+#endif
 
 // cm_shader.c
 
@@ -227,11 +270,17 @@ void        CM_LoadShaderFiles              ( void );
 dshader_t   *CM_FindShaderByName            ( const char *name );
 
 // cm_terrain.c
-void        CM_TerrainPatchCollide          ( cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end, int checkcount );
+void        CM_TerrainPatchCollide          ( cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end );
+void        CM_TerrainGridCollide           ( cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end );
 float       CM_TerrainWaterCollide          ( cTerrain_t *t, const vec3_t begin, const vec3_t end, float fraction );
 
 // cm_trace.c
+int         CM_AllocCheckIndexes            ( int count );
+int         *CM_BeginCheck                  ( int *checkcount );
+
 void        CM_CalcExtents                  ( const vec3_t start, const vec3_t end, const traceWork_t *tw, vec3_t bounds[2] );
+qboolean    CM_DoBoxesCollide               ( const vec3_t boundsA[2], const vec3_t boundsB[2] );
+void        CM_TraceThroughBrush            ( traceWork_t *tw, cbrush_t *brush, traceFraction_t *fractionOnly );
 
-void        CM_HandleTerrainPatchCollide    ( traceWork_t *tw, cTerrainPatch_t *patch, int checkcount );
+void        CM_HandleTerrainPatchCollide    ( traceWork_t *tw, cTerrainPatch_t *patch );
 void        CM_TraceThroughTerrain          ( traceWork_t *tw, cbrush_t *brush );
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cm_local.h"
 #include "cm_patch.h"
+#include <setjmp.h>
 
 /*
 
@@ -89,6 +90,12 @@ static const facet_t        *debugFacet;
 static qboolean     debugBlock;
 static vec3_t       debugBlockPoints[4];
 
+#ifndef BSPC
+// registered up front, traces may run on any thread
+static cvar_t       *cm_debugSurface;
+static cvar_t       *cm_debugSurfaceUpdate;
+#endif
+
 /*
 =================
 CM_ClearLevelPatches
@@ -97,6 +104,108 @@ CM_ClearLevelPatches
 void CM_ClearLevelPatches( void ) {
     debugPatchCollide = NULL;
     debugFacet = NULL;
+
+#ifndef BSPC
+    cm_debugSurface = Cvar_Get( "r_debugSurface", "0", 0 );
+    cm_debugSurfaceUpdate = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
+#endif
+}
+
+/*
+================================================================================
+
+JOB SUPPORT
+
+Patches are generated on the job threads while a map loads. Com_Error may
+only be thrown on the main thread, so errors in a job are recorded and
+raised again once all of them are done, and messages are held back until
+then so they come out in surface order.
+
+================================================================================
+*/
+
+typedef struct {
+    int             width;
+    int             height;
+    vec3_t          *points;
+
+    patchCollide_t  *pc;            // malloced, the planes and facets follow it
+    int             blocks;
+
+    jmp_buf         *abort;
+    int             errorCode;
+    char            error[256];
+    char            log[256];
+} patchJob_t;
+
+static Q_THREAD_LOCAL patchJob_t    *patchJob;
+
+/*
+=================
+CM_PatchError
+
+Com_Error that is safe to call from the patch jobs, polylib
+uses it as well since the facets are built from windings
+=================
+*/
+void QDECL CM_PatchError( int code, const char *fmt, ... ) {
+    va_list     argptr;
+    char        text[MAX_STRING_CHARS];
+
+    va_start( argptr, fmt );
+    Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+    va_end( argptr );
+
+    if ( !patchJob ) {
+        Com_Error( code, "%s", text );
+    }
+
+    patchJob->errorCode = code;
+    Q_strncpyz( patchJob->error, text, sizeof( patchJob->error ) );
+    longjmp( *patchJob->abort, 1 );
+}
+
+/*
+=================
+CM_PatchPrintf
+=================
+*/
+static void QDECL CM_PatchPrintf( const char *fmt, ... ) __attribute__ ((format(printf, 1, 2)));
+static void QDECL CM_PatchPrintf( const char *fmt, ... ) {
+    va_list     argptr;
+    char        text[MAX_STRING_CHARS];
+
+    va_start( argptr, fmt );
+    Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+    va_end( argptr );
+
+    if ( !patchJob ) {
+        Com_Printf( "%s", text );
+        return;
+    }
+
+    Q_strcat( patchJob->log, sizeof( patchJob->log ), text );
+}
+
+/*
+=================
+CM_PatchDPrintf
+=================
+*/
+static void QDECL CM_PatchDPrintf( const char *fmt, ... ) __attribute__ ((format(printf, 1, 2)));
+static void QDECL CM_PatchDPrintf( const char *fmt, ... ) {
+    va_list     argptr;
+    char        text[MAX_STRING_CHARS];
+
+    if ( !com_developer || !com_developer->integer ) {
+        return;
+    }
+
+    va_start( argptr, fmt );
+    Q_vsnprintf( text, sizeof( text ), fmt, argptr );
+    va_end( argptr );
+
+    CM_PatchPrintf( "%s", text );
 }
 
 /*
@@ -414,11 +523,12 @@ PATCH COLLIDE GENERATION
 ================================================================================
 */
 
-static  int             numPlanes;
-static  patchPlane_t    planes[MAX_PATCH_PLANES];
+// per thread, patches are generated on the job threads while loading
+static  Q_THREAD_LOCAL int             numPlanes;
+static  Q_THREAD_LOCAL patchPlane_t    planes[MAX_PATCH_PLANES];
 
-static  int             numFacets;
-static  facet_t         facets[MAX_FACETS];
+static  Q_THREAD_LOCAL int             numFacets;
+static  Q_THREAD_LOCAL facet_t         facets[MAX_FACETS];
 
 #define NORMAL_EPSILON  0.0001
 #define DIST_EPSILON    0.02
@@ -497,7 +607,7 @@ int CM_FindPlane2(float plane[4], int *flipped) {
 
     // add a new plane
     if ( numPlanes == MAX_PATCH_PLANES ) {
-        Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+        CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
     }
 
     Vector4Copy( plane, planes[numPlanes].plane );
@@ -551,7 +661,7 @@ static int CM_FindPlane( float *p1, float *p2, float *p3 ) {
 
     // add a new plane
     if ( numPlanes == MAX_PATCH_PLANES ) {
-        Com_Error( ERR_DROP, "MAX_PATCH_PLANES" );
+        CM_PatchError( ERR_DROP, "MAX_PATCH_PLANES" );
     }
 
     Vector4Copy( plane, planes[numPlanes].plane );
@@ -607,7 +717,7 @@ static int  CM_GridPlane( int gridPlanes[MAX_GRID_SIZE][MAX_GRID_SIZE][2], int i
     }
 
     // should never happen
-    Com_Printf( "WARNING: CM_GridPlane unresolvable\n" );
+    CM_PatchPrintf( "WARNING: CM_GridPlane unresolvable\n" );
     return -1;
 }
 
@@ -684,7 +794,7 @@ static int CM_EdgePlaneNum( cGrid_t *grid, int gridPlanes[MAX_GRID_SIZE][MAX_GRI
 
     }
 
-    Com_Error( ERR_DROP, "CM_EdgePlaneNum: bad k" );
+    CM_PatchError( ERR_DROP, "CM_EdgePlaneNum: bad k" );
     return -1;
 }
 
@@ -720,7 +830,7 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
         numPoints = 3;
         break;
     default:
-        Com_Error( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
+        CM_PatchError( ERR_FATAL, "CM_SetBorderInward: bad parameter" );
         numPoints = 0;
         break;
     }
@@ -751,9 +861,9 @@ static void CM_SetBorderInward( facet_t *facet, cGrid_t *grid, int gridPlanes[MA
             facet->borderPlanes[k] = -1;
         } else {
             // bisecting side border
-            Com_DPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
+            CM_PatchDPrintf( "WARNING: CM_SetBorderInward: mixed plane sides\n" );
             facet->borderInward[k] = qfalse;
-            if ( !debugBlock ) {
+            if ( !debugBlock && !patchJob ) {
                 debugBlock = qtrue;
                 VectorCopy( grid->points[i][j], debugBlockPoints[0] );
                 VectorCopy( grid->points[i+1][j], debugBlockPoints[1] );
@@ -876,7 +986,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
             if ( i == facet->numBorders ) {
                 if ( facet->numBorders >= 4 + 6 + 16 ) {
-                    Com_Printf( "ERROR: too many bevels\n" );
+                    CM_PatchPrintf( "ERROR: too many bevels\n" );
                     continue;
                 }
                 facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
@@ -941,14 +1051,14 @@ void CM_AddFacetBevels( facet_t *facet ) {
 
                 if ( i == facet->numBorders ) {
                     if ( facet->numBorders >= 4 + 6 + 16 ) {
-                        Com_Printf( "ERROR: too many bevels\n" );
+                        CM_PatchPrintf( "ERROR: too many bevels\n" );
                         continue;
                     }
                     facet->borderPlanes[facet->numBorders] = CM_FindPlane2(plane, &flipped);
 
                     for ( k = 0 ; k < facet->numBorders ; k++ ) {
                         if (facet->borderPlanes[facet->numBorders] ==
-                            facet->borderPlanes[k]) Com_Printf("WARNING: bevel plane already used\n");
+                            facet->borderPlanes[k]) CM_PatchPrintf("WARNING: bevel plane already used\n");
                     }
 
                     facet->borderNoAdjust[facet->numBorders] = 0;
@@ -963,7 +1073,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
                     } //end if
                     ChopWindingInPlace( &w2, newplane, newplane[3], 0.1f );
                     if (!w2) {
-                        Com_DPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
+                        CM_PatchDPrintf("WARNING: CM_AddFacetBevels... invalid bevel\n");
                         continue;
                     }
                     else {
@@ -982,7 +1092,7 @@ void CM_AddFacetBevels( facet_t *facet ) {
 #ifndef BSPC
     //add opposite plane
     if ( facet->numBorders >= 4 + 6 + 16 ) {
-        Com_Printf( "ERROR: too many bevels\n" );
+        CM_PatchPrintf( "ERROR: too many bevels\n" );
         return;
     }
     facet->borderPlanes[facet->numBorders] = facet->surfacePlane;
@@ -1080,7 +1190,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
             }
 
             if ( numFacets == MAX_FACETS ) {
-                Com_Error( ERR_DROP, "MAX_FACETS" );
+                CM_PatchError( ERR_DROP, "MAX_FACETS" );
             }
             facet = &facets[numFacets];
             Com_Memset( facet, 0, sizeof( *facet ) );
@@ -1126,7 +1236,7 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
                 }
 
                 if ( numFacets == MAX_FACETS ) {
-                    Com_Error( ERR_DROP, "MAX_FACETS" );
+                    CM_PatchError( ERR_DROP, "MAX_FACETS" );
                 }
                 facet = &facets[numFacets];
                 Com_Memset( facet, 0, sizeof( *facet ) );
@@ -1153,42 +1263,38 @@ static void CM_PatchCollideFromGrid( cGrid_t *grid, patchCollide_t *pf ) {
         }
     }
 
-    // copy the results out
+    // the results are left in planes and facets
+    // for the caller to copy out
     pf->numPlanes = numPlanes;
     pf->numFacets = numFacets;
-    pf->facets = Hunk_Alloc( numFacets * sizeof( *pf->facets ), h_high );
-    Com_Memcpy( pf->facets, facets, numFacets * sizeof( *pf->facets ) );
-    pf->planes = Hunk_Alloc( numPlanes * sizeof( *pf->planes ), h_high );
-    Com_Memcpy( pf->planes, planes, numPlanes * sizeof( *pf->planes ) );
 }
 
 
 /*
 ===================
-CM_GeneratePatchCollide
+CM_PatchCollideFromPoints
 
-Creates an internal structure that will be used to perform
-collision detection with a patch mesh.
+Fills in everything in pf but the planes and facets, which are
+left in planes and facets. Returns the number of grid blocks.
 
 Points is packed as concatenated rows.
 ===================
 */
-struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
-    patchCollide_t  *pf;
+static int CM_PatchCollideFromPoints( int width, int height, vec3_t *points, patchCollide_t *pf ) {
     cGrid_t         grid;
     int             i, j;
 
     if ( width <= 2 || height <= 2 || !points ) {
-        Com_Error( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
+        CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: bad parameters: (%i, %i, %p)",
             width, height, (void *)points );
     }
 
     if ( !(width & 1) || !(height & 1) ) {
-        Com_Error( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
+        CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: even sizes are invalid for quadratic meshes" );
     }
 
     if ( width > MAX_GRID_SIZE || height > MAX_GRID_SIZE ) {
-        Com_Error( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
+        CM_PatchError( ERR_DROP, "CM_GeneratePatchFacets: source is > MAX_GRID_SIZE" );
     }
 
     // build a grid
@@ -1216,7 +1322,6 @@ struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t
     // we now have a grid of points exactly on the curve
     // the approximate surface defined by these points will be
     // collided against
-    pf = Hunk_Alloc( sizeof( *pf ), h_high );
     ClearBounds( pf->bounds[0], pf->bounds[1] );
     for ( i = 0 ; i < grid.width ; i++ ) {
         for ( j = 0 ; j < grid.height ; j++ ) {
@@ -1224,8 +1329,6 @@ struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t
         }
     }
 
-    c_totalPatchBlocks += ( grid.width - 1 ) * ( grid.height - 1 );
-
     // generate a bsp tree for the surface
     CM_PatchCollideFromGrid( &grid, pf );
 
@@ -1238,9 +1341,415 @@ struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t
     pf->bounds[1][1] += 1;
     pf->bounds[1][2] += 1;
 
+    return ( grid.width - 1 ) * ( grid.height - 1 );
+}
+
+/*
+===================
+CM_CopyPatchCollide
+
+Copies a generated patch into the hunk.
+===================
+*/
+static patchCollide_t *CM_CopyPatchCollide( const patchCollide_t *src, const patchPlane_t *srcPlanes, const facet_t *srcFacets ) {
+    patchCollide_t  *pf;
+
+    pf = Hunk_Alloc( sizeof( *pf ), h_high );
+    VectorCopy( src->bounds[0], pf->bounds[0] );
+    VectorCopy( src->bounds[1], pf->bounds[1] );
+
+    pf->numPlanes = src->numPlanes;
+    pf->numFacets = src->numFacets;
+    pf->facets = Hunk_Alloc( pf->numFacets * sizeof( *pf->facets ), h_high );
+    Com_Memcpy( pf->facets, srcFacets, pf->numFacets * sizeof( *pf->facets ) );
+    pf->planes = Hunk_Alloc( pf->numPlanes * sizeof( *pf->planes ), h_high );
+    Com_Memcpy( pf->planes, srcPlanes, pf->numPlanes * sizeof( *pf->planes ) );
+
     return pf;
 }
 
+/*
+===================
+CM_GeneratePatchCollide
+
+Creates an internal structure that will be used to perform
+collision detection with a patch mesh.
+
+Points is packed as concatenated rows.
+===================
+*/
+struct patchCollide_s   *CM_GeneratePatchCollide( int width, int height, vec3_t *points ) {
+    patchCollide_t  pf;
+
+    c_totalPatchBlocks += CM_PatchCollideFromPoints( width, height, points, &pf );
+
+    return CM_CopyPatchCollide( &pf, planes, facets );
+}
+
+/*
+===================
+CM_GeneratePatchJob
+===================
+*/
+static void CM_GeneratePatchJob( void *data, int index ) {
+    patchJob_t      *job = (patchJob_t *)data + index;
+    patchCollide_t  pf;
+    jmp_buf         abort;
+    void            *windings;
+
+    job->abort = &abort;
+    patchJob = job;
+    windings = WindingsMark();
+
+    if ( setjmp( abort ) ) {
+        // free the windings the facet code was holding
+        FreeWindingsSince( windings );
+    } else {
+        job->blocks = CM_PatchCollideFromPoints( job->width, job->height, job->points, &pf );
+
+        job->pc = malloc( sizeof( pf ) + numPlanes * sizeof( patchPlane_t ) + numFacets * sizeof( facet_t ) );
+        if ( !job->pc ) {
+            CM_PatchError( ERR_FATAL, "CM_GeneratePatchJob: out of memory" );
+        }
+
+        *job->pc = pf;
+        job->pc->planes = (patchPlane_t *)( job->pc + 1 );
+        Com_Memcpy( job->pc->planes, planes, numPlanes * sizeof( patchPlane_t ) );
+        job->pc->facets = (facet_t *)( job->pc->planes + numPlanes );
+        Com_Memcpy( job->pc->facets, facets, numFacets * sizeof( facet_t ) );
+    }
+
+    patchJob = NULL;
+}
+
+/*
+===================
+CM_GeneratePatchCollides
+
+CM_GeneratePatchCollide for a whole map at once, spread over the job
+threads. The results are copied into the hunk in order afterwards, so
+they come out the same however the work was split up.
+===================
+*/
+void CM_GeneratePatchCollides( int count, const cPatchPoints_t *patches, struct patchCollide_s **out ) {
+    patchJob_t  *jobs;
+    char        error[sizeof( jobs->error )];
+    int         errorCode;
+    int         i;
+
+    if ( count <= 0 ) {
+        return;
+    }
+
+    jobs = Hunk_AllocateTempMemory( count * sizeof( *jobs ) );
+    Com_Memset( jobs, 0, count * sizeof( *jobs ) );
+
+    for ( i = 0 ; i < count ; i++ ) {
+        jobs[i].width = patches[i].width;
+        jobs[i].height = patches[i].height;
+        jobs[i].points = patches[i].points;
+    }
+
+    Com_RunJobs( CM_GeneratePatchJob, jobs, count );
+
+    errorCode = 0;
+    for ( i = 0 ; i < count ; i++ ) {
+        if ( jobs[i].log[0] ) {
+            Com_Printf( "%s", jobs[i].log );
+        }
+
+        if ( jobs[i].errorCode ) {
+            errorCode = jobs[i].errorCode;
+            Q_strncpyz( error, jobs[i].error, sizeof( error ) );
+            break;
+        }
+
+        out[i] = CM_CopyPatchCollide( jobs[i].pc, jobs[i].pc->planes, jobs[i].pc->facets );
+        c_totalPatchBlocks += jobs[i].blocks;
+    }
+
+    for ( i = 0 ; i < count ; i++ ) {
+        free( jobs[i].pc );
+    }
+    Hunk_FreeTempMemory( jobs );
+
+    if ( errorCode ) {
+        Com_Error( errorCode, "%s", error );
+    }
+}
+
+/*
+================================================================================
+
+PATCH COLLISION CACHE
+
+The facets and planes CM_GeneratePatchCollide builds only depend on the
+surfaces and drawverts of the BSP, so they are written out after the first
+load and read back in one go on later loads of the same map. The file is
+keyed by a checksum of those two lumps and by the engine version, anything
+that doesn't match exactly is thrown away and the cache rebuilt.
+
+Layout: the header, then for every patch surface in order a
+patchCacheRecord_t followed by its planes and facets.
+
+================================================================================
+*/
+
+#ifndef BSPC
+
+#define PATCH_CACHE_IDENT       (('L'<<24)+('O'<<16)+('C'<<8)+'P')
+#define PATCH_CACHE_VERSION     1
+
+typedef struct {
+    int         ident;
+    int         version;
+    char        engine[64];         // Q3_VERSION that wrote the file, may be cut short
+    unsigned    key;                // checksum of the surface and drawvert lumps
+    int         numSurfaces;
+    int         numPatches;
+    int         dataSize;           // bytes following the header
+    unsigned    dataChecksum;
+} patchCacheHeader_t;
+
+typedef struct {
+    int         surfaceNum;
+    vec3_t      bounds[2];
+    int         numPlanes;
+    int         numFacets;
+} patchCacheRecord_t;
+
+/*
+====================
+CM_PatchCacheName
+====================
+*/
+static void CM_PatchCacheName( const char *mapName, char *out, int outSize ) {
+    char    stripped[MAX_QPATH];
+
+    COM_StripExtension( mapName, stripped, sizeof( stripped ) );
+    Com_sprintf( out, outSize, "cache/%s.pcol", stripped );
+}
+
+/*
+====================
+CM_CheckPatchCacheRecords
+
+Walks the records without keeping anything, so a truncated or
+corrupt file is caught before any of it is used.
+====================
+*/
+static qboolean CM_CheckPatchCacheRecords( const clipMap_t *cm, const byte *data, int dataSize ) {
+    const patchCacheRecord_t    *rec;
+    const facet_t               *facets;
+    int                         offset;
+    int                         i, j, k;
+
+    offset = 0;
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+
+        if ( dataSize - offset < sizeof( *rec ) ) {
+            return qfalse;
+        }
+        rec = (const patchCacheRecord_t *)( data + offset );
+        offset += sizeof( *rec );
+
+        if ( rec->surfaceNum != i
+            || rec->numPlanes < 0 || rec->numPlanes > MAX_PATCH_PLANES
+            || rec->numFacets < 0 || rec->numFacets > MAX_FACETS ) {
+            return qfalse;
+        }
+
+        if ( dataSize - offset < rec->numPlanes * sizeof( patchPlane_t ) + rec->numFacets * sizeof( facet_t ) ) {
+            return qfalse;
+        }
+        offset += rec->numPlanes * sizeof( patchPlane_t );
+        facets = (const facet_t *)( data + offset );
+        offset += rec->numFacets * sizeof( facet_t );
+
+        for ( j = 0 ; j < rec->numFacets ; j++ ) {
+            if ( facets[j].surfacePlane < 0 || facets[j].surfacePlane >= rec->numPlanes
+                || facets[j].numBorders < 0 || facets[j].numBorders > ARRAY_LEN( facets[j].borderPlanes ) ) {
+                return qfalse;
+            }
+            for ( k = 0 ; k < facets[j].numBorders ; k++ ) {
+                if ( facets[j].borderPlanes[k] < 0 || facets[j].borderPlanes[k] >= rec->numPlanes ) {
+                    return qfalse;
+                }
+            }
+        }
+    }
+
+    return offset == dataSize;
+}
+
+/*
+====================
+CM_ReadPatchCache
+
+Sets the patchCollide of every patch surface from the cache file.
+Returns qfalse and leaves the surfaces alone when there is no
+usable cache for this map.
+====================
+*/
+qboolean CM_ReadPatchCache( clipMap_t *cm, const char *mapName, unsigned key ) {
+    char                        cacheName[MAX_QPATH];
+    patchCacheHeader_t          header;
+    char                        engine[sizeof( header.engine )];
+    const patchCacheRecord_t    *rec;
+    patchCollide_t              *pc;
+    fileHandle_t                f;
+    byte                        *temp, *data;
+    int                         numPatches;
+    int                         length;
+    int                         offset;
+    int                         i;
+
+    numPatches = 0;
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( cm->surfaces[i] ) {
+            numPatches++;
+        }
+    }
+
+    Q_strncpyz( engine, Q3_VERSION, sizeof( engine ) );
+
+    CM_PatchCacheName( mapName, cacheName, sizeof( cacheName ) );
+    length = FS_FOpenFileRead( cacheName, &f, qfalse );
+    if ( !f ) {
+        return qfalse;
+    }
+
+    if ( length < sizeof( header ) || FS_Read( &header, sizeof( header ), f ) != sizeof( header )
+        || header.ident != PATCH_CACHE_IDENT || header.version != PATCH_CACHE_VERSION
+        || strncmp( header.engine, engine, sizeof( engine ) )
+        || header.key != key || header.numSurfaces != cm->numSurfaces || header.numPatches != numPatches
+        || header.dataSize < 0 || header.dataSize != length - sizeof( header ) ) {
+        Com_DPrintf( "%s is stale, rebuilding it\n", cacheName );
+        FS_FCloseFile( f );
+        return qfalse;
+    }
+
+    temp = Hunk_AllocateTempMemory( header.dataSize );
+    if ( FS_Read( temp, header.dataSize, f ) != header.dataSize
+        || Com_BlockChecksum( temp, header.dataSize ) != header.dataChecksum
+        || !CM_CheckPatchCacheRecords( cm, temp, header.dataSize ) ) {
+        Com_Printf( S_COLOR_YELLOW "WARNING: %s is corrupt, rebuilding it\n", cacheName );
+        Hunk_FreeTempMemory( temp );
+        FS_FCloseFile( f );
+        return qfalse;
+    }
+    FS_FCloseFile( f );
+
+    // the planes and facets are used in place, only the
+    // patchCollide_t headers around them are rebuilt
+    data = Hunk_Alloc( header.dataSize, h_high );
+    Com_Memcpy( data, temp, header.dataSize );
+    Hunk_FreeTempMemory( temp );
+
+    offset = 0;
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+
+        rec = (const patchCacheRecord_t *)( data + offset );
+        offset += sizeof( *rec );
+
+        pc = Hunk_Alloc( sizeof( *pc ), h_high );
+        VectorCopy( rec->bounds[0], pc->bounds[0] );
+        VectorCopy( rec->bounds[1], pc->bounds[1] );
+        pc->numPlanes = rec->numPlanes;
+        pc->planes = (patchPlane_t *)( data + offset );
+        offset += rec->numPlanes * sizeof( patchPlane_t );
+        pc->numFacets = rec->numFacets;
+        pc->facets = (facet_t *)( data + offset );
+        offset += rec->numFacets * sizeof( facet_t );
+
+        cm->surfaces[i]->pc = pc;
+    }
+
+    return qtrue;
+}
+
+/*
+====================
+CM_WritePatchCache
+====================
+*/
+void CM_WritePatchCache( const clipMap_t *cm, const char *mapName, unsigned key ) {
+    char                    cacheName[MAX_QPATH];
+    patchCacheHeader_t      header;
+    patchCacheRecord_t      *rec;
+    const patchCollide_t    *pc;
+    fileHandle_t            f;
+    byte                    *data;
+    int                     offset;
+    int                     i;
+
+    Com_Memset( &header, 0, sizeof( header ) );
+    header.ident = PATCH_CACHE_IDENT;
+    header.version = PATCH_CACHE_VERSION;
+    Q_strncpyz( header.engine, Q3_VERSION, sizeof( header.engine ) );
+    header.key = key;
+    header.numSurfaces = cm->numSurfaces;
+
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+        pc = cm->surfaces[i]->pc;
+        header.numPatches++;
+        header.dataSize += sizeof( *rec ) + pc->numPlanes * sizeof( patchPlane_t ) + pc->numFacets * sizeof( facet_t );
+    }
+
+    if ( !header.numPatches ) {
+        return;
+    }
+
+    // gather everything first, the header holds a checksum of it
+    data = Hunk_AllocateTempMemory( header.dataSize );
+    offset = 0;
+
+    for ( i = 0 ; i < cm->numSurfaces ; i++ ) {
+        if ( !cm->surfaces[i] ) {
+            continue;
+        }
+        pc = cm->surfaces[i]->pc;
+
+        rec = (patchCacheRecord_t *)( data + offset );
+        rec->surfaceNum = i;
+        VectorCopy( pc->bounds[0], rec->bounds[0] );
+        VectorCopy( pc->bounds[1], rec->bounds[1] );
+        rec->numPlanes = pc->numPlanes;
+        rec->numFacets = pc->numFacets;
+        offset += sizeof( *rec );
+
+        Com_Memcpy( data + offset, pc->planes, pc->numPlanes * sizeof( patchPlane_t ) );
+        offset += pc->numPlanes * sizeof( patchPlane_t );
+        Com_Memcpy( data + offset, pc->facets, pc->numFacets * sizeof( facet_t ) );
+        offset += pc->numFacets * sizeof( facet_t );
+    }
+
+    header.dataChecksum = Com_BlockChecksum( data, header.dataSize );
+
+    CM_PatchCacheName( mapName, cacheName, sizeof( cacheName ) );
+    f = FS_FOpenFileWrite( cacheName );
+    if ( !f ) {
+        Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", cacheName );
+    } else {
+        FS_Write( &header, sizeof( header ), f );
+        FS_Write( data, header.dataSize, f );
+        FS_FCloseFile( f );
+    }
+
+    Hunk_FreeTempMemory( data );
+}
+
+#endif // !BSPC
+
 /*
 ================================================================================
 
@@ -1265,9 +1774,6 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
     int         i, j, k;
     float       offset;
     float       d1, d2;
-#ifndef BSPC
-    static cvar_t *cv;
-#endif //BSPC
 
 #ifndef BSPC
     if ( !cm_playerCurveClip->integer || !tw->isPoint ) {
@@ -1325,10 +1831,8 @@ void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patchCollid
         if ( j == facet->numBorders ) {
             // we hit this facet
 #ifndef BSPC
-            if (!cv) {
-                cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-            }
-            if (cv->integer) {
+            // only remembered while it's being drawn
+            if (cm_debugSurface && cm_debugSurface->integer == 1 && cm_debugSurfaceUpdate->integer) {
                 debugPatchCollide = pc;
                 debugFacet = facet;
             }
@@ -1409,9 +1913,6 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
     facet_t *facet;
     float plane[4] = {0, 0, 0, 0}, bestplane[4] = {0, 0, 0, 0};
     vec3_t startp, endp;
-#ifndef BSPC
-    static cvar_t *cv;
-#endif //BSPC
 
     if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
                 pc->bounds[0], pc->bounds[1] ) ) {
@@ -1512,10 +2013,8 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
                     enterFrac = 0;
                 }
 #ifndef BSPC
-                if (!cv) {
-                    cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
-                }
-                if (cv && cv->integer) {
+                // only remembered while it's being drawn
+                if (cm_debugSurface && cm_debugSurface->integer == 1 && cm_debugSurfaceUpdate->integer) {
                     debugPatchCollide = pc;
                     debugFacet = facet;
                 }
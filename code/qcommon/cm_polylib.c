@@ -28,10 +28,19 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 // counters are only bumped when running single threaded,
 // because they are an awful coherence problem
-int c_active_windings;
-int c_peak_windings;
-int c_winding_allocs;
-int c_winding_points;
+Q_THREAD_LOCAL int c_active_windings;
+Q_THREAD_LOCAL int c_peak_windings;
+Q_THREAD_LOCAL int c_winding_allocs;
+Q_THREAD_LOCAL int c_winding_points;
+
+// every winding a thread holds is linked in front of it, so a patch
+// job that bails out with CM_PatchError can free what it had allocated
+typedef struct windingLink_s
+{
+    struct windingLink_s    *prev, *next;
+} windingLink_t;
+
+static Q_THREAD_LOCAL windingLink_t *activeWindings;
 
 void pw(winding_t *w)
 {
@@ -48,7 +57,7 @@ AllocWinding
 */
 winding_t   *AllocWinding (int points)
 {
-    winding_t   *w;
+    windingLink_t   *link;
     int         s;
 
     c_winding_allocs++;
@@ -57,20 +66,66 @@ winding_t   *AllocWinding (int points)
     if (c_active_windings > c_peak_windings)
         c_peak_windings = c_active_windings;
 
+    // patch facets are built on the job threads, so stay away from the zone
     s = sizeof(vec_t)*3*points + sizeof(int);
-    w = Z_Malloc (s);
-    Com_Memset (w, 0, s);
-    return w;
+    link = malloc (sizeof(*link) + s);
+    if (!link)
+        CM_PatchError (ERR_FATAL, "AllocWinding: failed to allocate %i bytes", s);
+    Com_Memset (link + 1, 0, s);
+
+    link->prev = NULL;
+    link->next = activeWindings;
+    if (activeWindings)
+        activeWindings->prev = link;
+    activeWindings = link;
+
+    return (winding_t *)(link + 1);
 }
 
 void FreeWinding (winding_t *w)
 {
+    windingLink_t   *link;
+
     if (*(unsigned *)w == 0xdeaddead)
-        Com_Error (ERR_FATAL, "FreeWinding: freed a freed winding");
+        CM_PatchError (ERR_FATAL, "FreeWinding: freed a freed winding");
     *(unsigned *)w = 0xdeaddead;
 
+    link = (windingLink_t *)w - 1;
+    if (link->prev)
+        link->prev->next = link->next;
+    else
+        activeWindings = link->next;
+    if (link->next)
+        link->next->prev = link->prev;
+
     c_active_windings--;
-    Z_Free (w);
+    free (link);
+}
+
+/*
+=============
+WindingsMark
+
+Returns a mark for FreeWindingsSince
+=============
+*/
+void *WindingsMark (void)
+{
+    return activeWindings;
+}
+
+/*
+=============
+FreeWindingsSince
+
+Frees every winding this thread allocated after the mark was
+taken that is still held
+=============
+*/
+void FreeWindingsSince (void *mark)
+{
+    while (activeWindings && activeWindings != mark)
+        FreeWinding ((winding_t *)(activeWindings + 1));
 }
 
 /*
@@ -78,7 +133,7 @@ void FreeWinding (winding_t *w)
 RemoveColinearPoints
 ============
 */
-int c_removed;
+Q_THREAD_LOCAL int c_removed;
 
 void    RemoveColinearPoints (winding_t *w)
 {
@@ -220,7 +275,7 @@ winding_t *BaseWindingForPlane (vec3_t normal, vec_t dist)
         }
     }
     if (x==-1)
-        Com_Error (ERR_DROP, "BaseWindingForPlane: no axis found");
+        CM_PatchError (ERR_DROP, "BaseWindingForPlane: no axis found");
 
     VectorCopy (vec3_origin, vup);
     switch (x)
@@ -407,9 +462,9 @@ void    ClipWindingEpsilon (winding_t *in, vec3_t normal, vec_t dist,
     }
 
     if (f->numpoints > maxpts || b->numpoints > maxpts)
-        Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+        CM_PatchError (ERR_DROP, "ClipWinding: points exceeded estimate");
     if (f->numpoints > MAX_POINTS_ON_WINDING || b->numpoints > MAX_POINTS_ON_WINDING)
-        Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+        CM_PatchError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 }
 
 
@@ -506,9 +561,9 @@ void ChopWindingInPlace (winding_t **inout, vec3_t normal, vec_t dist, vec_t eps
     }
 
     if (f->numpoints > maxpts)
-        Com_Error (ERR_DROP, "ClipWinding: points exceeded estimate");
+        CM_PatchError (ERR_DROP, "ClipWinding: points exceeded estimate");
     if (f->numpoints > MAX_POINTS_ON_WINDING)
-        Com_Error (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
+        CM_PatchError (ERR_DROP, "ClipWinding: MAX_POINTS_ON_WINDING");
 
     FreeWinding (in);
     *inout = f;
@@ -551,11 +606,11 @@ void CheckWinding (winding_t *w)
     vec_t   facedist;
 
     if (w->numpoints < 3)
-        Com_Error (ERR_DROP, "CheckWinding: %i points",w->numpoints);
+        CM_PatchError (ERR_DROP, "CheckWinding: %i points",w->numpoints);
 
     area = WindingArea(w);
     if (area < 1)
-        Com_Error (ERR_DROP, "CheckWinding: %f area", area);
+        CM_PatchError (ERR_DROP, "CheckWinding: %f area", area);
 
     WindingPlane (w, facenormal, &facedist);
 
@@ -565,21 +620,21 @@ void CheckWinding (winding_t *w)
 
         for (j=0 ; j<3 ; j++)
             if (p1[j] > MAX_MAP_BOUNDS || p1[j] < -MAX_MAP_BOUNDS)
-                Com_Error (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
+                CM_PatchError (ERR_DROP, "CheckFace: BUGUS_RANGE: %f",p1[j]);
 
         j = i+1 == w->numpoints ? 0 : i+1;
 
     // check the point is on the face plane
         d = DotProduct (p1, facenormal) - facedist;
         if (d < -ON_EPSILON || d > ON_EPSILON)
-            Com_Error (ERR_DROP, "CheckWinding: point off plane");
+            CM_PatchError (ERR_DROP, "CheckWinding: point off plane");
 
     // check the edge isn't degenerate
         p2 = w->p[j];
         VectorSubtract (p2, p1, dir);
 
         if (VectorLength (dir) < ON_EPSILON)
-            Com_Error (ERR_DROP, "CheckWinding: degenerate edge");
+            CM_PatchError (ERR_DROP, "CheckWinding: degenerate edge");
 
         CrossProduct (facenormal, dir, edgenormal);
         VectorNormalize2 (edgenormal, edgenormal);
@@ -593,7 +648,7 @@ void CheckWinding (winding_t *w)
                 continue;
             d = DotProduct (w->p[j], edgenormal);
             if (d > edgedist)
-                Com_Error (ERR_DROP, "CheckWinding: non-convex");
+                CM_PatchError (ERR_DROP, "CheckWinding: non-convex");
         }
     }
 }
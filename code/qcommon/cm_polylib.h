@@ -58,6 +58,8 @@ void    WindingPlane (winding_t *w, vec3_t normal, vec_t *dist);
 void    RemoveColinearPoints (winding_t *w);
 int     WindingOnPlaneSide (winding_t *w, vec3_t normal, vec_t dist);
 void    FreeWinding (winding_t *w);
+void    *WindingsMark (void);
+void    FreeWindingsSince (void *mark);
 void    WindingBounds (winding_t *w, vec3_t mins, vec3_t maxs);
 
 void    AddWindingToConvexHull( winding_t *w, winding_t **hull, vec3_t normal );
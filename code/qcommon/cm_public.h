@@ -49,6 +49,10 @@ void        CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const
                           clipHandle_t model, int brushmask,
                           const vec3_t origin, const vec3_t angles, int capsule );
 
+// traces may run on any thread once the map is loaded, except against
+// temp box models; threads must release their stamps before they exit
+void        CM_FreeThreadCheckStamps( void );
+
 byte        *CM_ClusterPVS (int cluster);
 
 int         CM_PointLeafnum( const vec3_t p );
@@ -57,12 +61,17 @@ int         CM_PointLeafnum( const vec3_t p );
 // overflow if return listsize and if *lastLeaf != list[listsize-1]
 int         CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list,
                             int listsize, int *lastLeaf );
+// also returns how far the box faces can move and still touch the same leafs
+int         CM_BoxLeafnumsMargin( const vec3_t mins, const vec3_t maxs, int *list,
+                            int listsize, int *lastLeaf, float *margin );
 
 int         CM_LeafCluster (int leafnum);
 int         CM_LeafArea (int leafnum);
 
 void        CM_AdjustAreaPortalState( int area1, int area2, qboolean open );
 qboolean    CM_AreasConnected( int area1, int area2 );
+// changes whenever the areas connected to each other change, or a map is loaded
+int         CM_AreaConnectivityVersion( void );
 
 int         CM_WriteAreaBits( byte *buffer, int area );
 
@@ -25,6 +25,9 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 #include "cm_local.h"
 #include "genericparser2.h"
 
+// Terxel brush bounds are padded by this much.
+#define TERXEL_PAD          1.0f
+
 /*
 ==================
 CM_SetTerrainShaders
@@ -492,6 +495,8 @@ static void CM_InitTerrainPatch(cTerrain_t *t, cTerrainPatch_t *patch, int heigh
     int min, max;
     int height;
     int avgHeight;
+    int checkIndex;
+    int i;
 
     // Set owning terrain.
     patch->owner = t;
@@ -563,6 +568,12 @@ static void CM_InitTerrainPatch(cTerrain_t *t, cTerrainPatch_t *patch, int heigh
     // Number of brushes.
     patch->mNumBrushes = t->mTerxels * t->mTerxels * 2;
 
+    // Each brush gets its own slot in the trace check stamps.
+    checkIndex = CM_AllocCheckIndexes(patch->mNumBrushes);
+    for(i = 0; i < patch->mNumBrushes; i++){
+        ((cbrush_t *)patchBrushData)[i].checkIndex = checkIndex + i;
+    }
+
     // Continue creating patch plane data.
     CM_CreatePatchPlaneData(patch);
 }
@@ -850,7 +861,7 @@ patches.
 ==================
 */
 
-void CM_TerrainPatchCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end, int checkcount)
+void CM_TerrainPatchCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end)
 {
     vec3_t  tBounds[2];
     float   slope, offset;
@@ -934,7 +945,7 @@ void CM_TerrainPatchCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start,
                     // Valid location?
                     if(startPos >= 0 && startPos < t->mBlockHeight){
                         // Collide with every patch to find the minimum fraction.
-                        CM_HandleTerrainPatchCollide(tw, CM_GetPatch(t, startPatchLoc, startPos), checkcount);
+                        CM_HandleTerrainPatchCollide(tw, CM_GetPatch(t, startPatchLoc, startPos));
 
                         if(tw->trace.fraction <= 0.0f){
                             return;
@@ -1018,7 +1029,7 @@ void CM_TerrainPatchCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start,
                     // Valid location?
                     if(startPos >= 0 && startPos < t->mBlockWidth){
                         // Collide with every patch to find the minimum fraction.
-                        CM_HandleTerrainPatchCollide(tw, CM_GetPatch(t, startPos, startPatchLoc), checkcount);
+                        CM_HandleTerrainPatchCollide(tw, CM_GetPatch(t, startPos, startPatchLoc));
 
                         if(tw->trace.fraction <= 0.0f){
                             return;
@@ -1048,6 +1059,203 @@ void CM_TerrainPatchCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start,
     }
 }
 
+/*
+==================
+CM_TerxelCollide
+
+Traces through the two brushes
+of a terxel, unless the part of
+the trace above it stays clear
+of both top triangles.
+
+Only the top triangle is tested
+directly. The terxel brushes are
+solid down to the bottom of the
+terrain, and their side planes
+give the start and all solid
+results and the edge bevels that
+a box trace needs, which a plain
+swept box against triangle test
+would not.
+==================
+*/
+
+static void CM_TerxelCollide(cTerrain_t *t, traceWork_t *tw, int x, int y, const vec3_t pa, const vec3_t pb)
+{
+    cTerrainPatch_t *patch;
+    cbrush_t        *brush;
+    cplane_t        *plane;
+    float           dist;
+    int             i;
+
+    patch = CM_GetPatch(t, x / t->mTerxels, y / t->mTerxels);
+    brush = patch->mPatchBrushData + (((y % t->mTerxels) * t->mTerxels + (x % t->mTerxels)) * 2);
+
+    for(i = 0; i < 2; i++, brush++){
+        if(tw->checkStamps[brush->checkIndex] == tw->checkcount){
+            continue;
+        }
+
+        // The first side is the top triangle. If the box is
+        // above it all the way over the terxel it can't hit.
+        plane = brush->sides[0].plane;
+        dist = plane->dist - DotProduct(tw->offsets[plane->signbits], plane->normal);
+        if(DotProduct(pa, plane->normal) - dist >= TERXEL_PAD && DotProduct(pb, plane->normal) - dist >= TERXEL_PAD){
+            continue;
+        }
+
+        if(CM_DoBoxesCollide(brush->bounds, tw->localBounds)){
+            continue;
+        }
+
+        tw->checkStamps[brush->checkIndex] = tw->checkcount;
+        CM_TraceThroughBrush(tw, brush, NULL);
+    }
+}
+
+/*
+==================
+CM_TerxelRange
+
+Returns the first and last terxel
+on the given axis that the range
+of coordinates overlaps, or qfalse
+if it misses the terrain.
+==================
+*/
+
+static qboolean CM_TerxelRange(cTerrain_t *t, int axis, float lo, float hi, int *first, int *last)
+{
+    int size;
+
+    size = axis ? t->mHeight : t->mWidth;
+
+    *first = floor((lo - TERXEL_PAD - t->mBounds[0][axis]) / t->mTerxelSize[axis]);
+    *last = floor((hi + TERXEL_PAD - t->mBounds[0][axis]) / t->mTerxelSize[axis]);
+
+    if(*first < 0){
+        *first = 0;
+    }
+    if(*last > size - 1){
+        *last = size - 1;
+    }
+
+    return *first <= *last;
+}
+
+/*
+==================
+CM_TerrainGridCollide
+
+Walks the terxels under the trace
+box a column at a time along the
+axis it travels most on, in the
+order the trace passes them. Only
+the terxels of each column that the
+box passes over are tested, instead
+of every brush of every patch.
+==================
+*/
+
+void CM_TerrainGridCollide(cTerrain_t *t, traceWork_t *tw, const vec3_t start, const vec3_t end)
+{
+    vec3_t  delta;
+    vec3_t  pa, pb;
+    float   fa, fb, tmp;
+    float   lo, hi;
+    int     major, minor;
+    int     col, firstCol, lastCol, step;
+    int     row, firstRow, lastRow;
+
+    VectorSubtract(end, start, delta);
+
+    major = fabs(delta[0]) >= fabs(delta[1]) ? 0 : 1;
+    minor = major ^ 1;
+
+    // Columns the trace box passes over.
+    if(delta[major] < 0){
+        lo = end[major];
+        hi = start[major];
+    }else{
+        lo = start[major];
+        hi = end[major];
+    }
+
+    if(!CM_TerxelRange(t, major, lo + tw->size[0][major], hi + tw->size[1][major], &firstCol, &lastCol)){
+        return;
+    }
+
+    if(delta[major] < 0){
+        col = lastCol;
+        lastCol = firstCol;
+        step = -1;
+    }else{
+        col = firstCol;
+        step = 1;
+    }
+
+    for(;; col += step){
+        // Find the part of the trace that is over this column.
+        fa = 0.0f;
+        fb = 1.0f;
+        if(delta[major]){
+            lo = t->mBounds[0][major] + (col * t->mTerxelSize[major]) - TERXEL_PAD;
+            hi = lo + t->mTerxelSize[major] + (TERXEL_PAD * 2);
+
+            fa = (lo - tw->size[1][major] - start[major]) / delta[major];
+            fb = (hi - tw->size[0][major] - start[major]) / delta[major];
+            if(fa > fb){
+                tmp = fa;
+                fa = fb;
+                fb = tmp;
+            }
+
+            if(fa < 0.0f){
+                fa = 0.0f;
+            }
+            if(fb > 1.0f){
+                fb = 1.0f;
+            }
+        }
+
+        // Anything from here on is further along than what was hit.
+        if(tw->trace.fraction < fa){
+            return;
+        }
+
+        if(fa <= fb){
+            VectorMA(start, fa, delta, pa);
+            VectorMA(start, fb, delta, pb);
+
+            if(pa[minor] < pb[minor]){
+                lo = pa[minor];
+                hi = pb[minor];
+            }else{
+                lo = pb[minor];
+                hi = pa[minor];
+            }
+
+            if(CM_TerxelRange(t, minor, lo + tw->size[0][minor], hi + tw->size[1][minor], &firstRow, &lastRow)){
+                for(row = firstRow; row <= lastRow; row++){
+                    if(major == 0){
+                        CM_TerxelCollide(t, tw, col, row, pa, pb);
+                    }else{
+                        CM_TerxelCollide(t, tw, row, col, pa, pb);
+                    }
+
+                    if(tw->trace.fraction <= 0.0f){
+                        return;
+                    }
+                }
+            }
+        }
+
+        if(col == lastCol){
+            break;
+        }
+    }
+}
+
 /*
 ==================
 CM_TerrainWaterCollide
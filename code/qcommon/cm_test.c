@@ -33,6 +33,29 @@ int CM_PointLeafnum_r(clipMap_t *cm, const vec3_t p, int num)
     float       d;
     cNode_t     *node;
     cplane_t    *plane;
+    cFlatNode_t *flat;
+
+    // the flat layout numbers nodes differently, only the root is 0 in both
+    if (cm_flatNodes->integer && num == 0)
+    {
+        while (num >= 0)
+        {
+            flat = cm->flatNodes + num;
+
+            if (flat->type < 3)
+                d = p[flat->type] - flat->dist;
+            else
+                d = DotProduct (flat->normal, p) - flat->dist;
+            if (d < 0)
+                num = flat->children[1];
+            else
+                num = flat->children[0];
+        }
+
+        c_pointcontents++;      // optimize counter
+
+        return -1 - num;
+    }
 
     while (num >= 0)
     {
@@ -102,10 +125,10 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
     for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
         brushnum = cmg->leafbrushes[leaf->firstLeafBrush+k];
         b = &cmg->brushes[brushnum];
-        if ( b->checkcount == cmg->checkcount ) {
+        if ( ll->checkStamps[b->checkIndex] == ll->checkcount ) {
             continue;   // already checked this brush in another leaf
         }
-        b->checkcount = cmg->checkcount;
+        ll->checkStamps[b->checkIndex] = ll->checkcount;
         for ( i = 0 ; i < 3 ; i++ ) {
             if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
                 break;
@@ -173,8 +196,6 @@ CM_BoxLeafnums
 int CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
     leafList_t  ll;
 
-    cmg->checkcount++;
-
     VectorCopy( mins, ll.bounds[0] );
     VectorCopy( maxs, ll.bounds[1] );
     ll.count = 0;
@@ -190,6 +211,101 @@ int CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
     return ll.count;
 }
 
+/*
+=============
+CM_BoxLeafnumsMargin_r
+
+Same walk as CM_BoxLeafnums_r, but also lowers ll->margin to how far
+the box faces can move before the side of any visited plane changes.
+=============
+*/
+static void CM_BoxLeafnumsMargin_r( leafList_t *ll, int nodenum, float *margin ) {
+    cplane_t    *plane;
+    cNode_t     *node;
+    float       dist[2];
+    float       front, back, scale;
+    int         s, b, i;
+
+    while (1) {
+        if (nodenum < 0) {
+            ll->storeLeafs( ll, nodenum );
+            return;
+        }
+
+        node = &cmg->nodes[nodenum];
+        plane = node->plane;
+        s = BoxOnPlaneSide( ll->bounds[0], ll->bounds[1], plane );
+
+        // the corners BoxOnPlaneSide tested, and the largest
+        // change moving every face by one unit can make to them
+        if ( plane->type < 3 ) {
+            dist[0] = ll->bounds[1][plane->type];
+            dist[1] = ll->bounds[0][plane->type];
+            scale = 1.0f;
+        } else if ( plane->signbits < 8 ) {
+            dist[0] = dist[1] = 0;
+            for ( i = 0 ; i < 3 ; i++ ) {
+                b = ( plane->signbits >> i ) & 1;
+                dist[b] += plane->normal[i] * ll->bounds[1][i];
+                dist[!b] += plane->normal[i] * ll->bounds[0][i];
+            }
+            scale = fabs( plane->normal[0] ) + fabs( plane->normal[1] ) + fabs( plane->normal[2] );
+        } else {
+            dist[0] = dist[1] = 0;
+            scale = 0.0f;
+        }
+
+        if ( scale > 0.0f ) {
+            front = fabs( dist[0] - plane->dist ) / scale;
+            back = fabs( dist[1] - plane->dist ) / scale;
+            if ( front < *margin ) {
+                *margin = front;
+            }
+            if ( back < *margin ) {
+                *margin = back;
+            }
+        }
+
+        if (s == 1) {
+            nodenum = node->children[0];
+        } else if (s == 2) {
+            nodenum = node->children[1];
+        } else {
+            // go down both
+            CM_BoxLeafnumsMargin_r( ll, node->children[0], margin );
+            nodenum = node->children[1];
+        }
+    }
+}
+
+/*
+==================
+CM_BoxLeafnumsMargin
+
+CM_BoxLeafnums that also returns in *margin how far each face of the box
+may move, independently of the others, and still touch the same leafs.
+Faces exactly on a plane give a margin of 0.
+==================
+*/
+int CM_BoxLeafnumsMargin( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf, float *margin ) {
+    leafList_t  ll;
+
+    VectorCopy( mins, ll.bounds[0] );
+    VectorCopy( maxs, ll.bounds[1] );
+    ll.count = 0;
+    ll.maxcount = listsize;
+    ll.list = list;
+    ll.storeLeafs = CM_StoreLeafs;
+    ll.lastLeaf = 0;
+    ll.overflowed = qfalse;
+
+    *margin = WORLD_SIZE;
+    CM_BoxLeafnumsMargin_r( &ll, 0, margin );
+
+    *lastLeaf = ll.lastLeaf;
+    return ll.count;
+}
+
 /*
 ==================
 CM_BoxBrushes
@@ -198,7 +314,7 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
     leafList_t  ll;
 
-    cmg->checkcount++;
+    ll.checkStamps = CM_BeginCheck( &ll.checkcount );
 
     VectorCopy( mins, ll.bounds[0] );
     VectorCopy( maxs, ll.bounds[1] );
@@ -349,9 +465,18 @@ byte    *CM_ClusterPVS (int cluster) {
 
 AREAPORTALS
 
+Areas that can see each other through open portals share a floodnum. The
+floods are only worked out from scratch when a map is loaded. After that,
+opening a portal between two floods relabels one of them, and closing the
+last reference to a portal refloods only the flood it was in, to see if it
+fell apart. Reference count changes that don't open or close a portal leave
+the floods alone.
+
 ===============================================================================
 */
 
+static int  cm_areaConnectivityVersion;
+
 void CM_FloodArea_r(clipMap_t *cm, int areaNum, int floodnum)
 {
     int     i;
@@ -401,6 +526,56 @@ void CM_FloodAreaConnections(clipMap_t *cm)
         CM_FloodArea_r (cm, i, floodnum);
     }
 
+    cm->lastFloodnum = floodnum;
+    cm_areaConnectivityVersion++;
+}
+
+/*
+====================
+CM_JoinFloods
+
+A portal was opened between area1 and area2.
+====================
+*/
+static void CM_JoinFloods( clipMap_t *cm, int area1, int area2 )
+{
+    int     i;
+    int     from, to;
+
+    from = cm->areas[area2].floodnum;
+    to = cm->areas[area1].floodnum;
+
+    if ( from == to ) {
+        return;     // already connected some other way
+    }
+
+    for ( i = 0 ; i < cm->numAreas ; i++ ) {
+        if ( cm->areas[i].floodnum == from ) {
+            cm->areas[i].floodnum = to;
+        }
+    }
+
+    cm_areaConnectivityVersion++;
+}
+
+/*
+====================
+CM_SplitFlood
+
+The last portal between area1 and area2 was closed. Only the areas
+area1 can still reach get a new floodnum, so if area2 isn't among
+them the old floodnum is left to the areas on its side.
+====================
+*/
+static void CM_SplitFlood( clipMap_t *cm, int area1, int area2 )
+{
+    cm->floodvalid++;
+    cm->lastFloodnum++;
+    CM_FloodArea_r( cm, area1, cm->lastFloodnum );
+
+    if ( cm->areas[area2].floodnum != cm->lastFloodnum ) {
+        cm_areaConnectivityVersion++;
+    }
 }
 
 /*
@@ -421,15 +596,19 @@ void    CM_AdjustAreaPortalState( int area1, int area2, qboolean open ) {
     if ( open ) {
         cmg->areaPortals[ area1 * cmg->numAreas + area2 ]++;
         cmg->areaPortals[ area2 * cmg->numAreas + area1 ]++;
+
+        CM_JoinFloods( cmg, area1, area2 );
     } else {
         cmg->areaPortals[ area1 * cmg->numAreas + area2 ]--;
         cmg->areaPortals[ area2 * cmg->numAreas + area1 ]--;
         if ( cmg->areaPortals[ area2 * cmg->numAreas + area1 ] < 0 ) {
             Com_Error (ERR_DROP, "CM_AdjustAreaPortalState: negative reference count");
         }
-    }
 
-    CM_FloodAreaConnections (cmg);
+        if ( cmg->areaPortals[ area2 * cmg->numAreas + area1 ] == 0 ) {
+            CM_SplitFlood( cmg, area1, area2 );
+        }
+    }
 }
 
 /*
@@ -459,6 +638,18 @@ qboolean    CM_AreasConnected( int area1, int area2 ) {
     return qfalse;
 }
 
+/*
+====================
+CM_AreaConnectivityVersion
+
+Anything worked out from which areas are connected
+can be kept for as long as this stays the same.
+====================
+*/
+int CM_AreaConnectivityVersion( void ) {
+    return cm_areaConnectivityVersion;
+}
+
 
 /*
 =================
@@ -479,6 +670,7 @@ int CM_WriteAreaBits (byte *buffer, int area)
     int     i;
     int     floodnum;
     int     bytes;
+    cArea_t *a;
 
     bytes = (cmg->numAreas+7)>>3;
 
@@ -492,12 +684,23 @@ int CM_WriteAreaBits (byte *buffer, int area)
     }
     else
     {
-        floodnum = cmg->areas[area].floodnum;
-        for (i=0 ; i<cmg->numAreas ; i++)
+        // every client in an area asks for the same bits,
+        // so they are only worked out again after a change
+        a = &cmg->areas[area];
+        if (a->bitsVersion != cm_areaConnectivityVersion)
         {
-            if (cmg->areas[i].floodnum == floodnum || area == -1)
-                buffer[i>>3] |= 1<<(i&7);
+            Com_Memset (a->bits, 0, sizeof(a->bits));
+            floodnum = a->floodnum;
+            for (i=0 ; i<cmg->numAreas ; i++)
+            {
+                if (cmg->areas[i].floodnum == floodnum)
+                    a->bits[i>>3] |= 1<<(i&7);
+            }
+            a->bitsVersion = cm_areaConnectivityVersion;
         }
+
+        for (i=0 ; i<bytes ; i++)
+            buffer[i] |= a->bits[i];
     }
 
     return bytes;
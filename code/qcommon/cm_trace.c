@@ -21,6 +21,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "cm_local.h"
 
+#if idx64
+#include <emmintrin.h>
+#endif
+
 // always use bbox vs. bbox collision and never capsule vs. bbox or vice versa
 //#define ALWAYS_BBOX_VS_BBOX
 // always use capsule vs. capsule collision and never capsule vs. bbox or vice versa
@@ -145,6 +149,94 @@ float SquareRootFloat(float number) {
 }
 
 
+/*
+===============================================================================
+
+CHECK STAMPS
+
+A brush or patch can be in many leafs, so every trace remembers which ones
+it has tested already. Rather than stamping the shared clipmap, each thread
+keeps its own array of stamps indexed by checkIndex, and each trace takes
+a new checkcount from it. Traces never write to the clipmap and can run
+concurrently once the map is loaded.
+
+===============================================================================
+*/
+
+typedef struct {
+    int     *stamps;
+    int     numStamps;
+    int     checkcount;
+} cmCheckStamps_t;
+
+int         cm_numCheckIndexes;
+static Q_THREAD_LOCAL cmCheckStamps_t cm_checkStamps;
+
+/*
+================
+CM_AllocCheckIndexes
+
+Only called on the main thread while loading.
+================
+*/
+int CM_AllocCheckIndexes( int count ) {
+    int     first;
+
+    first = cm_numCheckIndexes;
+    cm_numCheckIndexes += count;
+    return first;
+}
+
+/*
+================
+CM_BeginCheck
+
+Returns the calling thread's stamps and a checkcount that
+none of them hold yet.
+================
+*/
+int *CM_BeginCheck( int *checkcount ) {
+    cmCheckStamps_t *cs = &cm_checkStamps;
+    int             *stamps;
+    int             numStamps;
+
+    if ( cs->numStamps < cm_numCheckIndexes ) {
+        // this may run on any thread, so stay away from the zone
+        numStamps = cm_numCheckIndexes + 1024;
+        stamps = realloc( cs->stamps, numStamps * sizeof( *stamps ) );
+        if ( !stamps ) {
+            Com_Error( ERR_FATAL, "CM_BeginCheck: failed to allocate %i stamps", numStamps );
+        }
+        memset( stamps + cs->numStamps, 0, ( numStamps - cs->numStamps ) * sizeof( *stamps ) );
+
+        cs->stamps = stamps;
+        cs->numStamps = numStamps;
+    }
+
+    if ( ++cs->checkcount <= 0 ) {
+        // wrapped, old stamps could match again
+        memset( cs->stamps, 0, cs->numStamps * sizeof( *cs->stamps ) );
+        cs->checkcount = 1;
+    }
+
+    *checkcount = cs->checkcount;
+    return cs->stamps;
+}
+
+/*
+================
+CM_FreeThreadCheckStamps
+
+Threads other than the main one must call this before they exit
+if they did any traces.
+================
+*/
+void CM_FreeThreadCheckStamps( void ) {
+    free( cm_checkStamps.stamps );
+    cm_checkStamps.stamps = NULL;
+    cm_checkStamps.numStamps = 0;
+}
+
 /*
 ===============================================================================
 
@@ -153,6 +245,55 @@ POSITION TESTING
 ===============================================================================
 */
 
+#if idx64
+/*
+================
+CM_BrushSideDists
+
+Distances of the trace start and end from four sides of a brush, pushed
+out for the box the way the scalar loops do it with tw->offsets.
+
+They are only good to within BRUSH_SIDE_TOLERANCE of the scalar ones,
+-ffast-math lets the compiler add up either version in any order. So
+they only decide the clear cases, any side close to a decision gets
+the exact scalar test, and the results stay identical.
+================
+*/
+#define BRUSH_SIDE_TOLERANCE    0.25f
+
+static ID_INLINE void CM_BrushSideDists( const traceWork_t *tw, const float *rows, int padded, int first,
+                                         __m128 *d1, __m128 *d2 ) {
+    __m128  nx, ny, nz, dist;
+    __m128  neg, ox, oy, oz, offset;
+    __m128  zero;
+
+    zero = _mm_setzero_ps();
+
+    nx = _mm_loadu_ps( rows + first );
+    ny = _mm_loadu_ps( rows + padded + first );
+    nz = _mm_loadu_ps( rows + 2 * padded + first );
+    dist = _mm_loadu_ps( rows + 3 * padded + first );
+
+    // offsets[signbits], the box corner furthest behind each plane
+    neg = _mm_cmplt_ps( nx, zero );
+    ox = _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( tw->size[1][0] ) ), _mm_andnot_ps( neg, _mm_set1_ps( tw->size[0][0] ) ) );
+    neg = _mm_cmplt_ps( ny, zero );
+    oy = _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( tw->size[1][1] ) ), _mm_andnot_ps( neg, _mm_set1_ps( tw->size[0][1] ) ) );
+    neg = _mm_cmplt_ps( nz, zero );
+    oz = _mm_or_ps( _mm_and_ps( neg, _mm_set1_ps( tw->size[1][2] ) ), _mm_andnot_ps( neg, _mm_set1_ps( tw->size[0][2] ) ) );
+
+    offset = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) );
+
+    *d1 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( tw->start[0] ), nx ),
+        _mm_mul_ps( _mm_set1_ps( tw->start[1] ), ny ) ), _mm_mul_ps( _mm_set1_ps( tw->start[2] ), nz ) ), offset ), dist );
+
+    if ( d2 ) {
+        *d2 = _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( tw->end[0] ), nx ),
+            _mm_mul_ps( _mm_set1_ps( tw->end[1] ), ny ) ), _mm_mul_ps( _mm_set1_ps( tw->end[2] ), nz ) ), offset ), dist );
+    }
+}
+#endif
+
 /*
 ================
 CM_TestBoxInBrush
@@ -207,6 +348,48 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
                 return;
             }
         }
+#if idx64
+    } else if ( brush->sidePlanes && cm_simdBrushes->integer ) {
+        __m128  d1s;
+        int     padded, first, lane;
+        int     front, check;
+
+        // four sides at a time, starting with the group that holds side 6
+        padded = PADDED_SIDES( brush->numsides );
+        for ( first = 4 ; first < padded ; first += 4 ) {
+            CM_BrushSideDists( tw, brush->sidePlanes, padded, first, &d1s, NULL );
+
+            front = _mm_movemask_ps( _mm_cmpgt_ps( d1s, _mm_set1_ps( BRUSH_SIDE_TOLERANCE ) ) );
+            check = _mm_movemask_ps( _mm_cmpge_ps( d1s, _mm_set1_ps( -BRUSH_SIDE_TOLERANCE ) ) );
+            if ( first == 4 ) {
+                front &= ~3;    // sides 4 and 5 are axial
+                check &= ~3;
+            }
+
+            // clearly in front of a face, no intersection
+            if ( front ) {
+                return;
+            }
+
+            for ( lane = 0 ; check ; lane++, check >>= 1 ) {
+                if ( !( check & 1 ) ) {
+                    continue;
+                }
+
+                plane = brush->sides[first + lane].plane;
+
+                // adjust the plane distance appropriately for mins/maxs
+                dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+
+                d1 = DotProduct( tw->start, plane->normal ) - dist;
+
+                // if completely in front of face, no intersection
+                if ( d1 > 0 ) {
+                    return;
+                }
+            }
+        }
+#endif
     } else {
         // the first six planes are the axial planes, so we only
         // need to test the remainder
@@ -250,10 +433,10 @@ void CM_TestInLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
     for (k=0 ; k<leaf->numLeafBrushes ; k++) {
         brushnum = cm->leafbrushes[leaf->firstLeafBrush+k];
         b = &cm->brushes[brushnum];
-        if (b->checkcount == cm->checkcount) {
+        if (tw->checkStamps[b->checkIndex] == tw->checkcount) {
             continue;   // already checked this brush in another leaf
         }
-        b->checkcount = cm->checkcount;
+        tw->checkStamps[b->checkIndex] = tw->checkcount;
 
         if ( !(b->contents & tw->contents)) {
             continue;
@@ -264,7 +447,7 @@ void CM_TestInLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
             // Invalidate the checkount for the terrain
             // as the terrain brush has to be processed
             // many times.
-            b->checkcount--;
+            tw->checkStamps[b->checkIndex]--;
 
             // Trace through the terrain.
             CM_TraceThroughTerrain(tw, b);
@@ -292,10 +475,10 @@ void CM_TestInLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
             if ( !patch ) {
                 continue;
             }
-            if ( patch->checkcount == cm->checkcount ) {
+            if ( tw->checkStamps[patch->checkIndex] == tw->checkcount ) {
                 continue;   // already checked this brush in another leaf
             }
-            patch->checkcount = cm->checkcount;
+            tw->checkStamps[patch->checkIndex] = tw->checkcount;
 
             if ( !(patch->contents & tw->contents)) {
                 continue;
@@ -445,13 +628,8 @@ void CM_PositionTest( traceWork_t *tw ) {
     ll.lastLeaf = 0;
     ll.overflowed = qfalse;
 
-    cmg->checkcount++;
-
     CM_BoxLeafnums_r( &ll, 0 );
 
-
-    cmg->checkcount++;
-
     // test the contents of the leafs
     for (i=0 ; i < ll.count ; i++) {
         CM_TestInLeaf( cmg, tw, &cmg->leafs[leafs[i]] );
@@ -591,6 +769,88 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush, traceFraction_t *fr
                 }
             }
         }
+#if idx64
+    } else if ( brush->sidePlanes && cm_simdBrushes->integer ) {
+        __m128  d1s, d2s, tolerance;
+        int     padded, first, lane;
+        int     out, check;
+
+        //
+        // the same as below, with the distances worked out four sides at a
+        // time and only the sides that could matter tested one by one
+        //
+        tolerance = _mm_set1_ps( BRUSH_SIDE_TOLERANCE );
+        padded = PADDED_SIDES( brush->numsides );
+
+        for (first = 0; first < padded; first += 4) {
+            CM_BrushSideDists( tw, brush->sidePlanes, padded, first, &d1s, &d2s );
+
+            // clearly in front of a face, no intersection with the entire brush
+            out = _mm_movemask_ps( _mm_and_ps( _mm_cmpgt_ps( d1s, tolerance ),
+                _mm_or_ps( _mm_cmpge_ps( d2s, _mm_set1_ps( SURFACE_CLIP_EPSILON + BRUSH_SIDE_TOLERANCE ) ),
+                _mm_cmpge_ps( d2s, _mm_add_ps( d1s, tolerance ) ) ) ) );
+            if (out) {
+                return;
+            }
+
+            // sides the trace stays well behind are not relevant
+            check = _mm_movemask_ps( _mm_or_ps( _mm_cmpge_ps( d1s, _mm_sub_ps( _mm_setzero_ps(), tolerance ) ),
+                _mm_cmpge_ps( d2s, _mm_sub_ps( _mm_setzero_ps(), tolerance ) ) ) );
+
+            for (lane = 0; check; lane++, check >>= 1) {
+                if (!(check & 1)) {
+                    continue;
+                }
+
+                side = brush->sides + first + lane;
+                plane = side->plane;
+
+                // adjust the plane distance appropriately for mins/maxs
+                dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+
+                d1 = DotProduct( tw->start, plane->normal ) - dist;
+                d2 = DotProduct( tw->end, plane->normal ) - dist;
+
+                if (d2 > 0) {
+                    getout = qtrue; // endpoint is not in solid
+                }
+                if (d1 > 0) {
+                    startout = qtrue;
+                }
+
+                // if completely in front of face, no intersection with the entire brush
+                if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+                    return;
+                }
+
+                // if it doesn't cross the plane, the plane isn't relevant
+                if (d1 <= 0 && d2 <= 0 ) {
+                    continue;
+                }
+
+                // crosses face
+                if (d1 > d2) {  // enter
+                    f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+                    if ( f < 0 ) {
+                        f = 0;
+                    }
+                    if (f > enterFrac) {
+                        enterFrac = f;
+                        clipplane = plane;
+                        leadside = side;
+                    }
+                } else {    // leave
+                    f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+                    if ( f > 1 ) {
+                        f = 1;
+                    }
+                    if (f < leaveFrac) {
+                        leaveFrac = f;
+                    }
+                }
+            }
+        }
+#endif
     } else {
         //
         // compare the trace against all planes of the brush
@@ -712,10 +972,10 @@ void CM_TraceThroughLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
         brushnum = cm->leafbrushes[leaf->firstLeafBrush+k];
 
         b = &cm->brushes[brushnum];
-        if ( b->checkcount == cm->checkcount ) {
+        if ( tw->checkStamps[b->checkIndex] == tw->checkcount ) {
             continue;   // already checked this brush in another leaf
         }
-        b->checkcount = cm->checkcount;
+        tw->checkStamps[b->checkIndex] = tw->checkcount;
 
         if ( !(b->contents & tw->contents) ) {
             continue;
@@ -731,7 +991,7 @@ void CM_TraceThroughLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
             // Invalidate the checkount for the terrain
             // as the terrain brush has to be processed
             // many times.
-            b->checkcount--;
+            tw->checkStamps[b->checkIndex]--;
 
             // Trace through the terrain.
             CM_TraceThroughTerrain(tw, b);
@@ -755,10 +1015,10 @@ void CM_TraceThroughLeaf(clipMap_t *cm, traceWork_t *tw, cLeaf_t *leaf)
             if ( !patch ) {
                 continue;
             }
-            if ( patch->checkcount == cm->checkcount ) {
+            if ( tw->checkStamps[patch->checkIndex] == tw->checkcount ) {
                 continue;   // already checked this patch in another leaf
             }
-            patch->checkcount = cm->checkcount;
+            tw->checkStamps[patch->checkIndex] = tw->checkcount;
 
             if ( !(patch->contents & tw->contents) ) {
                 continue;
@@ -1077,7 +1337,7 @@ intersect in any way.
 ==================
 */
 
-static qboolean CM_DoBoxesCollide(const vec3_t boundsA[2], const vec3_t boundsB[2])
+qboolean CM_DoBoxesCollide(const vec3_t boundsA[2], const vec3_t boundsB[2])
 {
     int i;
 
@@ -1133,7 +1393,7 @@ fraction.
 ==================
 */
 
-void CM_HandleTerrainPatchCollide(traceWork_t *tw, cTerrainPatch_t *patch, int checkcount)
+void CM_HandleTerrainPatchCollide(traceWork_t *tw, cTerrainPatch_t *patch)
 {
     cbrush_t    *brush;
     int         numBrushes;
@@ -1144,18 +1404,18 @@ void CM_HandleTerrainPatchCollide(traceWork_t *tw, cTerrainPatch_t *patch, int c
     numBrushes = patch->mNumBrushes;
 
     for(i = 0; i < numBrushes; i++, brush++){
-        if(brush->checkcount == checkcount){
+        if(tw->checkStamps[brush->checkIndex] == tw->checkcount){
             return;
         }
 
         // Generic collision of terxel bounds
         // to line segment bounds.
-        if(!CM_DoBoxesCollide(brush->bounds, tw->localBounds)){
+        if(CM_DoBoxesCollide(brush->bounds, tw->localBounds)){
             continue;
         }
 
         // Perform a trace through this brush.
-        brush->checkcount = checkcount;
+        tw->checkStamps[brush->checkIndex] = tw->checkcount;
         CM_TraceThroughBrush(tw, brush, NULL);
         if(tw->trace.fraction <= 0.0f){
             break;
@@ -1182,7 +1442,7 @@ void CM_TraceThroughTerrain(traceWork_t *tw, cbrush_t *brush)
     vec3_t          tStart, tEnd, tDistance;
     vec3_t          baseStart, baseEnd;
     int             i;
-    float           fraction;
+    float           fraction, localFraction;
 
     // At this point we may be colliding with a terrain brush with a valid terrain structure.
     t = brush->terrain;
@@ -1194,7 +1454,18 @@ void CM_TraceThroughTerrain(traceWork_t *tw, cbrush_t *brush)
 
     // Now we know that at least some part of the trace needs to collide with the terrain.
     // The regular brush collision is handled elsewhere, so advance the ray to an edge in the terrain brush.
+    // The fractions are left alone when the trace misses the brush altogether.
+    fract.enterFrac = 1.0f;
+    fract.leaveFrac = 0.0f;
     CM_TraceThroughBrush(tw, brush, &fract);
+    if(fract.enterFrac >= fract.leaveFrac){
+        return;
+    }
+
+    // Something was already hit before the trace gets to the terrain.
+    if(tw->trace.fraction < fract.enterFrac){
+        return;
+    }
 
     // Work out the corners of the AABB when the trace first hits
     // the terrain brush and when it leaves.
@@ -1204,8 +1475,16 @@ void CM_TraceThroughTerrain(traceWork_t *tw, cbrush_t *brush)
     }
     VectorSubtract(tEnd, tStart, tDistance);
 
-    // Make a copy of the base fraction.
+    // Make a copy of the base fraction, and express it as a fraction
+    // of the part of the trace inside the terrain brush, which is what
+    // the terxel brushes are traced with. The terrain brush is processed
+    // once for every leaf it is in, so this must not be skipped.
     fraction = tw->trace.fraction;
+    tw->trace.fraction = (fraction - fract.enterFrac) / (fract.leaveFrac - fract.enterFrac);
+    if(tw->trace.fraction > 1.0f){
+        tw->trace.fraction = 1.0f;
+    }
+    localFraction = tw->trace.fraction;
 
     // Save a copy of the base start and end vectors.
     VectorCopy(tw->start, baseStart);
@@ -1222,7 +1501,11 @@ void CM_TraceThroughTerrain(traceWork_t *tw, cbrush_t *brush)
 
     // Step through the terrain patch.
     CM_CalcExtents(tStart, tw->end, tw, tw->localBounds);
-    CM_TerrainPatchCollide(t, tw, tw->start, tw->end, brush->checkcount);
+    if(cm_terrainGrid->integer){
+        CM_TerrainGridCollide(t, tw, tw->start, tw->end);
+    }else{
+        CM_TerrainPatchCollide(t, tw, tw->start, tw->end);
+    }
 
     // Put the original start and end back.
     VectorCopy(baseStart, tw->start);
@@ -1230,9 +1513,11 @@ void CM_TraceThroughTerrain(traceWork_t *tw, cbrush_t *brush)
 
     // Convert the global fraction only if
     // something was hit along the way.
-    if(tw->trace.fraction != 1.0f){
+    if(tw->trace.fraction < localFraction){
         tw->trace.fraction = fract.enterFrac + ((fract.leaveFrac - fract.enterFrac) * tw->trace.fraction);
         tw->trace.contents = brush->contents;
+    }else{
+        tw->trace.fraction = fraction;
     }
 
     // Collide with any water.
@@ -1367,6 +1652,117 @@ void CM_TraceThroughTree(clipMap_t *cm, traceWork_t *tw, int num, float p1f, flo
 }
 
 
+/*
+==================
+CM_TraceThroughFlatTree
+
+CM_TraceThroughTree for the flatNodes layout.
+==================
+*/
+void CM_TraceThroughFlatTree(clipMap_t *cm, traceWork_t *tw, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+{
+    cFlatNode_t *node;
+    float       t1, t2, offset;
+    float       frac, frac2;
+    float       idist;
+    vec3_t      mid;
+    int         side;
+    float       midf;
+
+    if (tw->trace.fraction <= p1f) {
+        return;     // already hit something nearer
+    }
+
+    // if < 0, we are in a leaf node
+    if (num < 0) {
+        CM_TraceThroughLeaf( cm, tw, &cm->leafs[-1-num] );
+        return;
+    }
+
+    //
+    // find the point distances to the separating plane
+    // and the offset for the size of the box
+    //
+    node = cm->flatNodes + num;
+
+    // adjust the plane distance appropriately for mins/maxs
+    if ( node->type < 3 ) {
+        t1 = p1[node->type] - node->dist;
+        t2 = p2[node->type] - node->dist;
+        offset = tw->extents[node->type];
+    } else {
+        t1 = DotProduct (node->normal, p1) - node->dist;
+        t2 = DotProduct (node->normal, p2) - node->dist;
+        if ( tw->isPoint ) {
+            offset = 0;
+        } else {
+            // this is silly
+            offset = 2048;
+        }
+    }
+
+    // see which sides we need to consider
+    if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+        CM_TraceThroughFlatTree( cm, tw, node->children[0], p1f, p2f, p1, p2 );
+        return;
+    }
+    if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+        CM_TraceThroughFlatTree( cm, tw, node->children[1], p1f, p2f, p1, p2 );
+        return;
+    }
+
+    // put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+    if ( t1 < t2 ) {
+        idist = 1.0/(t1-t2);
+        side = 1;
+        frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+        frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+    } else if (t1 > t2) {
+        idist = 1.0/(t1-t2);
+        side = 0;
+        frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+        frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+    } else {
+        side = 0;
+        frac = 1;
+        frac2 = 0;
+    }
+
+    // move up to the node
+    if ( frac < 0 ) {
+        frac = 0;
+    }
+    if ( frac > 1 ) {
+        frac = 1;
+    }
+
+    midf = p1f + (p2f - p1f)*frac;
+
+    mid[0] = p1[0] + frac*(p2[0] - p1[0]);
+    mid[1] = p1[1] + frac*(p2[1] - p1[1]);
+    mid[2] = p1[2] + frac*(p2[2] - p1[2]);
+
+    CM_TraceThroughFlatTree( cm, tw, node->children[side], p1f, midf, p1, mid );
+
+
+    // go past the node
+    if ( frac2 < 0 ) {
+        frac2 = 0;
+    }
+    if ( frac2 > 1 ) {
+        frac2 = 1;
+    }
+
+    midf = p1f + (p2f - p1f)*frac2;
+
+    mid[0] = p1[0] + frac2*(p2[0] - p1[0]);
+    mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
+    mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
+
+    CM_TraceThroughFlatTree( cm, tw, node->children[side^1], midf, p2f, mid, p2 );
+}
+
+
 //======================================================================
 
 
@@ -1388,8 +1784,6 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 
     cmod = CM_ClipHandleToModel( model );
 
-    cm->checkcount++;        // for multi-check avoidance
-
     c_traces++;             // for statistics, may be zeroed
 
     // fill in a default trace
@@ -1403,6 +1797,9 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
         return; // map not loaded, shouldn't happen
     }
 
+    // for multi-check avoidance
+    tw.checkStamps = CM_BeginCheck( &tw.checkcount );
+
     // allow NULL to be passed in for 0,0,0
     if ( !mins ) {
         mins = vec3_origin;
@@ -1527,6 +1924,8 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
             }
         } else if ( cmod->firstNode == -1 ) {
             CM_PositionTest( &tw );
+        } else if ( cm_flatNodes->integer ) {
+            CM_TraceThroughFlatTree( cm, &tw, cmod->firstNode, 0, 1, tw.start, tw.end );
         } else {
             CM_TraceThroughTree( cm, &tw, cmod->firstNode, 0, 1, tw.start, tw.end );
         }
@@ -1571,6 +1970,8 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
             else {
                 CM_TraceThroughLeaf( cm, &tw, &cmod->leaf );
             }
+        } else if ( cm_flatNodes->integer ) {
+            CM_TraceThroughFlatTree( cm, &tw, 0, 0, 1, tw.start, tw.end );
         } else {
             CM_TraceThroughTree( cm, &tw, 0, 0, 1, tw.start, tw.end );
         }
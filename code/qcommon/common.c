@@ -1390,6 +1390,10 @@ void Com_Meminfo_f( void ) {
     Com_Printf("==========\n");
     Com_Printf("%8i bytes in small zone memory\n", smallZoneBytes);
 
+    // Ghoul II instances.
+    Com_Printf("\n");
+    G2_ArenaInfo();
+
     Com_Printf("\n");
 }
 
@@ -2705,6 +2709,7 @@ void Com_Init( char *commandLine ) {
 #endif
 
     Sys_Init();
+    Com_InitJobs();
 
     Sys_InitPIDFile( FS_GetCurrentGameDir() );
 
@@ -3146,8 +3151,8 @@ void Com_Frame( void ) {
     //
     if ( com_showtrace->integer ) {
 
-        extern  int c_traces, c_brush_traces, c_patch_traces;
-        extern  int c_pointcontents;
+        extern  Q_THREAD_LOCAL int c_traces, c_brush_traces, c_patch_traces;
+        extern  Q_THREAD_LOCAL int c_pointcontents;
 
         Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
             c_brush_traces, c_patch_traces, c_pointcontents);
@@ -3168,6 +3173,9 @@ Com_Shutdown
 =================
 */
 void Com_Shutdown (void) {
+    Com_ShutdownJobs();
+    NET_ShutdownPacketQueue();
+
     if (logfile) {
         FS_FCloseFile (logfile);
         logfile = 0;
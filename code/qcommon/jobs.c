@@ -0,0 +1,238 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+
+Worker threads for splitting up independent work, such as a batch of
+world traces.
+
+Com_RunJobs hands out the indexes 0..count-1 one at a time to the workers
+and to the calling thread, and returns once all of them are finished. Jobs
+run concurrently with each other, so they may only touch data that is read
+only for the duration of the call or owned by their index. The workers are
+started the first time they are needed.
+
+*/
+
+#define MAX_JOB_THREADS     32
+
+typedef struct {
+    jobFunc_t       func;
+    void            *data;
+    int             count;
+    int             next;           // next index to hand out, under jobMutex
+} jobList_t;
+
+static jobList_t        jobList;
+static qboolean         jobsRunning;
+static qboolean         jobsQuit;
+
+static sysThread_t      *jobThreads[MAX_JOB_THREADS];
+static int              numJobThreads;
+static qboolean         jobThreadsStarted;
+
+static sysMutex_t       *jobMutex;
+static sysSemaphore_t   *jobStart;
+static sysSemaphore_t   *jobDone;
+
+static cvar_t           *com_jobThreads;
+
+/*
+=================
+Com_WorkOnJobs
+
+Runs jobs until every index has been handed out.
+=================
+*/
+static void Com_WorkOnJobs( void ) {
+    int     index;
+
+    for ( ;; ) {
+        Sys_LockMutex( jobMutex );
+        index = jobList.next < jobList.count ? jobList.next++ : -1;
+        Sys_UnlockMutex( jobMutex );
+
+        if ( index < 0 ) {
+            return;
+        }
+
+        jobList.func( jobList.data, index );
+    }
+}
+
+/*
+=================
+Com_JobThread
+=================
+*/
+static void Com_JobThread( void *arg ) {
+    for ( ;; ) {
+        Sys_SemaphoreWait( jobStart );
+
+        if ( jobsQuit ) {
+            break;
+        }
+
+        Com_WorkOnJobs();
+        Sys_SemaphorePost( jobDone );
+    }
+
+    CM_FreeThreadCheckStamps();
+}
+
+/*
+=================
+Com_StartJobThreads
+=================
+*/
+static void Com_StartJobThreads( void ) {
+    int     wanted;
+
+    if ( jobThreadsStarted ) {
+        return;
+    }
+    jobThreadsStarted = qtrue;
+
+    // com_jobThreads counts the main thread too
+    wanted = com_jobThreads->integer > 0 ? com_jobThreads->integer : Sys_ProcessorCount();
+    wanted--;
+    if ( wanted > MAX_JOB_THREADS ) {
+        wanted = MAX_JOB_THREADS;
+    }
+
+    if ( wanted <= 0 ) {
+        return;
+    }
+
+    jobMutex = Sys_CreateMutex();
+    jobStart = Sys_CreateSemaphore( 0 );
+    jobDone = Sys_CreateSemaphore( 0 );
+
+    for ( numJobThreads = 0; numJobThreads < wanted; numJobThreads++ ) {
+        jobThreads[numJobThreads] = Sys_CreateThread( Com_JobThread, NULL );
+        if ( !jobThreads[numJobThreads] ) {
+            Com_Printf( S_COLOR_YELLOW "WARNING: could only start %i of %i job threads\n", numJobThreads, wanted );
+            break;
+        }
+    }
+}
+
+/*
+=================
+Com_JobThreads
+
+Number of threads Com_RunJobs spreads work over, including the caller.
+=================
+*/
+int Com_JobThreads( void ) {
+    Com_StartJobThreads();
+    return numJobThreads + 1;
+}
+
+/*
+=================
+Com_RunJobs
+=================
+*/
+void Com_RunJobs( jobFunc_t func, void *data, int count ) {
+    int     helpers;
+    int     i;
+
+    Com_StartJobThreads();
+
+    helpers = count - 1;
+    if ( helpers > numJobThreads ) {
+        helpers = numJobThreads;
+    }
+
+    // nested calls and single items just run here
+    if ( helpers <= 0 || jobsRunning ) {
+        for ( i = 0; i < count; i++ ) {
+            func( data, i );
+        }
+        return;
+    }
+
+    jobsRunning = qtrue;
+
+    jobList.func = func;
+    jobList.data = data;
+    jobList.count = count;
+    jobList.next = 0;
+
+    for ( i = 0; i < helpers; i++ ) {
+        Sys_SemaphorePost( jobStart );
+    }
+
+    Com_WorkOnJobs();
+
+    for ( i = 0; i < helpers; i++ ) {
+        Sys_SemaphoreWait( jobDone );
+    }
+
+    jobsRunning = qfalse;
+}
+
+/*
+=================
+Com_InitJobs
+=================
+*/
+void Com_InitJobs( void ) {
+    com_jobThreads = Cvar_Get( "com_jobThreads", "0", CVAR_ARCHIVE | CVAR_LATCH );
+    Cvar_CheckRange( com_jobThreads, 0, MAX_JOB_THREADS + 1, qtrue );
+}
+
+/*
+=================
+Com_ShutdownJobs
+=================
+*/
+void Com_ShutdownJobs( void ) {
+    int     i;
+
+    if ( !jobMutex ) {
+        jobThreadsStarted = qfalse;
+        return;
+    }
+
+    jobsQuit = qtrue;
+
+    for ( i = 0; i < numJobThreads; i++ ) {
+        Sys_SemaphorePost( jobStart );
+    }
+    for ( i = 0; i < numJobThreads; i++ ) {
+        Sys_JoinThread( jobThreads[i] );
+    }
+
+    Sys_DestroySemaphore( jobDone );
+    Sys_DestroySemaphore( jobStart );
+    Sys_DestroyMutex( jobMutex );
+    jobMutex = NULL;
+
+    numJobThreads = 0;
+    jobsQuit = qfalse;
+    jobThreadsStarted = qfalse;
+}
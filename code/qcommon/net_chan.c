@@ -58,6 +58,10 @@ cvar_t      *showpackets;
 cvar_t      *showdrop;
 cvar_t      *qport;
 
+static packetPool_t *packetPools;
+
+static void NET_PacketPools_f( void );
+
 static char *netsrcString[2] = {
     "client",
     "server"
@@ -74,6 +78,9 @@ void Netchan_Init( int port ) {
     showpackets = Cvar_Get ("showpackets", "0", CVAR_TEMP );
     showdrop = Cvar_Get ("showdrop", "0", CVAR_TEMP );
     qport = Cvar_Get ("net_qport", va("%i", port), CVAR_INIT );
+
+    Cmd_AddCommand( "packetpools", NET_PacketPools_f );
+    NET_InitResolver();
 }
 
 /*
@@ -448,43 +455,229 @@ void NET_SendLoopPacket (netsrc_t sock, int length, const void *data, netadr_t t
 
 //=============================================================================
 
+/*
+=============================================================================
+
+PACKET POOLS
+
+=============================================================================
+*/
+
+#define PACKETSLOT_STRIDE( size )   ( ( sizeof( packetSlot_t ) + (size) + 15 ) & ~15 )
+
+/*
+==============
+NET_InitPacketPool
+
+The slab memory is only allocated once a packet is queued
+==============
+*/
+void NET_InitPacketPool( packetPool_t *pool, const char *name, const int *slotSizes, const int *numSlots, int numSlabs )
+{
+    int     i;
+
+    if ( numSlabs > MAX_PACKETPOOL_SLABS ) {
+        Com_Error( ERR_FATAL, "NET_InitPacketPool: %i slabs for %s", numSlabs, name );
+    }
+
+    Com_Memset( pool, 0, sizeof( *pool ) );
+    pool->name = name;
+    pool->numSlabs = numSlabs;
+
+    for ( i = 0; i < numSlabs; i++ ) {
+        pool->slabs[i].slotSize = slotSizes[i];
+        pool->slabs[i].numSlots = numSlots[i];
+    }
+
+    pool->next = packetPools;
+    packetPools = pool;
+}
+
+/*
+==============
+NET_PacketPoolAlloc
+
+Returns a slot of at least size bytes from the smallest
+slab that has one free, or NULL if the pool is exhausted
+==============
+*/
+void *NET_PacketPoolAlloc( packetPool_t *pool, int size )
+{
+    packetSlab_t    *slab;
+    packetSlot_t    *slot;
+    int             i, j, stride;
+
+    for ( i = 0, slab = pool->slabs; i < pool->numSlabs; i++, slab++ ) {
+        if ( slab->slotSize < size ) {
+            continue;
+        }
+
+        if ( !slab->slots ) {
+            stride = PACKETSLOT_STRIDE( slab->slotSize );
+            slab->slots = Z_Malloc( slab->numSlots * stride );
+
+            for ( j = slab->numSlots - 1; j >= 0; j-- ) {
+                slot = (packetSlot_t *)( slab->slots + j * stride );
+                slot->slab = i;
+                slot->next = slab->free;
+                slab->free = slot;
+            }
+        }
+
+        slot = slab->free;
+        if ( !slot ) {
+            continue;
+        }
+
+        slab->free = slot->next;
+        slot->next = NULL;
+
+        if ( ++slab->used > slab->peak ) {
+            slab->peak = slab->used;
+        }
+
+        return slot + 1;
+    }
+
+    pool->exhausted++;
+    return NULL;
+}
+
+/*
+==============
+NET_PacketPoolFree
+==============
+*/
+void NET_PacketPoolFree( packetPool_t *pool, void *data )
+{
+    packetSlot_t    *slot;
+    packetSlab_t    *slab;
+
+    if ( !data ) {
+        return;
+    }
+
+    slot = (packetSlot_t *)data - 1;
+    slab = &pool->slabs[slot->slab];
+
+    slot->next = slab->free;
+    slab->free = slot;
+    slab->used--;
+}
+
+/*
+==============
+NET_ShutdownPacketPool
+
+Returns the slab memory to the zone, every slot must have been freed
+==============
+*/
+void NET_ShutdownPacketPool( packetPool_t *pool )
+{
+    packetPool_t    **prev;
+    int             i;
+
+    if ( !pool->numSlabs ) {
+        return;
+    }
+
+    for ( i = 0; i < pool->numSlabs; i++ ) {
+        if ( pool->slabs[i].slots ) {
+            Z_Free( pool->slabs[i].slots );
+        }
+    }
+
+    for ( prev = &packetPools; *prev; prev = &(*prev)->next ) {
+        if ( *prev == pool ) {
+            *prev = pool->next;
+            break;
+        }
+    }
+
+    Com_Memset( pool, 0, sizeof( *pool ) );
+}
+
+/*
+==============
+NET_PacketPools_f
+==============
+*/
+static void NET_PacketPools_f( void )
+{
+    packetPool_t    *pool;
+    packetSlab_t    *slab;
+    int             i;
+
+    if ( !packetPools ) {
+        Com_Printf( "No packets have been queued.\n" );
+        return;
+    }
+
+    for ( pool = packetPools; pool; pool = pool->next ) {
+        Com_Printf( "%s: %i exhausted\n", pool->name, pool->exhausted );
+
+        for ( i = 0, slab = pool->slabs; i < pool->numSlabs; i++, slab++ ) {
+            Com_Printf( "  %5i byte slots: %4i used, %4i peak, %4i total%s\n", slab->slotSize,
+                slab->used, slab->peak, slab->numSlots, slab->slots ? "" : " (unallocated)" );
+        }
+    }
+}
+
+//=============================================================================
+
 typedef struct packetQueue_s {
         struct packetQueue_s *next;
         int length;
-        byte *data;
         netadr_t to;
         int release;
+        byte data[1];       // variable sized
 } packetQueue_t;
 
-packetQueue_t *packetQueue = NULL;
+static packetPool_t packetQueuePool;
+static packetQueue_t *packetQueue = NULL;
+static packetQueue_t *packetQueueTail = NULL;
 
 static void NET_QueuePacket( int length, const void *data, netadr_t to,
     int offset )
 {
-    packetQueue_t *new, *next = packetQueue;
+    static const int slotSizes[] = { 256, MAX_PACKETLEN, MAX_MSGLEN };
+    static const int numSlots[] = { 1024, 2048, 32 };
+    packetQueue_t *new;
+    int i;
 
     if(offset > 999)
         offset = 999;
 
-    new = S_Malloc(sizeof(packetQueue_t));
-    new->data = S_Malloc(length);
+    if(!packetQueuePool.numSlabs)
+    {
+        int sizes[ARRAY_LEN(slotSizes)];
+
+        // reserve room for the queue entry in every slot
+        for(i = 0; i < ARRAY_LEN(slotSizes); i++)
+            sizes[i] = offsetof(packetQueue_t, data) + slotSizes[i];
+
+        NET_InitPacketPool(&packetQueuePool, "packet delay queue", sizes, numSlots, ARRAY_LEN(slotSizes));
+    }
+
+    new = NET_PacketPoolAlloc(&packetQueuePool, offsetof(packetQueue_t, data) + length);
+    if(!new) {
+        // drop it, as if it had been lost on the way
+        if(showdrop->integer)
+            Com_Printf("%s:Dropped a delayed packet, queue is full\n", NET_AdrToString(to));
+        return;
+    }
+
     Com_Memcpy(new->data, data, length);
     new->length = length;
     new->to = to;
     new->release = Sys_Milliseconds() + (int)((float)offset / com_timescale->value);
     new->next = NULL;
 
-    if(!packetQueue) {
+    if(!packetQueue)
         packetQueue = new;
-        return;
-    }
-    while(next) {
-        if(!next->next) {
-            next->next = new;
-            return;
-        }
-        next = next->next;
-    }
+    else
+        packetQueueTail->next = new;
+    packetQueueTail = new;
 }
 
 void NET_FlushPacketQueue(void)
@@ -500,9 +693,25 @@ void NET_FlushPacketQueue(void)
             packetQueue->to);
         last = packetQueue;
         packetQueue = packetQueue->next;
-        Z_Free(last->data);
-        Z_Free(last);
+        NET_PacketPoolFree(&packetQueuePool, last);
     }
+
+    if(!packetQueue)
+        packetQueueTail = NULL;
+}
+
+void NET_ShutdownPacketQueue(void)
+{
+    packetQueue_t *next;
+
+    for(; packetQueue; packetQueue = next)
+    {
+        next = packetQueue->next;
+        NET_PacketPoolFree(&packetQueuePool, packetQueue);
+    }
+    packetQueueTail = NULL;
+
+    NET_ShutdownPacketPool(&packetQueuePool);
 }
 
 void NET_SendPacket( netsrc_t sock, int length, const void *data, netadr_t to ) {
@@ -591,13 +800,13 @@ void QDECL NET_OutOfBandData( netsrc_t sock, netadr_t adr, byte *format, int len
 
 /*
 =============
-NET_StringToAdr
+NET_ParseAdr
 
 Traps "localhost" for loopback, passes everything else to system
 return 0 on address not found, 1 on address found with port, 2 on address found without port.
 =============
 */
-int NET_StringToAdr( const char *s, netadr_t *a, netadrtype_t family )
+static int NET_ParseAdr( const char *s, netadr_t *a, netadrtype_t family, qboolean quiet )
 {
     char    base[MAX_STRING_CHARS], *search;
     char    *port = NULL;
@@ -642,7 +851,7 @@ int NET_StringToAdr( const char *s, netadr_t *a, netadrtype_t family )
         search = base;
     }
 
-    if(!Sys_StringToAdr(search, a, family))
+    if(quiet ? !Sys_ResolveAdr(search, a, family) : !Sys_StringToAdr(search, a, family))
     {
         a->type = NA_BAD;
         return 0;
@@ -659,3 +868,26 @@ int NET_StringToAdr( const char *s, netadr_t *a, netadrtype_t family )
         return 2;
     }
 }
+
+/*
+=============
+NET_StringToAdr
+=============
+*/
+int NET_StringToAdr( const char *s, netadr_t *a, netadrtype_t family )
+{
+    return NET_ParseAdr(s, a, family, qfalse);
+}
+
+/*
+=============
+NET_ResolveAdr
+
+Same as NET_StringToAdr, but safe to call from a worker thread.
+family must be NA_IP or NA_IP6.
+=============
+*/
+int NET_ResolveAdr( const char *s, netadr_t *a, netadrtype_t family )
+{
+    return NET_ParseAdr(s, a, family, qtrue);
+}
@@ -267,9 +267,11 @@ static struct addrinfo *SearchAddrInfo(struct addrinfo *hints, sa_family_t famil
 /*
 =============
 Sys_StringToSockaddr
+
+Only prints errors when verbose is set, quiet lookups may run off the main thread.
 =============
 */
-static qboolean Sys_StringToSockaddr(const char *s, struct sockaddr *sadr, int sadr_len, sa_family_t family)
+static qboolean Sys_StringToSockaddr(const char *s, struct sockaddr *sadr, int sadr_len, sa_family_t family, qboolean verbose)
 {
     struct addrinfo hints;
     struct addrinfo *res = NULL;
@@ -321,10 +323,10 @@ static qboolean Sys_StringToSockaddr(const char *s, struct sockaddr *sadr, int s
 
             return qtrue;
         }
-        else
+        else if(verbose)
             Com_Printf("Sys_StringToSockaddr: Error resolving %s: No address of required type found.\n", s);
     }
-    else
+    else if(verbose)
         Com_Printf("Sys_StringToSockaddr: Error resolving %s: %s\n", s, gai_strerror(retval));
 
     if(res)
@@ -372,7 +374,34 @@ qboolean Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family ) {
             fam = AF_UNSPEC;
         break;
     }
-    if( !Sys_StringToSockaddr(s, (struct sockaddr *) &sadr, sizeof(sadr), fam ) ) {
+    if( !Sys_StringToSockaddr(s, (struct sockaddr *) &sadr, sizeof(sadr), fam, qtrue ) ) {
+        return qfalse;
+    }
+
+    SockadrToNetadr( (struct sockaddr *) &sadr, a );
+    return qtrue;
+}
+
+/*
+=============
+Sys_ResolveAdr
+
+Thread safe variant of Sys_StringToAdr, never prints
+and needs an explicit address family.
+=============
+*/
+qboolean Sys_ResolveAdr( const char *s, netadr_t *a, netadrtype_t family ) {
+    struct sockaddr_storage sadr;
+    sa_family_t fam;
+
+    if( family == NA_IP )
+        fam = AF_INET;
+    else if( family == NA_IP6 )
+        fam = AF_INET6;
+    else
+        return qfalse;
+
+    if( !Sys_StringToSockaddr(s, (struct sockaddr *) &sadr, sizeof(sadr), fam, qfalse ) ) {
         return qfalse;
     }
 
@@ -849,7 +878,7 @@ SOCKET NET_IPSocket( char *net_interface, int port, int *err ) {
     }
     else
     {
-        if(!Sys_StringToSockaddr( net_interface, (struct sockaddr *)&address, sizeof(address), AF_INET))
+        if(!Sys_StringToSockaddr( net_interface, (struct sockaddr *)&address, sizeof(address), AF_INET, qtrue))
         {
             closesocket(newsocket);
             return INVALID_SOCKET;
@@ -929,7 +958,7 @@ SOCKET NET_IP6Socket( char *net_interface, int port, struct sockaddr_in6 *bindto
     }
     else
     {
-        if(!Sys_StringToSockaddr( net_interface, (struct sockaddr *)&address, sizeof(address), AF_INET6))
+        if(!Sys_StringToSockaddr( net_interface, (struct sockaddr *)&address, sizeof(address), AF_INET6, qtrue))
         {
             closesocket(newsocket);
             return INVALID_SOCKET;
@@ -966,7 +995,7 @@ void NET_SetMulticast6(void)
 {
     struct sockaddr_in6 addr;
 
-    if(!*net_mcast6addr->string || !Sys_StringToSockaddr(net_mcast6addr->string, (struct sockaddr *) &addr, sizeof(addr), AF_INET6))
+    if(!*net_mcast6addr->string || !Sys_StringToSockaddr(net_mcast6addr->string, (struct sockaddr *) &addr, sizeof(addr), AF_INET6, qtrue))
     {
         Com_Printf("WARNING: NET_JoinMulticast6: Incorrect multicast address given, "
                "please set cvar %s to a sane value.\n", net_mcast6addr->name);
@@ -0,0 +1,338 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+
+Asynchronous name resolution.
+
+getaddrinfo can block for seconds when a resolver is slow or unreachable,
+which used to stall the whole server frame while master server names were
+looked up. Lookups are now handed to a single worker thread and the results
+cached per name and address family. NET_StringToAdrAsync only ever reads the
+cache: it returns -1 until the first lookup for a name has finished, and
+keeps serving the old address while an expired entry is looked up again.
+
+The worker thread only calls NET_ResolveAdr, which never prints or reads
+cvars. Everything else happens on the main thread.
+
+*/
+
+#define MAX_RESOLVE_ENTRIES     32
+#define MAX_RESOLVE_NAME        256
+#define RESOLVE_RETRY_MSEC      60*1000     // failed lookups are retried after this
+
+typedef enum {
+    RS_FREE,
+    RS_QUEUED,              // waiting for the worker
+    RS_RESOLVING,           // worker is looking it up, entry may not be reused
+    RS_DONE
+} resolveState_t;
+
+typedef struct {
+    resolveState_t  state;
+    char            name[MAX_RESOLVE_NAME];
+    netadrtype_t    family;
+
+    qboolean        valid;          // result and adr hold a finished lookup
+    int             result;         // NET_StringToAdr return value
+    netadr_t        adr;
+    int             resolvedTime;   // Sys_Milliseconds when the lookup finished
+    int             lastUsed;
+} resolveEntry_t;
+
+static resolveEntry_t   resolveEntries[MAX_RESOLVE_ENTRIES];
+static sysMutex_t       *resolveMutex;
+static sysSemaphore_t   *resolveSemaphore;
+static sysThread_t      *resolveThread;
+static qboolean         resolveThreadFailed;
+
+static cvar_t           *net_resolveTTL;
+
+/*
+=================
+NET_ResolveThread
+
+Worker loop, woken up once for every queued entry.
+=================
+*/
+static void NET_ResolveThread( void *arg ) {
+    char            name[MAX_RESOLVE_NAME];
+    netadrtype_t    family;
+    netadr_t        adr;
+    int             result;
+    int             i;
+
+    for ( ;; ) {
+        Sys_SemaphoreWait( resolveSemaphore );
+
+        Sys_LockMutex( resolveMutex );
+        for ( i = 0; i < MAX_RESOLVE_ENTRIES; i++ ) {
+            if ( resolveEntries[i].state == RS_QUEUED ) {
+                break;
+            }
+        }
+
+        if ( i == MAX_RESOLVE_ENTRIES ) {
+            Sys_UnlockMutex( resolveMutex );
+            continue;
+        }
+
+        resolveEntries[i].state = RS_RESOLVING;
+        Q_strncpyz( name, resolveEntries[i].name, sizeof( name ) );
+        family = resolveEntries[i].family;
+        Sys_UnlockMutex( resolveMutex );
+
+        // this is the part that may block
+        Com_Memset( &adr, 0, sizeof( adr ) );
+        result = NET_ResolveAdr( name, &adr, family );
+
+        Sys_LockMutex( resolveMutex );
+        resolveEntries[i].state = RS_DONE;
+        resolveEntries[i].valid = qtrue;
+        resolveEntries[i].result = result;
+        resolveEntries[i].adr = adr;
+        resolveEntries[i].resolvedTime = Sys_Milliseconds();
+        Sys_UnlockMutex( resolveMutex );
+    }
+}
+
+/*
+=================
+NET_StartResolveThread
+
+The thread is only started the first time something needs resolving.
+=================
+*/
+static qboolean NET_StartResolveThread( void ) {
+    if ( resolveThread ) {
+        return qtrue;
+    }
+
+    if ( resolveThreadFailed ) {
+        return qfalse;
+    }
+
+    resolveMutex = Sys_CreateMutex();
+    resolveSemaphore = Sys_CreateSemaphore( 0 );
+    resolveThread = Sys_CreateThread( NET_ResolveThread, NULL );
+
+    if ( !resolveThread ) {
+        Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start the resolver thread, name lookups will block\n" );
+        Sys_DestroySemaphore( resolveSemaphore );
+        Sys_DestroyMutex( resolveMutex );
+        resolveSemaphore = NULL;
+        resolveMutex = NULL;
+        resolveThreadFailed = qtrue;
+        return qfalse;
+    }
+
+    return qtrue;
+}
+
+/*
+=================
+NET_FindResolveEntry
+
+Returns the entry for name and family, or a new one to
+queue it in. Must be called with the mutex held.
+=================
+*/
+static resolveEntry_t *NET_FindResolveEntry( const char *name, netadrtype_t family, qboolean *isNew ) {
+    resolveEntry_t  *entry;
+    resolveEntry_t  *oldest;
+    int             i;
+
+    *isNew = qfalse;
+    oldest = NULL;
+
+    for ( i = 0, entry = resolveEntries; i < MAX_RESOLVE_ENTRIES; i++, entry++ ) {
+        if ( entry->state == RS_FREE ) {
+            if ( !oldest || oldest->state != RS_FREE ) {
+                oldest = entry;
+            }
+            continue;
+        }
+
+        if ( entry->family == family && !Q_stricmp( entry->name, name ) ) {
+            return entry;
+        }
+
+        // only finished entries can be evicted, the worker
+        // still refers to queued ones by their index
+        if ( entry->state == RS_DONE && ( !oldest ||
+            ( oldest->state == RS_DONE && entry->lastUsed - oldest->lastUsed < 0 ) ) ) {
+            oldest = entry;
+        }
+    }
+
+    if ( oldest ) {
+        Com_Memset( oldest, 0, sizeof( *oldest ) );
+        Q_strncpyz( oldest->name, name, sizeof( oldest->name ) );
+        oldest->family = family;
+        *isNew = qtrue;
+    }
+
+    return oldest;
+}
+
+/*
+=================
+NET_StringToAdrAsync
+
+Non-blocking NET_StringToAdr for NA_IP and NA_IP6. Returns -1 while the
+first lookup for s is still pending, otherwise the same as NET_StringToAdr.
+=================
+*/
+int NET_StringToAdrAsync( const char *s, netadr_t *a, netadrtype_t family ) {
+    resolveEntry_t  *entry;
+    qboolean        isNew;
+    int             now;
+    int             ttl;
+    int             result;
+
+    if ( strlen( s ) >= MAX_RESOLVE_NAME || ( family != NA_IP && family != NA_IP6 ) ) {
+        return NET_StringToAdr( s, a, family );
+    }
+
+    if ( !NET_StartResolveThread() ) {
+        return NET_StringToAdr( s, a, family );
+    }
+
+    now = Sys_Milliseconds();
+
+    Sys_LockMutex( resolveMutex );
+
+    entry = NET_FindResolveEntry( s, family, &isNew );
+    if ( !entry ) {
+        // every slot is waiting on the worker, try again later
+        Sys_UnlockMutex( resolveMutex );
+        return -1;
+    }
+
+    if ( isNew ) {
+        entry->state = RS_QUEUED;
+        Sys_SemaphorePost( resolveSemaphore );
+    } else if ( entry->state == RS_DONE ) {
+        ttl = entry->result ? net_resolveTTL->integer * 1000 : RESOLVE_RETRY_MSEC;
+
+        if ( now - entry->resolvedTime >= ttl ) {
+            // look it up again, meanwhile the old result is still handed out
+            entry->state = RS_QUEUED;
+            Sys_SemaphorePost( resolveSemaphore );
+        }
+    }
+
+    entry->lastUsed = now;
+
+    if ( entry->valid ) {
+        *a = entry->adr;
+        result = entry->result;
+    } else {
+        result = -1;
+    }
+
+    Sys_UnlockMutex( resolveMutex );
+
+    return result;
+}
+
+/*
+=================
+NET_Resolve_f
+
+resolve <name> [4|6] queues a lookup and shows what the cache has for it,
+without arguments the whole cache is listed.
+=================
+*/
+static void NET_Resolve_f( void ) {
+    resolveEntry_t  *entry;
+    netadrtype_t    family;
+    netadr_t        adr;
+    const char      *state;
+    int             result;
+    int             now;
+    int             i;
+
+    if ( Cmd_Argc() > 1 ) {
+        family = atoi( Cmd_Argv( 2 ) ) == 6 ? NA_IP6 : NA_IP;
+        result = NET_StringToAdrAsync( Cmd_Argv( 1 ), &adr, family );
+
+        if ( result < 0 ) {
+            Com_Printf( "%s: lookup pending\n", Cmd_Argv( 1 ) );
+        } else if ( result == 0 ) {
+            Com_Printf( "%s: not found\n", Cmd_Argv( 1 ) );
+        } else {
+            Com_Printf( "%s: %s\n", Cmd_Argv( 1 ), NET_AdrToStringwPort( adr ) );
+        }
+        return;
+    }
+
+    if ( !resolveThread ) {
+        Com_Printf( "No names have been resolved.\n" );
+        return;
+    }
+
+    now = Sys_Milliseconds();
+
+    Sys_LockMutex( resolveMutex );
+    for ( i = 0, entry = resolveEntries; i < MAX_RESOLVE_ENTRIES; i++, entry++ ) {
+        if ( entry->state == RS_FREE ) {
+            continue;
+        }
+
+        switch ( entry->state ) {
+        case RS_QUEUED:
+            state = "queued";
+            break;
+        case RS_RESOLVING:
+            state = "resolving";
+            break;
+        default:
+            state = "done";
+            break;
+        }
+
+        Com_Printf( "%-32s %s %-9s %-24s", entry->name, entry->family == NA_IP6 ? "v6" : "v4", state,
+            !entry->valid ? "-" : entry->result ? NET_AdrToString( entry->adr ) : "not found" );
+
+        if ( entry->valid ) {
+            Com_Printf( " age %is", ( now - entry->resolvedTime ) / 1000 );
+        }
+        Com_Printf( "\n" );
+    }
+    Sys_UnlockMutex( resolveMutex );
+}
+
+/*
+=================
+NET_InitResolver
+=================
+*/
+void NET_InitResolver( void ) {
+    net_resolveTTL = Cvar_Get( "net_resolveTTL", "86400", CVAR_ARCHIVE );
+    Cvar_CheckRange( net_resolveTTL, 10, 7 * 86400, qtrue );
+
+    Cmd_AddCommand( "resolve", NET_Resolve_f );
+}
@@ -103,6 +103,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define Q_EXPORT
 #endif
 
+// storage class for data that every thread gets its own copy of
+#ifdef _MSC_VER
+#define Q_THREAD_LOCAL __declspec(thread)
+#else
+#define Q_THREAD_LOCAL __thread
+#endif
+
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
@@ -171,6 +171,7 @@ void        NET_Shutdown( void );
 void        NET_Restart_f( void );
 void        NET_Config( qboolean enableNetworking );
 void        NET_FlushPacketQueue(void);
+void        NET_ShutdownPacketQueue(void);
 void        NET_SendPacket (netsrc_t sock, int length, const void *data, netadr_t to);
 void        QDECL NET_OutOfBandPrint( netsrc_t net_socket, netadr_t adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
 void        QDECL NET_OutOfBandData( netsrc_t sock, netadr_t adr, byte *format, int len );
@@ -182,6 +183,12 @@ qboolean    NET_IsLocalAddress (netadr_t adr);
 const char  *NET_AdrToString (netadr_t a);
 const char  *NET_AdrToStringwPort (netadr_t a);
 int     NET_StringToAdr ( const char *s, netadr_t *a, netadrtype_t family);
+int     NET_ResolveAdr( const char *s, netadr_t *a, netadrtype_t family );
+
+// asynchronous lookups: the name is resolved on a worker thread and the
+// result cached, NET_StringToAdrAsync returns -1 while it is still pending
+void        NET_InitResolver( void );
+int         NET_StringToAdrAsync( const char *s, netadr_t *a, netadrtype_t family );
 qboolean    NET_GetLoopPacket (netsrc_t sock, netadr_t *net_from, msg_t *net_message);
 void        NET_JoinMulticast6(void);
 void        NET_LeaveMulticast6(void);
@@ -238,6 +245,41 @@ void Netchan_TransmitNextFragment( netchan_t *chan );
 
 qboolean Netchan_Process( netchan_t *chan, msg_t *msg );
 
+/*
+Packet pools hold queued packets in preallocated slots of a few sizes,
+so queueing a packet doesn't allocate from the zone.  When all slots
+that could hold a packet are in use the allocation fails and is counted.
+*/
+
+#define MAX_PACKETPOOL_SLABS    4
+
+typedef struct packetSlot_s {
+    struct packetSlot_s *next;      // next free slot in the slab
+    int         slab;
+} packetSlot_t;
+
+typedef struct {
+    int         slotSize;           // usable bytes in each slot
+    int         numSlots;
+    byte        *slots;             // allocated on first use
+    packetSlot_t    *free;
+    int         used;
+    int         peak;
+} packetSlab_t;
+
+typedef struct packetPool_s {
+    const char  *name;
+    int         numSlabs;
+    packetSlab_t    slabs[MAX_PACKETPOOL_SLABS];    // in increasing slot size
+    int         exhausted;          // allocations that didn't find a free slot
+    struct packetPool_s *next;
+} packetPool_t;
+
+void NET_InitPacketPool( packetPool_t *pool, const char *name, const int *slotSizes, const int *numSlots, int numSlabs );
+void *NET_PacketPoolAlloc( packetPool_t *pool, int size );
+void NET_PacketPoolFree( packetPool_t *pool, void *data );
+void NET_ShutdownPacketPool( packetPool_t *pool );
+
 
 /*
 ==============================================================
@@ -802,6 +844,7 @@ int QDECL   Com_strCompare( const void *a, const void *b );
 extern  cvar_t  *com_developer;
 extern  cvar_t  *com_dedicated;
 extern  cvar_t  *com_speeds;
+extern  cvar_t  *com_showtrace;
 extern  cvar_t  *com_timescale;
 extern  cvar_t  *com_sv_running;
 extern  cvar_t  *com_cl_running;
@@ -1015,6 +1058,11 @@ int SV_FrameMsec(void);
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets(void);
 
+//
+// renderer interface
+//
+void G2_ArenaInfo( void );
+
 //
 // UI interface
 //
@@ -1073,6 +1121,7 @@ void    Sys_SendPacket( int length, const void *data, netadr_t to );
 
 qboolean    Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 //Does NOT parse port numbers, only base addresses.
+qboolean    Sys_ResolveAdr( const char *s, netadr_t *a, netadrtype_t family );
 
 qboolean    Sys_IsLANAddress (netadr_t adr);
 void        Sys_ShowIP(void);
@@ -1126,6 +1175,37 @@ dialogResult_t Sys_Dialog( dialogType_t type, const char *message, const char *t
 void Sys_RemovePIDFile( const char *gamedir );
 void Sys_InitPIDFile( const char *gamedir );
 
+// threads, for background work that must never stall a frame.
+// Nothing reached from a worker may touch cvars, the zone or the console.
+typedef struct sysThread_s sysThread_t;
+typedef struct sysMutex_s sysMutex_t;
+typedef struct sysSemaphore_s sysSemaphore_t;
+
+int     Sys_ProcessorCount( void );
+
+sysThread_t *Sys_CreateThread( void (*func)( void *arg ), void *arg );
+void    Sys_JoinThread( sysThread_t *thread );
+
+sysMutex_t *Sys_CreateMutex( void );
+void    Sys_DestroyMutex( sysMutex_t *mutex );
+void    Sys_LockMutex( sysMutex_t *mutex );
+void    Sys_UnlockMutex( sysMutex_t *mutex );
+
+sysSemaphore_t *Sys_CreateSemaphore( int count );
+void    Sys_DestroySemaphore( sysSemaphore_t *sem );
+void    Sys_SemaphoreWait( sysSemaphore_t *sem );
+void    Sys_SemaphorePost( sysSemaphore_t *sem );
+
+// jobs.c, spreads independent work items over a pool of worker threads.
+// Com_RunJobs must only be called from the main thread and returns when
+// func has been called once for every index; the calling thread helps out.
+typedef void (*jobFunc_t)( void *data, int index );
+
+void    Com_InitJobs( void );
+void    Com_ShutdownJobs( void );
+int     Com_JobThreads( void );
+void    Com_RunJobs( jobFunc_t func, void *data, int count );
+
 /* This is based on the Adaptive Huffman algorithm described in Sayood's Data
  * Compression book.  The ranks are not actually stored, but implicitly defined
  * by the location of a node within a doubly-linked list */
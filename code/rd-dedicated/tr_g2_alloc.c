@@ -0,0 +1,310 @@
+/*
+===========================================================================
+Copyright (C) 2017, SoF2Plus contributors
+
+This file is part of the SoF2Plus source code.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+// tr_g2_alloc.c - Ghoul II instance memory.
+
+#include "tr_g2_local.h"
+
+/*
+=============================================
+Ghoul II models are created and removed every
+time a player spawns or leaves. Everything an
+instance needs is allocated here, in blocks of
+the same size for the same kind of data of the
+same model. Each size gets a slab that takes
+its blocks from the zone a chunk at a time and
+keeps freed blocks on a free list, so instances
+are recycled instead of fragmenting the zone.
+=============================================
+*/
+
+#define     G2_CHUNK_BYTES          (64 * 1024)     // Blocks are taken from the zone this much at a time, at least one.
+#define     G2_BLOCK_ALIGN          16
+#define     MAX_G2_SLABS            64
+
+typedef     struct      g2Slab_s        g2Slab_t;
+typedef     struct      g2Block_s       g2Block_t;
+typedef     struct      g2Chunk_s       g2Chunk_t;
+
+struct g2Block_s {
+    g2Slab_t            *slab;                      // NULL if taken straight from the zone.
+    g2Block_t           *next;                      // Next free block of the slab.
+};
+
+struct g2Chunk_s {
+    g2Chunk_t           *next;
+};
+
+struct g2Slab_s {
+    char                name[MAX_QPATH];            // What the blocks are for.
+    int                 blockSize;                  // Without the block header.
+
+    g2Chunk_t           *chunks;
+    g2Block_t           *freeList;
+
+    int                 numChunks;
+    int                 numBlocks;
+    int                 numUsed;
+    int                 peakUsed;
+    int                 numAllocs;
+};
+
+static g2Slab_t         g2Slabs[MAX_G2_SLABS];
+static int              g2NumSlabs;
+static int              g2ZoneBlocks;               // Blocks allocated outside the slabs.
+
+#define     G2_BLOCK_HEADER         PAD((int)sizeof(g2Block_t), G2_BLOCK_ALIGN)
+#define     G2_CHUNK_HEADER         PAD((int)sizeof(g2Chunk_t), G2_BLOCK_ALIGN)
+
+/*
+==================
+G2_FindSlab
+
+Returns the slab for blocks of this size and
+name, creating it if needed. Returns NULL if
+there are no free slabs left.
+==================
+*/
+
+static g2Slab_t *G2_FindSlab(int blockSize, const char *name)
+{
+    g2Slab_t    *slab, *freeSlab;
+    int         i;
+
+    freeSlab = NULL;
+    for(i = 0, slab = g2Slabs; i < g2NumSlabs; i++, slab++){
+        if(slab->blockSize == blockSize && !Q_stricmp(slab->name, name)){
+            return slab;
+        }
+
+        // Emptied by G2_ShrinkArena, but kept in
+        // place by a slab in use after it.
+        if(!slab->blockSize && !freeSlab){
+            freeSlab = slab;
+        }
+    }
+
+    if(freeSlab){
+        slab = freeSlab;
+    }else if(g2NumSlabs == MAX_G2_SLABS){
+        return NULL;
+    }else{
+        slab = &g2Slabs[g2NumSlabs++];
+    }
+
+    Com_Memset(slab, 0, sizeof(g2Slab_t));
+    Q_strncpyz(slab->name, name, sizeof(slab->name));
+    slab->blockSize = blockSize;
+
+    return slab;
+}
+
+/*
+==================
+G2_GrowSlab
+
+Adds a chunk of free blocks to the slab.
+==================
+*/
+
+static void G2_GrowSlab(g2Slab_t *slab)
+{
+    g2Chunk_t   *chunk;
+    g2Block_t   *block;
+    int         stride, numBlocks;
+    int         i;
+
+    stride = G2_BLOCK_HEADER + slab->blockSize;
+    numBlocks = (G2_CHUNK_BYTES - G2_CHUNK_HEADER) / stride;
+    if(numBlocks < 1){
+        numBlocks = 1;
+    }
+
+    chunk = Z_TagMalloc(G2_CHUNK_HEADER + numBlocks * stride, TAG_GHOUL2);
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    slab->numChunks++;
+
+    for(i = 0; i < numBlocks; i++){
+        block = (g2Block_t *)((byte *)chunk + G2_CHUNK_HEADER + i * stride);
+        block->slab = slab;
+        block->next = slab->freeList;
+        slab->freeList = block;
+    }
+
+    slab->numBlocks += numBlocks;
+}
+
+/*
+==================
+G2_Alloc
+
+Returns a block of at least size bytes from
+the slab of the given name. The contents are
+not cleared.
+==================
+*/
+
+void *G2_Alloc(int size, const char *name)
+{
+    g2Slab_t    *slab;
+    g2Block_t   *block;
+
+    // Slabs with a block size of 0 are free.
+    if(size < 1){
+        size = 1;
+    }
+
+    size = PAD(size, G2_BLOCK_ALIGN);
+    slab = G2_FindSlab(size, name);
+
+    // Out of slabs, just use the zone.
+    if(slab == NULL){
+        block = Z_TagMalloc(G2_BLOCK_HEADER + size, TAG_GHOUL2);
+        block->slab = NULL;
+        g2ZoneBlocks++;
+
+        return (byte *)block + G2_BLOCK_HEADER;
+    }
+
+    if(slab->freeList == NULL){
+        G2_GrowSlab(slab);
+    }
+
+    block = slab->freeList;
+    slab->freeList = block->next;
+
+    slab->numAllocs++;
+    slab->numUsed++;
+    if(slab->numUsed > slab->peakUsed){
+        slab->peakUsed = slab->numUsed;
+    }
+
+    return (byte *)block + G2_BLOCK_HEADER;
+}
+
+/*
+==================
+G2_Free
+
+Returns a block to its slab.
+==================
+*/
+
+void G2_Free(void *ptr)
+{
+    g2Block_t   *block;
+    g2Slab_t    *slab;
+
+    block = (g2Block_t *)((byte *)ptr - G2_BLOCK_HEADER);
+    slab = block->slab;
+
+    if(slab == NULL){
+        Z_Free(block);
+        g2ZoneBlocks--;
+        return;
+    }
+
+    block->next = slab->freeList;
+    slab->freeList = block;
+    slab->numUsed--;
+}
+
+/*
+==================
+G2_ShrinkArena
+
+Gives the memory of slabs without any blocks
+in use back to the zone. Called when the
+renderer starts, as the models of the next
+level may need other sizes.
+==================
+*/
+
+void G2_ShrinkArena(void)
+{
+    g2Slab_t    *slab;
+    g2Chunk_t   *chunk, *next;
+    int         i, numKept;
+
+    numKept = 0;
+    for(i = 0, slab = g2Slabs; i < g2NumSlabs; i++, slab++){
+        if(slab->numUsed){
+            // Blocks point back at their slab,
+            // so slabs in use can't move.
+            numKept = i + 1;
+            continue;
+        }
+
+        for(chunk = slab->chunks; chunk; chunk = next){
+            next = chunk->next;
+            Z_Free(chunk);
+        }
+
+        Com_Memset(slab, 0, sizeof(g2Slab_t));
+    }
+
+    g2NumSlabs = numKept;
+}
+
+/*
+==================
+G2_ArenaInfo
+
+Prints the memory statistics of the Ghoul II
+arena, as part of meminfo.
+==================
+*/
+
+void G2_ArenaInfo(void)
+{
+    g2Slab_t    *slab;
+    int         totalBytes, usedBytes;
+    int         bytes, numSlabs;
+    int         i;
+
+    Com_Printf("Ghoul II arena\n");
+    Com_Printf("==========\n");
+
+    totalBytes = usedBytes = numSlabs = 0;
+    for(i = 0, slab = g2Slabs; i < g2NumSlabs; i++, slab++){
+        if(!slab->numChunks){
+            continue;
+        }
+
+        bytes = slab->numBlocks * (G2_BLOCK_HEADER + slab->blockSize) + slab->numChunks * G2_CHUNK_HEADER;
+        totalBytes += bytes;
+        usedBytes += slab->numUsed * slab->blockSize;
+        numSlabs++;
+    }
+
+    Com_Printf("%8i bytes in %i slabs, %i bytes in use\n", totalBytes, numSlabs, usedBytes);
+    if(g2ZoneBlocks){
+        Com_Printf("%8i blocks outside the slabs\n", g2ZoneBlocks);
+    }
+
+    for(i = 0, slab = g2Slabs; i < g2NumSlabs; i++, slab++){
+        if(!slab->numChunks){
+            continue;
+        }
+
+        Com_Printf("        %8i bytes, %4i/%4i blocks in use, peak %4i, %6i allocs : %s\n",
+            slab->blockSize, slab->numUsed, slab->numBlocks, slab->peakUsed, slab->numAllocs, slab->name);
+    }
+}
@@ -24,6 +24,8 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_g2_local.h"
 
+g2CollisionStats_t  g2CollisionStats;
+
 /*
 ==================
 G2API_ListBones
@@ -178,7 +180,7 @@ qboolean G2API_InitGhoul2Model(CGhoul2Model_t **modelPtr, const char *fileName,
     }
 
     // Allocate memory for the actual Ghoul II model.
-    model = Z_TagMalloc(sizeof(CGhoul2Model_t), TAG_GHOUL2);
+    model = G2_Alloc(sizeof(CGhoul2Model_t), "Ghoul II instances");
     Com_Memset(model, 0, sizeof(CGhoul2Model_t));
 
     // Set new Ghoul II model info.
@@ -237,34 +239,22 @@ qboolean G2API_RemoveGhoul2Model(CGhoul2Model_t **modelPtr)
 
     // Free the entire bone cache.
     if(model->mBoneCache){
-        if(model->mBoneCache->mBones){
-            Z_Free(model->mBoneCache->mBones);
-        }
-        if(model->mBoneCache->mFinalBones){
-            Z_Free(model->mBoneCache->mFinalBones);
-        }
-
-        Z_Free(model->mBoneCache);
+        G2_Free(model->mBoneCache);
     }
 
     // Free bones from the bone list.
     for(i = 0; i < model->numBones; i++){
-        Z_Free(model->mBoneList[i]);
+        G2_Free(model->mBoneList[i]);
     }
 
-    // Free transformed verts array.
+    // Free transformed verts, along with
+    // the arrays they share a block with.
     if(model->mTransformedVertsArray){
-        for(i = 0; i < model->numTransformedVerts; i++){
-            if(model->mTransformedVertsArray[i]){
-                Z_Free(model->mTransformedVertsArray[i]);
-            }
-        }
-
-        Z_Free(model->mTransformedVertsArray);
+        G2_Free(model->mTransformedVertsArray);
     }
 
     // Finally, free the actual Ghoul II model.
-    Z_Free(model);
+    G2_Free(model);
 
     // All done.
     *modelPtr = NULL;
@@ -316,6 +306,7 @@ qboolean G2API_SetBoneAngles(CGhoul2Model_t *model, const char *boneName, const
 
     // Generate the end matrix.
     G2_BoneGenerateMatrix(modAnim, model->mBoneList, boneIndex, angles, flags, up, left, forward);
+    model->mPoseVersion++;
 
     return qtrue;
 }
@@ -401,6 +392,7 @@ qboolean G2API_SetBoneAnim(CGhoul2Model_t *model, const char *boneName, const in
         model->mBoneList[boneIndex]->flags = 0;
     }
     model->mBoneList[boneIndex]->flags |= flags;
+    model->mPoseVersion++;
 
     return qtrue;
 }
@@ -471,19 +463,44 @@ static int QDECL G2_CollisionDetectSortDistance(const void *recA, const void *re
 void G2API_CollisionDetect(CollisionRecord_t *collRecMap, CGhoul2Model_t *model, const vec3_t angles, const vec3_t position,
                            int frameNumber, int entNum, vec3_t rayStart, vec3_t rayEnd, vec3_t scale, int traceFlags, int useLod)
 {
-    vec3_t      transRayStart;
-    vec3_t      transRayEnd;
-    mdxaBone_t  worldMatrix;
-    mdxaBone_t  worldMatrixInv;
-    int         i;
+    G2API_CollisionDetectMulti(collRecMap, model, angles, position, frameNumber, entNum,
+        (vec3_t *)rayStart, (vec3_t *)rayEnd, 1, scale, traceFlags, useLod);
+}
+
+/*
+==================
+G2API_CollisionDetectMulti
+
+Same as G2API_CollisionDetect for a number
+of rays against the same model and pose,
+each ray filling its own MAX_G2_COLLISIONS
+collision records in collRecMaps. The model
+is posed and skinned once for all of them.
+==================
+*/
+
+void G2API_CollisionDetectMulti(CollisionRecord_t *collRecMaps, CGhoul2Model_t *model, const vec3_t angles, const vec3_t position,
+                                int frameNumber, int entNum, vec3_t *rayStarts, vec3_t *rayEnds, int numRays,
+                                vec3_t scale, int traceFlags, int useLod)
+{
+    vec3_t              transRayStarts[MAX_G2_TRACE_RAYS];
+    vec3_t              transRayEnds[MAX_G2_TRACE_RAYS];
+    mdxaBone_t          worldMatrix;
+    mdxaBone_t          worldMatrixInv;
+    CollisionRecord_t   *collRecMap;
+    int                 i, j, n;
+
+    if(numRays <= 0){
+        return;
+    }
 
     //
     // Initialize collision trace records
     // before anything else.
     //
-    Com_Memset(collRecMap, 0, sizeof(G2Trace_t));
-    for(i = 0; i < MAX_G2_COLLISIONS; i++){
-        collRecMap[i].mEntityNum = -1;
+    Com_Memset(collRecMaps, 0, numRays * sizeof(G2Trace_t));
+    for(i = 0; i < numRays * MAX_G2_COLLISIONS; i++){
+        collRecMaps[i].mEntityNum = -1;
     }
 
     //
@@ -492,6 +509,8 @@ void G2API_CollisionDetect(CollisionRecord_t *collRecMap, CGhoul2Model_t *model,
     if(!G2_IsModelValid(model, "G2API_CollisionDetect")){
         return;
     }
+    g2CollisionStats.calls++;
+    g2CollisionStats.rays += numRays;
 
     //
     // Build model.
@@ -513,22 +532,52 @@ void G2API_CollisionDetect(CollisionRecord_t *collRecMap, CGhoul2Model_t *model,
     // Check if any triangles are actually hit.
     //
 
-    // Translate the rays to model space.
-    G2_TransformTranslatePoint(rayStart, transRayStart, &worldMatrixInv);
-    G2_TransformTranslatePoint(rayEnd, transRayEnd, &worldMatrixInv);
+    for(n = 0; n < numRays; n += MAX_G2_TRACE_RAYS){
+        // Translate the rays to model space.
+        for(i = 0; i < MAX_G2_TRACE_RAYS && n + i < numRays; i++){
+            G2_TransformTranslatePoint(rayStarts[n + i], transRayStarts[i], &worldMatrixInv);
+            G2_TransformTranslatePoint(rayEnds[n + i], transRayEnds[i], &worldMatrixInv);
+        }
+
+        // Now check the rays against each poly.
+        G2_TraceModel(model, transRayStarts, transRayEnds, i, &worldMatrix,
+            collRecMaps + n * MAX_G2_COLLISIONS, entNum, traceFlags, useLod);
+    }
 
-    // Now check the ray against each poly.
-    G2_TraceModel(model, transRayStart, transRayEnd, &worldMatrix, collRecMap, entNum, traceFlags, useLod);
+    for(i = 0; i < numRays; i++){
+        collRecMap = collRecMaps + i * MAX_G2_COLLISIONS;
 
-    // Check how many collision records we have.
-    for(i = 0; i < MAX_G2_COLLISIONS; i++){
-        if(collRecMap[i].mEntityNum == -1){
-            break;
+        // Check how many collision records we have.
+        for(j = 0; j < MAX_G2_COLLISIONS; j++){
+            if(collRecMap[j].mEntityNum == -1){
+                break;
+            }
         }
+
+        // Sort the resulting array of collision records so they are distance sorted.
+        qsort(collRecMap, j, sizeof(CollisionRecord_t), G2_CollisionDetectSortDistance);
+    }
+}
+
+/*
+==================
+G2API_CollisionStats
+
+Prints and clears the collision cache
+counters, every frame while com_showtrace
+is set.
+==================
+*/
+
+void G2API_CollisionStats(void)
+{
+    if(g2CollisionStats.calls){
+        Com_Printf("%4i G2 collision checks (%i rays), %i reused the skeleton, %i the skinned mesh, %i surfaces skinned, %i culled, %i polys tested\n",
+            g2CollisionStats.calls, g2CollisionStats.rays, g2CollisionStats.skeletonHits, g2CollisionStats.meshHits,
+            g2CollisionStats.surfacesSkinned, g2CollisionStats.surfacesCulled, g2CollisionStats.polysTested);
     }
 
-    // Sort the resulting array of collision records so they are distance sorted.
-    qsort(collRecMap, i, sizeof(CollisionRecord_t), G2_CollisionDetectSortDistance);
+    Com_Memset(&g2CollisionStats, 0, sizeof(g2CollisionStats));
 }
 
 /*
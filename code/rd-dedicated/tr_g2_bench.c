@@ -0,0 +1,652 @@
+/*
+===========================================================================
+Copyright (C) 2017, SoF2Plus contributors
+
+This file is part of the SoF2Plus source code.
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3 as
+published by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, see <http://www.gnu.org/licenses/>.
+===========================================================================
+*/
+// tr_g2_bench.c - Console commands to time and check the Ghoul II collision code.
+
+#include "tr_g2_local.h"
+
+/*
+=============================================
+------------------------------
+Shared by the bench commands.
+------------------------------
+=============================================
+*/
+
+/*
+==============
+G2_BenchRandom
+
+A number in [0, 1) from the seed, the same
+numbers for the same seed on every platform.
+==============
+*/
+
+static float G2_BenchRandom(unsigned int *seed)
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return (*seed >> 8) / (float)(1 << 24);
+}
+
+/*
+==============
+G2_BenchLoopAnimation
+
+Loops the whole animation on the root bone,
+so every frame shows a different pose.
+==============
+*/
+
+static void G2_BenchLoopAnimation(CGhoul2Model_t *model)
+{
+    mdxaSkelOffsets_t   *offsets;
+    mdxaSkel_t          *skel;
+
+    offsets = (mdxaSkelOffsets_t *)((byte *)model->aHeader + sizeof(mdxaHeader_t));
+    skel = (mdxaSkel_t *)((byte *)model->aHeader + sizeof(mdxaHeader_t) + offsets->offsets[0]);
+    G2API_SetBoneAnim(model, skel->name, 0, model->aHeader->numFrames - 1, BONE_ANIM_OVERRIDE_LOOP, 1.0f, 0);
+}
+
+/*
+=============================================
+---------------------------
+Skinning benchmark command.
+---------------------------
+=============================================
+*/
+
+/*
+==============
+G2_SkinBenchModel
+
+Skins all surfaces of all LODs of a model
+both ways, returns the number of vertexes
+where they don't agree.
+==============
+*/
+
+static int G2_SkinBenchModel(const model_t *mod, int passes, float *verts[2], int *msec, int *numVerts)
+{
+#if idx64
+    CGhoul2Model_t      *model;
+    mdxmHeader_t        *mdxm;
+    mdxmSurface_t       *surface;
+    const surfaceSkin_t *skin;
+    vec3_t              scale;
+    int                 lod, i, j, k, pass, start;
+    int                 mismatches;
+
+    model = NULL;
+    if(!G2API_InitGhoul2Model(&model, mod->name, 0, -1) || !model->mValid){
+        G2API_RemoveGhoul2Model(&model);
+        return -1;
+    }
+
+    G2_TransformSkeleton(model, 0);
+    VectorSet(scale, 1.0f, 1.0f, 1.0f);
+
+    mdxm = mod->modelData;
+    mismatches = 0;
+    *numVerts = 0;
+
+    for(lod = 0; lod < mdxm->numLODs; lod++){
+        for(i = 0; i < mdxm->numSurfaces; i++){
+            surface = G2_FindSurfaceFromModel(mod, i, lod);
+            skin = &mod->surfaceSkins[lod * mdxm->numSurfaces + i];
+            if(!surface || !skin->groups){
+                continue;
+            }
+
+            *numVerts += surface->numVerts * passes;
+
+            start = Sys_Milliseconds();
+            for(pass = 0; pass < passes; pass++){
+                G2_SkinSurface(model, surface, verts[0], scale);
+            }
+            msec[0] += Sys_Milliseconds() - start;
+
+            start = Sys_Milliseconds();
+            for(pass = 0; pass < passes; pass++){
+                G2_SkinSurfaceSIMD(model, surface, skin, verts[1], scale);
+            }
+            msec[1] += Sys_Milliseconds() - start;
+
+            for(j = 0; j < surface->numVerts; j++){
+                for(k = 0; k < 3; k++){
+                    if(verts[0][j * 4 + k] != verts[1][j * 4 + k]){
+                        break;
+                    }
+                }
+                if(k < 3){
+                    mismatches++;
+                }
+            }
+        }
+    }
+
+    G2API_RemoveGhoul2Model(&model);
+    return mismatches;
+#else
+    return -1;
+#endif // idx64
+}
+
+/*
+==============
+G2_SkinBench_f
+
+g2skinbench [passes] [model]
+
+Compares skinning collision meshes one
+vertex and four vertexes at a time, over
+the given model or all Ghoul II meshes
+that are loaded. With players on the
+server those are the player models.
+==============
+*/
+
+void G2_SkinBench_f(void)
+{
+    const model_t   *mod;
+    float           *verts[2];
+    int             passes;
+    int             msec[2], numVerts, mismatches;
+    int             i, numModels;
+
+#if !idx64
+    Com_Printf("g2skinbench: there is no SIMD skinning on this platform.\n");
+    return;
+#endif // !idx64
+
+    passes = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+    if(passes < 1){
+        Com_Printf("Usage: g2skinbench [passes] [model]\n");
+        return;
+    }
+
+    if(Cmd_Argc() > 2 && RE_RegisterServerModel(Cmd_Argv(2)) < 0){
+        return;
+    }
+
+    verts[0] = Z_Malloc(SHADER_MAX_VERTEXES * 4 * sizeof(float));
+    verts[1] = Z_Malloc(SHADER_MAX_VERTEXES * 4 * sizeof(float));
+
+    numModels = 0;
+    for(i = 0; i < tr.numModels; i++){
+        mod = tr.models[i];
+        if(mod->type != MOD_MDXM){
+            continue;
+        }
+        if(Cmd_Argc() > 2 && Q_stricmp(mod->name, Cmd_Argv(2))){
+            continue;
+        }
+
+        msec[0] = msec[1] = 0;
+        mismatches = G2_SkinBenchModel(mod, passes, verts, msec, &numVerts);
+        if(mismatches < 0){
+            continue;
+        }
+
+        Com_Printf("%s: %i verts, scalar %i msec, simd %i msec, %i mismatches\n",
+            mod->name, numVerts, msec[0], msec[1], mismatches);
+        numModels++;
+    }
+
+    if(!numModels){
+        Com_Printf("No Ghoul II meshes are loaded.\n");
+    }
+
+    Z_Free(verts[1]);
+    Z_Free(verts[0]);
+}
+
+/*
+=============================================
+----------------------------
+Multi-ray benchmark command.
+----------------------------
+=============================================
+*/
+
+/*
+==============
+G2_RayBenchBurst
+
+Aims a burst of rays at the model from a
+random direction, the same rays for the
+same pass.
+==============
+*/
+
+static void G2_RayBenchBurst(int pass, vec3_t *rayStarts, vec3_t *rayEnds, int numRays)
+{
+    unsigned int    seed;
+    vec3_t          muzzle, aim, dir;
+    float           yaw, pitch;
+    int             i, j;
+
+    seed = pass * 7919 + 1;
+
+    // Somewhere inside a player sized box.
+    aim[0] = (G2_BenchRandom(&seed) - 0.5f) * 32.0f;
+    aim[1] = (G2_BenchRandom(&seed) - 0.5f) * 32.0f;
+    aim[2] = (G2_BenchRandom(&seed) - 0.5f) * 80.0f;
+
+    yaw = G2_BenchRandom(&seed) * 2.0f * M_PI;
+    pitch = (G2_BenchRandom(&seed) - 0.5f) * 0.5f;
+    dir[0] = cos(yaw) * cos(pitch);
+    dir[1] = sin(yaw) * cos(pitch);
+    dir[2] = sin(pitch);
+    VectorMA(aim, 256.0f, dir, muzzle);
+
+    for(i = 0; i < numRays; i++){
+        VectorCopy(muzzle, rayStarts[i]);
+
+        // Spread the pellets around the aim point,
+        // and go as far past it again.
+        for(j = 0; j < 3; j++){
+            rayEnds[i][j] = muzzle[j] + 2.0f * (aim[j] + (G2_BenchRandom(&seed) - 0.5f) * 16.0f - muzzle[j]);
+        }
+    }
+}
+
+/*
+==============
+G2_RayBench_f
+
+g2raybench <model> [rays] [passes]
+
+Fires a burst of rays at a Ghoul II model
+posed on a different frame each pass, first
+with a G2API_CollisionDetect call per ray
+and then with one G2API_CollisionDetectMulti
+call per burst, and checks that both give
+the same collision records.
+==============
+*/
+
+void G2_RayBench_f(void)
+{
+    CGhoul2Model_t      *model;
+    CollisionRecord_t   *recs;
+    vec3_t              *rayStarts, *rayEnds;
+    vec3_t              scale;
+    unsigned int        *checksums;
+    int                 numRays, passes;
+    int                 msec[2], start, hits, mismatches;
+    int                 i, pass, method;
+
+    numRays = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 12;
+    passes = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 1000;
+    if(Cmd_Argc() < 2 || numRays < 1 || passes < 1){
+        Com_Printf("Usage: g2raybench <model> [rays] [passes]\n");
+        return;
+    }
+
+    model = NULL;
+    if(!G2API_InitGhoul2Model(&model, Cmd_Argv(1), 0, 0)){
+        return;
+    }
+    if(!G2_IsModelValid(model, "G2_RayBench_f")){
+        G2API_RemoveGhoul2Model(&model);
+        return;
+    }
+
+    // Every pass shows a different pose.
+    G2_BenchLoopAnimation(model);
+
+    recs = Z_Malloc(numRays * sizeof(G2Trace_t));
+    rayStarts = Z_Malloc(numRays * sizeof(vec3_t));
+    rayEnds = Z_Malloc(numRays * sizeof(vec3_t));
+    checksums = Z_Malloc(passes * sizeof(unsigned int));
+    VectorSet(scale, 1.0f, 1.0f, 1.0f);
+
+    hits = mismatches = 0;
+    for(method = 0; method < 2; method++){
+        msec[method] = 0;
+
+        for(pass = 0; pass < passes; pass++){
+            G2_RayBenchBurst(pass, rayStarts, rayEnds, numRays);
+
+            start = Sys_Milliseconds();
+            if(!method){
+                for(i = 0; i < numRays; i++){
+                    G2API_CollisionDetect(recs + i * MAX_G2_COLLISIONS, model, vec3_origin, vec3_origin, pass * 50, 0,
+                        rayStarts[i], rayEnds[i], scale, G2_COLLIDE, 0);
+                }
+            }else{
+                G2API_CollisionDetectMulti(recs, model, vec3_origin, vec3_origin, pass * 50, 0,
+                    rayStarts, rayEnds, numRays, scale, G2_COLLIDE, 0);
+            }
+            msec[method] += Sys_Milliseconds() - start;
+
+            if(!method){
+                checksums[pass] = Com_BlockChecksum(recs, numRays * sizeof(G2Trace_t));
+                for(i = 0; i < numRays; i++){
+                    if(recs[i * MAX_G2_COLLISIONS].mEntityNum != -1){
+                        hits++;
+                    }
+                }
+            }else if(checksums[pass] != Com_BlockChecksum(recs, numRays * sizeof(G2Trace_t))){
+                mismatches++;
+            }
+        }
+    }
+
+    Com_Printf("%i bursts of %i rays, %i hit: single %i msec, multi %i msec, %i mismatches\n",
+        passes, numRays, hits, msec[0], msec[1], mismatches);
+
+    // Don't leave the counters for com_showtrace.
+    Com_Memset(&g2CollisionStats, 0, sizeof(g2CollisionStats));
+
+    Z_Free(checksums);
+    Z_Free(rayEnds);
+    Z_Free(rayStarts);
+    Z_Free(recs);
+    G2API_RemoveGhoul2Model(&model);
+}
+
+/*
+=============================================
+-------------------------------------
+Hit detection benchmark and regression
+command.
+-------------------------------------
+=============================================
+*/
+
+typedef struct {
+    fileHandle_t        f;                          // Saving the records.
+    char                *golden;                    // Checking them, the golden file.
+    char                *pos;
+    int                 line;
+    int                 mismatches;
+    int                 firstMismatch;
+} g2HitGolden_t;
+
+/*
+==============
+G2_HitBenchSkin
+
+Skins every surface of the LOD the verts
+are set up for, for timing the skinning
+on its own.
+==============
+*/
+
+static void G2_HitBenchSkin(CGhoul2Model_t *model)
+{
+    mdxmSurface_t   *surface;
+    int             i;
+
+    for(i = 0; i < model->numTransformedVerts; i++){
+        if(model->mSurfaceVertsStamp[i] == model->mVertsStamp){
+            continue;
+        }
+
+        surface = G2_FindSurfaceFromModel(model->currentModel, i, model->mVertsLod);
+        if(surface){
+            G2_TransformEachSurface(model, surface, model->mVertsLod, model->mVertsScale);
+            model->mSurfaceVertsStamp[i] = model->mVertsStamp;
+        }
+    }
+}
+
+/*
+==============
+G2_HitBenchLine
+
+Saves a line of the results, or compares it
+with the next line of the golden file.
+==============
+*/
+
+static void G2_HitBenchLine(g2HitGolden_t *golden, const char *line)
+{
+    char    *end;
+    int     len;
+
+    golden->line++;
+
+    if(golden->f){
+        FS_Write(line, strlen(line), golden->f);
+        return;
+    }
+
+    if(!golden->golden){
+        return;
+    }
+
+    end = strchr(golden->pos, '\n');
+    len = end ? end - golden->pos + 1 : strlen(golden->pos);
+
+    if(len != (int)strlen(line) || strncmp(golden->pos, line, len)){
+        if(!golden->mismatches){
+            golden->firstMismatch = golden->line;
+        }
+        golden->mismatches++;
+    }
+
+    golden->pos += len;
+}
+
+/*
+==============
+G2_HitBench_f
+
+g2hitbench <model> [frames] [rays] [save|check] [file]
+
+Poses a Ghoul II model on successive frames
+of its animation and casts the same random
+rays at it every run. Reports the time spent
+evaluating bones, skinning and testing polys,
+and the rate of full collision checks.
+
+The collision records can be saved to a golden
+file and checked against it later, to make sure
+a change gives identical results.
+==============
+*/
+
+void G2_HitBench_f(void)
+{
+    CGhoul2Model_t      *model;
+    CollisionRecord_t   *recs, *rec;
+    vec3_t              *rayStarts, *rayEnds;
+    vec3_t              *frameStarts, *frameEnds;
+    vec3_t              angles, origin, scale, target, dir;
+    g2HitGolden_t       golden;
+    const char          *mode, *fileName;
+    char                line[MAX_STRING_CHARS];
+    unsigned int        seed;
+    float               yaw, pitch;
+    int                 numFrames, numRays, totalRays;
+    int                 msec[4], start, hits, numRecords;
+    int                 frame, phase, i, j;
+
+    numFrames = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 100;
+    numRays = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : 100;
+    mode = Cmd_Argv(4);
+    fileName = Cmd_Argc() > 5 ? Cmd_Argv(5) : "g2hitbench.txt";
+
+    if(Cmd_Argc() < 2 || numFrames < 1 || numRays < 1 || (mode[0] && Q_stricmp(mode, "save") && Q_stricmp(mode, "check"))){
+        Com_Printf("Usage: g2hitbench <model> [frames] [rays] [save|check] [file]\n");
+        return;
+    }
+
+    Com_Memset(&golden, 0, sizeof(golden));
+    if(!Q_stricmp(mode, "check")){
+        if(FS_ReadFile(fileName, (void **)&golden.golden) < 0){
+            Com_Printf("g2hitbench: couldn't read %s.\n", fileName);
+            return;
+        }
+        golden.pos = golden.golden;
+    }
+
+    model = NULL;
+    if(!G2API_InitGhoul2Model(&model, Cmd_Argv(1), 0, 0) || !G2_IsModelValid(model, "G2_HitBench_f")){
+        if(model){
+            G2API_RemoveGhoul2Model(&model);
+        }
+        if(golden.golden){
+            FS_FreeFile(golden.golden);
+        }
+        return;
+    }
+
+    // Each frame of the benchmark shows the
+    // next frame of the animation.
+    G2_BenchLoopAnimation(model);
+
+    VectorSet(angles, 0.0f, 30.0f, 0.0f);
+    VectorSet(origin, 100.0f, 50.0f, 0.0f);
+    VectorSet(scale, 1.0f, 1.0f, 1.0f);
+
+    //
+    // Make up the rays, from all around the model through
+    // a player sized box, with a fixed seed so every run
+    // casts the same ones.
+    //
+    totalRays = numFrames * numRays;
+    rayStarts = Z_Malloc(totalRays * sizeof(vec3_t));
+    rayEnds = Z_Malloc(totalRays * sizeof(vec3_t));
+    recs = Z_Malloc(numRays * sizeof(G2Trace_t));
+
+    seed = 1;
+
+    for(i = 0; i < totalRays; i++){
+        target[0] = origin[0] + (G2_BenchRandom(&seed) - 0.5f) * 32.0f;
+        target[1] = origin[1] + (G2_BenchRandom(&seed) - 0.5f) * 32.0f;
+        target[2] = origin[2] + (G2_BenchRandom(&seed) - 0.5f) * 80.0f;
+
+        yaw = G2_BenchRandom(&seed) * 2.0f * M_PI;
+        pitch = (G2_BenchRandom(&seed) - 0.5f) * M_PI;
+        dir[0] = cos(yaw) * cos(pitch);
+        dir[1] = sin(yaw) * cos(pitch);
+        dir[2] = sin(pitch);
+
+        VectorMA(target, 128.0f, dir, rayStarts[i]);
+        VectorMA(target, -128.0f, dir, rayEnds[i]);
+    }
+
+    if(!Q_stricmp(mode, "save")){
+        golden.f = FS_FOpenFileWrite(fileName);
+        if(!golden.f){
+            Com_Printf("g2hitbench: couldn't write %s.\n", fileName);
+        }
+    }
+
+    Com_sprintf(line, sizeof(line), "g2hitbench %s %i %i\n", model->mFileName, numFrames, numRays);
+    G2_HitBenchLine(&golden, line);
+
+    //
+    // Time the phases by adding one at a time:
+    // evaluating all bones, then skinning all
+    // surfaces, then tracing the rays against the
+    // skinned mesh. The last pass is the usual
+    // collision check, with bones and surfaces
+    // done as the rays need them.
+    //
+    hits = numRecords = 0;
+    for(phase = 0; phase < 4; phase++){
+        start = Sys_Milliseconds();
+
+        for(frame = 0; frame < numFrames; frame++){
+            frameStarts = rayStarts + frame * numRays;
+            frameEnds = rayEnds + frame * numRays;
+
+            if(phase < 3){
+                G2_TransformSkeleton(model, frame * 50);
+                for(i = 0; i < model->mBoneCache->numBones; i++){
+                    G2_BoneEval(model->mBoneCache, i);
+                }
+
+                if(phase > 0){
+                    G2_TransformModel(model, scale, 0);
+                    G2_HitBenchSkin(model);
+                }
+                if(phase < 2){
+                    continue;
+                }
+            }
+
+            G2API_CollisionDetectMulti(recs, model, angles, origin, frame * 50, 0,
+                frameStarts, frameEnds, numRays, scale, G2_COLLIDE, 0);
+            if(phase < 3){
+                continue;
+            }
+
+            for(i = 0; i < numRays; i++){
+                rec = recs + i * MAX_G2_COLLISIONS;
+                if(rec->mEntityNum != -1){
+                    hits++;
+                }
+
+                for(j = 0; j < MAX_G2_COLLISIONS && rec[j].mEntityNum != -1; j++){
+                    Com_sprintf(line, sizeof(line), "%i %i %i %i %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %i %i %i\n",
+                        frame, i, rec[j].mSurfaceIndex, rec[j].mPolyIndex, rec[j].mDistance,
+                        rec[j].mCollisionPosition[0], rec[j].mCollisionPosition[1], rec[j].mCollisionPosition[2],
+                        rec[j].mCollisionNormal[0], rec[j].mCollisionNormal[1], rec[j].mCollisionNormal[2],
+                        rec[j].mBarycentricI, rec[j].mBarycentricJ,
+                        rec[j].mFlags, rec[j].mMaterial, rec[j].mLocation);
+                    G2_HitBenchLine(&golden, line);
+                    numRecords++;
+                }
+            }
+        }
+
+        msec[phase] = Sys_Milliseconds() - start;
+    }
+
+    Com_Printf("%s: %i frames of %i rays, %i hit, %i collision records\n",
+        model->mFileName, numFrames, numRays, hits, numRecords);
+    Com_Printf("  bones     %5i msec\n", msec[0]);
+    Com_Printf("  skinning  %5i msec\n", msec[1] - msec[0]);
+    Com_Printf("  poly test %5i msec\n", msec[2] - msec[1]);
+    Com_Printf("  collision %5i msec, %.0f rays/sec\n", msec[3], totalRays * 1000.0f / (msec[3] ? msec[3] : 1));
+
+    if(golden.f){
+        FS_FCloseFile(golden.f);
+        Com_Printf("Saved %i lines to %s.\n", golden.line, fileName);
+    }else if(golden.golden){
+        // Lines missing at the end differ as well.
+        if(*golden.pos && !golden.mismatches){
+            golden.firstMismatch = golden.line + 1;
+        }
+        if(*golden.pos){
+            golden.mismatches++;
+        }
+
+        if(golden.mismatches){
+            Com_Printf(S_COLOR_YELLOW "%s: %i lines differ, the first is line %i.\n", fileName, golden.mismatches, golden.firstMismatch);
+        }else{
+            Com_Printf("%s: all %i lines match.\n", fileName, golden.line);
+        }
+
+        FS_FreeFile(golden.golden);
+    }
+
+    // Don't leave the counters for com_showtrace.
+    Com_Memset(&g2CollisionStats, 0, sizeof(g2CollisionStats));
+
+    Z_Free(recs);
+    Z_Free(rayEnds);
+    Z_Free(rayStarts);
+    G2API_RemoveGhoul2Model(&model);
+}
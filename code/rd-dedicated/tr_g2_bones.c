@@ -218,7 +218,7 @@ int G2_AddBone(const model_t *modAnim, boneInfo_t **boneList, int *numBones, con
     // Do we need to allocate this slot?
     if(boneList[boneIndex] == NULL){
         // Allocate this slot.
-        boneList[boneIndex] = Z_TagMalloc(sizeof(boneInfo_t), TAG_GHOUL2);
+        boneList[boneIndex] = G2_Alloc(sizeof(boneInfo_t), "Ghoul II bone overrides");
         Com_Memset(boneList[boneIndex], 0, sizeof(boneInfo_t));
         (*numBones)++;
     }
@@ -279,6 +279,7 @@ qboolean G2_InitBoneCache(CGhoul2Model_t *model)
 {
     CBoneCache_t        *boneCache;
     int                 i;
+    int                 numBones, size;
     mdxaSkelOffsets_t   *offsets;
     mdxaSkel_t          *skel;
     CTransformBone_t    *transformBone;
@@ -290,19 +291,19 @@ qboolean G2_InitBoneCache(CGhoul2Model_t *model)
     }
 
     // The bone cache doesn't exist yet, allocate memory for it now.
-    boneCache = model->mBoneCache = Z_TagMalloc(sizeof(CBoneCache_t), TAG_GHOUL2);
-    Com_Memset(boneCache, 0, sizeof(CBoneCache_t));
+    // It is one block along with our internal bone lists.
+    numBones = model->aHeader->numBones;
+    size = sizeof(CBoneCache_t) + numBones * (sizeof(CBoneCalc_t) + sizeof(CTransformBone_t));
 
-    // Set the number of bones.
-    boneCache->numBones = model->aHeader->numBones;
+    boneCache = model->mBoneCache = G2_Alloc(size, model->animModel->name);
+    Com_Memset(boneCache, 0, size);
 
-    // Allocate memory for our internal bone lists.
-    boneCache->mBones = Z_TagMalloc(boneCache->numBones * sizeof(CBoneCalc_t), TAG_GHOUL2);
-    boneCache->mFinalBones = Z_TagMalloc(boneCache->numBones * sizeof(CTransformBone_t), TAG_GHOUL2);
+    // Set the number of bones.
+    boneCache->numBones = numBones;
 
-    // Clear the memory.
-    Com_Memset(boneCache->mBones, 0, boneCache->numBones * sizeof(CBoneCalc_t));
-    Com_Memset(boneCache->mFinalBones, 0, boneCache->numBones * sizeof(CTransformBone_t));
+    // Set up our internal bone lists.
+    boneCache->mBones = boneCache + 1;
+    boneCache->mFinalBones = (CBoneCalc_t *)boneCache->mBones + numBones;
 
     // Determine the skeleton offsets.
     offsets = (mdxaSkelOffsets_t *)((byte *)model->aHeader + sizeof(mdxaHeader_t));
@@ -379,13 +380,14 @@ static int G2_GetBonePoolIndex(const mdxaHeader_t *pMDXAHeader, int iFrame, int
 
 /*
 ==============
-G2_UncompressBone
+G2_DecompressBone
 
-Uncompresses bone for the given frame.
+Expands a compressed bone from the
+bone pool into a matrix.
 ==============
 */
 
-static void G2_UncompressBone(float mat[3][4], int iBoneIndex, const mdxaHeader_t *pMDXAHeader, int iFrame)
+static void G2_DecompressBone(float mat[3][4], const mdxaCompQuatBone_t *bone)
 {
     float                   w,x,y,z,f;
     float                   fTx;
@@ -400,13 +402,9 @@ static void G2_UncompressBone(float mat[3][4], int iBoneIndex, const mdxaHeader_
     float                   fTyy;
     float                   fTyz;
     float                   fTzz;
-    unsigned short          *pwIn;
-    unsigned char           *comp;
-    mdxaCompQuatBone_t      *pCompBonePool;
+    const unsigned short    *pwIn;
 
-    pCompBonePool   = (mdxaCompQuatBone_t *) ((byte *)pMDXAHeader + pMDXAHeader->ofsCompBonePool);
-    comp            = pCompBonePool[G2_GetBonePoolIndex(pMDXAHeader, iFrame, iBoneIndex)].Comp;
-    pwIn            = (unsigned short *)comp;
+    pwIn            = (const unsigned short *)bone->Comp;
 
     w           =   *pwIn++;
     w           /=  16383.0f;
@@ -466,6 +464,129 @@ static void G2_UncompressBone(float mat[3][4], int iBoneIndex, const mdxaHeader_
     mat[2][3]   =   f;
 }
 
+/*
+==============
+G2_UncompressBone
+
+Uncompresses bone for the given frame.
+==============
+*/
+
+static void G2_UncompressBone(float mat[3][4], int iBoneIndex, const model_t *modAnim, int iFrame)
+{
+    const mdxaHeader_t      *pMDXAHeader;
+    mdxaCompQuatBone_t      *pCompBonePool;
+    int                     poolIndex;
+
+    pMDXAHeader     = (mdxaHeader_t *)modAnim->modelData;
+    poolIndex       = G2_GetBonePoolIndex(pMDXAHeader, iFrame, iBoneIndex);
+
+    // Use the expanded pool if it was built at load time.
+    if(modAnim->bonePool){
+        Com_Memcpy(mat, modAnim->bonePool[poolIndex].matrix, sizeof(mdxaBone_t));
+        return;
+    }
+
+    pCompBonePool   = (mdxaCompQuatBone_t *)((byte *)pMDXAHeader + pMDXAHeader->ofsCompBonePool);
+    G2_DecompressBone(mat, &pCompBonePool[poolIndex]);
+}
+
+/*
+==============
+G2_BuildBonePool
+
+Expands the whole compressed bone pool of a
+Ghoul II animation file into matrices, so
+bones no longer have to be decompressed each
+time they're evaluated. Only done when
+r_g2BonePool is set, as the matrices take
+well over three times the memory.
+==============
+*/
+
+void G2_BuildBonePool(model_t *mod)
+{
+    mdxaHeader_t            *mdxa;
+    mdxaCompQuatBone_t      *pCompBonePool;
+    int                     numEntries;
+    int                     size;
+    int                     i;
+
+    mod->bonePool = NULL;
+    if(!r_g2BonePool->integer){
+        return;
+    }
+
+    mdxa            = (mdxaHeader_t *)mod->modelData;
+    numEntries      = (mdxa->ofsEnd - mdxa->ofsCompBonePool) / sizeof(mdxaCompQuatBone_t);
+    size            = numEntries * sizeof(mdxaBone_t);
+    if(numEntries <= 0){
+        return;
+    }
+
+    // Leave enough of the zone for the rest of the level.
+    if(size > Z_AvailableMemory() / 2){
+        Com_Printf(S_COLOR_YELLOW "G2_BuildBonePool: Not enough memory to expand the bone pool of \"%s\" (%i KB), raise com_zoneMegs.\n",
+            mod->name, size / 1024);
+        return;
+    }
+
+    pCompBonePool   = (mdxaCompQuatBone_t *)((byte *)mdxa + mdxa->ofsCompBonePool);
+    mod->bonePool   = Z_TagMalloc(size, TAG_RENDERER);
+
+    for(i = 0; i < numEntries; i++){
+        G2_DecompressBone(mod->bonePool[i].matrix, &pCompBonePool[i]);
+    }
+}
+
+/*
+==============
+G2_BonePoolInfo_f
+
+g2bonepool
+
+Lists the memory the bone pool of each
+loaded Ghoul II animation file takes,
+compressed and expanded.
+==============
+*/
+
+void G2_BonePoolInfo_f(void)
+{
+    const model_t           *mod;
+    const mdxaHeader_t      *mdxa;
+    int                     numEntries;
+    int                     compSize, expandedSize;
+    int                     totalComp, totalExpanded;
+    int                     i, numModels;
+
+    Com_Printf("frames bones   entries  comp KB expanded KB name\n");
+
+    numModels = 0;
+    totalComp = totalExpanded = 0;
+    for(i = 0; i < tr.numModels; i++){
+        mod = tr.models[i];
+        if(mod->type != MOD_MDXA){
+            continue;
+        }
+
+        mdxa            = (mdxaHeader_t *)mod->modelData;
+        numEntries      = (mdxa->ofsEnd - mdxa->ofsCompBonePool) / sizeof(mdxaCompQuatBone_t);
+        compSize        = numEntries * sizeof(mdxaCompQuatBone_t);
+        expandedSize    = mod->bonePool ? numEntries * sizeof(mdxaBone_t) : 0;
+
+        Com_Printf("%6i %5i %9i %8i %11i %s\n", mdxa->numFrames, mdxa->numBones,
+            numEntries, compSize / 1024, expandedSize / 1024, mod->name);
+
+        totalComp += compSize;
+        totalExpanded += expandedSize;
+        numModels++;
+    }
+
+    Com_Printf("%i animation file(s), %i KB compressed, %i KB extra for expanded pools.\n",
+        numModels, totalComp / 1024, totalExpanded / 1024);
+}
+
 /*
 ==============
 G2_TimingModel
@@ -680,6 +801,12 @@ static void G2_TransformBone(CBoneCache_t *mBoneCache, int boneIndex)
         // Should this animation be overridden by an animation in the bone list?
         if(boneFound->flags & (BONE_ANIM_OVERRIDE_LOOP | BONE_ANIM_OVERRIDE)){
             G2_TimingModel(boneFound, mBoneCache->incomingTime, mBoneCache->parent->aHeader->numFrames, &boneCalc->currentFrame, &boneCalc->newFrame, &boneCalc->backlerp);
+
+            // A finished animation is dropped from the bone, which
+            // changes the pose the next evaluation will give.
+            if(!(boneFound->flags & BONE_ANIM_TOTAL)){
+                mBoneCache->parent->mPoseVersion++;
+            }
         }
     }
 
@@ -696,7 +823,7 @@ static void G2_TransformBone(CBoneCache_t *mBoneCache, int boneIndex)
     //
     if(!boneCalc->backlerp)
     {
-        G2_UncompressBone(tbone[2].matrix, boneIndex, mBoneCache->parent->aHeader, boneCalc->currentFrame);
+        G2_UncompressBone(tbone[2].matrix, boneIndex, mBoneCache->parent->animModel, boneCalc->currentFrame);
 
         if(!boneIndex){
             // Now multiply by the root matrix, so we can offset this model should we need to.
@@ -705,8 +832,8 @@ static void G2_TransformBone(CBoneCache_t *mBoneCache, int boneIndex)
     }else{
         frontlerp = 1.0f - boneCalc->backlerp;
 
-        G2_UncompressBone(tbone[0].matrix, boneIndex, mBoneCache->parent->aHeader, boneCalc->newFrame);
-        G2_UncompressBone(tbone[1].matrix, boneIndex, mBoneCache->parent->aHeader, boneCalc->currentFrame);
+        G2_UncompressBone(tbone[0].matrix, boneIndex, mBoneCache->parent->animModel, boneCalc->newFrame);
+        G2_UncompressBone(tbone[1].matrix, boneIndex, mBoneCache->parent->animModel, boneCalc->currentFrame);
 
         for(j = 0; j < 12; j++){
             ((float *)&tbone[2])[j] = (boneCalc->backlerp * ((float *)&tbone[0])[j])
@@ -1052,15 +1179,31 @@ void G2_BoneGenerateMatrix(const model_t *modAnim, boneInfo_t **boneList, int bo
 G2_TransformSkeleton
 
 Sets the Ghoul II model skeleton
-to be re-rendered.
+to be re-rendered, unless it was
+already evaluated for the same
+frame and pose.
 ==============
 */
 
 void G2_TransformSkeleton(CGhoul2Model_t *model, const int frameNum)
 {
+    CBoneCache_t    *boneCache;
+
+    boneCache = model->mBoneCache;
+
+    // Bones evaluated for this frame and pose are still good,
+    // hitting the same model again in a frame can reuse them.
+    if(r_g2CollisionCache->integer && boneCache->mCurrentTouch
+        && boneCache->incomingTime == frameNum && boneCache->mPoseVersion == model->mPoseVersion)
+    {
+        g2CollisionStats.skeletonHits++;
+        return;
+    }
+
     // Make sure the the bone is re-rendered.
-    model->mBoneCache->mCurrentTouch++;
+    boneCache->mCurrentTouch++;
 
     // Set the incoming time based on the frame number.
-    model->mBoneCache->incomingTime = frameNum;
+    boneCache->incomingTime = frameNum;
+    boneCache->mPoseVersion = model->mPoseVersion;
 }
@@ -24,6 +24,32 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 
 #include "tr_g2_local.h"
 
+#if idx64
+#include <emmintrin.h>
+#endif
+
+// Both skinning paths add up a matrix row as (m0 x + m1 y) + (m2 z + m3),
+// weigh it and add it to the total, written out in that order. -ffast-math
+// would let the compiler regroup or fuse those sums, so the skinning code
+// asks it not to, and both paths give the same verts bit for bit. MSVC
+// keeps them as written unless built with /fp:fast.
+#if defined(__GNUC__) && !defined(__clang__)
+#define G2_SKIN_MATH    __attribute__((optimize("no-associative-math", "fp-contract=off")))
+#define G2_SKIN_ORDER
+#elif defined(__clang__) && __clang_major__ >= 12
+#define G2_SKIN_MATH
+#define G2_SKIN_ORDER   _Pragma("clang fp reassociate(off)") _Pragma("clang fp contract(off)")
+#else
+#define G2_SKIN_MATH
+#define G2_SKIN_ORDER
+#endif
+
+#define     G2_POLYTREE_MIN_POLYS       16          // Surfaces with fewer polys are tested one poly after the other.
+#define     G2_POLYTREE_LEAF_POLYS      4
+#define     G2_POLYTREE_MAX_DEPTH       32
+#define     G2_POLYTREE_EPSILON         0.125f      // Room left around the leaves for rounding errors.
+#define     MAX_POLYTREE_CANDIDATES     256         // More polys than this in the leaves a ray goes through are all tested.
+
 /*
 =============================================
 ----------------------------
@@ -47,8 +73,10 @@ static ID_INLINE int G2_GetVertBoneIndex(const mdxmVertex_t *pVert, const int iW
     return boneIndex;
 }
 
-static ID_INLINE float G2_GetVertBoneWeight(const mdxmVertex_t *pVert, const int iWeightNum, float *fTotalWeight, int iNumWeights)
+static ID_INLINE G2_SKIN_MATH float G2_GetVertBoneWeight(const mdxmVertex_t *pVert, const int iWeightNum, float *fTotalWeight, int iNumWeights)
 {
+    G2_SKIN_ORDER
+
     float   fBoneWeight;
     int     iTemp;
 
@@ -114,47 +142,88 @@ static int G2_DecideTraceLod(CGhoul2Model_t *model, int useLod)
 
 /*
 ==================
-G2_TransformEachSurface
+G2_SurfaceVertsSize
 
-Transforms all vertexes for the
-given surface.
+Number of floats the transformed verts
+of a surface need, followed by the boxes
+of its poly tree. The buffer is shared
+by all LODs, so it fits the largest.
 ==================
 */
 
-static void G2_TransformEachSurface(CGhoul2Model_t *model, const mdxmSurface_t *surface, vec3_t scale)
+static int G2_SurfaceVertsSize(CGhoul2Model_t *model, int surfaceIndex)
 {
+    mdxmSurface_t   *surface;
+    surfaceTree_t   *tree;
+    int             numSurfaces;
+    int             numVerts, numNodes;
+    int             lod;
+
+    numSurfaces = ((mdxmHeader_t *)model->currentModel->modelData)->numSurfaces;
+    numVerts = numNodes = 0;
+
+    for(lod = 0; lod < model->currentModel->numLods; lod++){
+        surface = G2_FindSurfaceFromModel(model->currentModel, surfaceIndex, lod);
+        if(surface && surface->numVerts > numVerts){
+            numVerts = surface->numVerts;
+        }
+
+        if(model->currentModel->surfaceTrees){
+            tree = &model->currentModel->surfaceTrees[lod * numSurfaces + surfaceIndex];
+            if(tree->numNodes > numNodes){
+                numNodes = tree->numNodes;
+            }
+        }
+    }
+
+    // Rounded up to whole skin groups.
+    return ((numVerts + 3) & ~3) * 4 + numNodes * 8;
+}
+
+/*
+==================
+G2_SkinRow
+
+Transforms the vertex coordinates
+by a row of a bone matrix.
+==================
+*/
+
+static ID_INLINE G2_SKIN_MATH float G2_SkinRow(const float *row, const float *xyz)
+{
+    G2_SKIN_ORDER
+
+    return (row[0] * xyz[0] + row[1] * xyz[1]) + (row[2] * xyz[2] + row[3]);
+}
+
+/*
+==================
+G2_SkinSurface
+
+Skins the vertexes one at a time.
+==================
+*/
+
+G2_SKIN_MATH void G2_SkinSurface(CGhoul2Model_t *model, const mdxmSurface_t *surface, float *transformedVerts, vec3_t scale)
+{
+    G2_SKIN_ORDER
+
     int                     numVerts;
     int                     i, j, pos;
     int                     *piBoneReferences;
-    float                   *transformedVerts;
     mdxaBone_t              *bone;
     mdxmVertex_t            *v;
-    mdxmVertexTexCoord_t    *pTexCoords;
     vec3_t                  tempVert;
     int                     iNumWeights, iBoneIndex;
     float                   fTotalWeight, fBoneWeight;
 
-    //
-    // Deform the vertexes by the lerped bones.
-    //
     piBoneReferences = (int *)((byte *)surface + surface->ofsBoneReferences);
     numVerts = surface->numVerts;
 
-    // Allocate some space for the transformed verts to get put in,
-    // if it isn't allocated yet.
-    transformedVerts = model->mTransformedVertsArray[surface->thisSurfaceIndex];
-    if(transformedVerts == NULL){
-        transformedVerts
-            = model->mTransformedVertsArray[surface->thisSurfaceIndex]
-            = Z_TagMalloc(numVerts * 5 * sizeof(float), TAG_GHOUL2);
-    }
-    Com_Memset(transformedVerts, 0, numVerts * 5 * sizeof(float));
-
     //
     // Whip through and actually transform each vertex.
     //
     v = (mdxmVertex_t *)((byte *)surface + surface->ofsVerts);
-    pTexCoords = (mdxmVertexTexCoord_t *)&v[numVerts];
 
     if((scale[0] != 1.0) || (scale[1] != 1.0) || (scale[2] != 1.0)){
         for(i = 0; i < numVerts; i++){
@@ -169,22 +238,17 @@ static void G2_TransformEachSurface(CGhoul2Model_t *model, const mdxmSurface_t *
                 // Get bone and evaluate if necessary.
                 bone = G2_BoneEval(model->mBoneCache, piBoneReferences[iBoneIndex]);
 
-                tempVert[0] += fBoneWeight * (DotProduct(bone->matrix[0], v->vertCoords) + bone->matrix[0][3]);
-                tempVert[1] += fBoneWeight * (DotProduct(bone->matrix[1], v->vertCoords) + bone->matrix[1][3]);
-                tempVert[2] += fBoneWeight * (DotProduct(bone->matrix[2], v->vertCoords) + bone->matrix[2][3]);
+                tempVert[0] += fBoneWeight * G2_SkinRow(bone->matrix[0], v->vertCoords);
+                tempVert[1] += fBoneWeight * G2_SkinRow(bone->matrix[1], v->vertCoords);
+                tempVert[2] += fBoneWeight * G2_SkinRow(bone->matrix[2], v->vertCoords);
             }
 
-            pos = i * 5;
+            pos = i * 4;
 
             // Copy transformed verts into allocated space.
             transformedVerts[pos++] = tempVert[0] * scale[0];
             transformedVerts[pos++] = tempVert[1] * scale[1];
-            transformedVerts[pos++] = tempVert[2] * scale[2];
-
-            // We will need the S & T coordinates too for hit location
-            // and hit material stuff.
-            transformedVerts[pos++] = pTexCoords[i].texCoords[0];
-            transformedVerts[pos]   = pTexCoords[i].texCoords[1];
+            transformedVerts[pos]   = tempVert[2] * scale[2];
 
             v++;
         }
@@ -204,65 +268,197 @@ static void G2_TransformEachSurface(CGhoul2Model_t *model, const mdxmSurface_t *
                 // Get bone and evaluate if necessary.
                 bone = G2_BoneEval(model->mBoneCache, piBoneReferences[iBoneIndex]);
 
-                tempVert[0] += fBoneWeight * (DotProduct(bone->matrix[0], v->vertCoords) + bone->matrix[0][3]);
-                tempVert[1] += fBoneWeight * (DotProduct(bone->matrix[1], v->vertCoords) + bone->matrix[1][3]);
-                tempVert[2] += fBoneWeight * (DotProduct(bone->matrix[2], v->vertCoords) + bone->matrix[2][3]);
+                tempVert[0] += fBoneWeight * G2_SkinRow(bone->matrix[0], v->vertCoords);
+                tempVert[1] += fBoneWeight * G2_SkinRow(bone->matrix[1], v->vertCoords);
+                tempVert[2] += fBoneWeight * G2_SkinRow(bone->matrix[2], v->vertCoords);
             }
 
             // Copy transformed verts into allocated space.
             transformedVerts[pos++] = tempVert[0];
             transformedVerts[pos++] = tempVert[1];
             transformedVerts[pos++] = tempVert[2];
-
-            // We will need the S & T coordinates too for hit location
-            // and hit material stuff.
-            transformedVerts[pos++] = pTexCoords[i].texCoords[0];
-            transformedVerts[pos++] = pTexCoords[i].texCoords[1];
+            pos++;
 
             v++;
         }
     }
 }
 
+#if idx64
 /*
 ==================
-G2_TransformSurfaces_r
+G2_SkinRowSIMD
 
-Recursively renders all surfaces
-in the Ghoul II model.
+Adds the weighted row of four bone
+matrices to the coordinates of four
+vertexes.
 ==================
 */
 
-static void G2_TransformSurfaces_r(CGhoul2Model_t *model, int surfaceIndex, int lod, vec3_t scale)
+static ID_INLINE G2_SKIN_MATH __m128 G2_SkinRowSIMD(mdxaBone_t **bones, const int *boneRefs, int row,
+                                       __m128 x, __m128 y, __m128 z, __m128 w, __m128 acc)
 {
-    mdxmSurface_t               *surface;
-    mdxmHierarchyOffsets_t      *surfIndexes;
-    mdxmSurfHierarchy_t         *surfInfo;
-    int                         i, offFlags;
+    G2_SKIN_ORDER
 
-    // Back track and get the surface info structures for this surface.
+    __m128  e0, e1, e2, e3;
 
-    // Get surface.
-    surface = G2_FindSurfaceFromModel(model->currentModel, surfaceIndex, lod);
+    // One register per matrix element.
+    e0 = _mm_loadu_ps(bones[boneRefs[0]]->matrix[row]);
+    e1 = _mm_loadu_ps(bones[boneRefs[1]]->matrix[row]);
+    e2 = _mm_loadu_ps(bones[boneRefs[2]]->matrix[row]);
+    e3 = _mm_loadu_ps(bones[boneRefs[3]]->matrix[row]);
+    _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
 
-    // Get surface index and hierarchy info.
-    surfIndexes = (mdxmHierarchyOffsets_t *)((byte *)model->currentModel->modelData + sizeof(mdxmHeader_t));
-    surfInfo = (mdxmSurfHierarchy_t *)((byte *)surfIndexes + surfIndexes->offsets[surface->thisSurfaceIndex]);
+    return _mm_add_ps(acc, _mm_mul_ps(w, _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(e0, x), _mm_mul_ps(e1, y)),
+        _mm_add_ps(_mm_mul_ps(e2, z), e3))));
+}
 
-    // Get the flags for this surface so we can determine
-    // whether it is on or off.
-    offFlags = surfInfo->flags;
+/*
+==================
+G2_SkinSurfaceSIMD
 
-    // If this surface is not off, add it to the shader render list.
-    if(!offFlags){
-        G2_TransformEachSurface(model, surface, scale);
+Skins four vertexes at a time, using the
+skin groups G2_BuildSkinGroups set up.
+
+Every vertex goes through the same sums
+in the same order as in G2_SkinSurface,
+the weights a vertex doesn't have are 0,
+so the results are identical.
+==================
+*/
+
+G2_SKIN_MATH void G2_SkinSurfaceSIMD(CGhoul2Model_t *model, const mdxmSurface_t *surface, const surfaceSkin_t *skin,
+                               float *transformedVerts, vec3_t scale)
+{
+    G2_SKIN_ORDER
+
+    mdxaBone_t          *bones[1 << iG2_BITS_PER_BONEREF];
+    const skinGroup_t   *group;
+    const int           *piBoneReferences;
+    __m128              x, y, z, w;
+    __m128              accX, accY, accZ, pad;
+    qboolean            scaled;
+    int                 numGroups;
+    int                 i, k;
+
+    // Evaluate every bone the vertexes use.
+    piBoneReferences = (int *)((byte *)surface + surface->ofsBoneReferences);
+    for(i = 0; i < (1 << iG2_BITS_PER_BONEREF); i++){
+        if(skin->usedBones & (1u << i)){
+            bones[i] = G2_BoneEval(model->mBoneCache, piBoneReferences[i]);
+        }
     }
 
-    // Now recursively call for all the children.
-    for(i = 0; i < surfInfo->numChildren; i++){
-        G2_TransformSurfaces_r(model, surfInfo->childIndexes[i], lod, scale);
+    scaled = (scale[0] != 1.0) || (scale[1] != 1.0) || (scale[2] != 1.0);
+
+    numGroups = (surface->numVerts + 3) >> 2;
+    for(i = 0, group = skin->groups; i < numGroups; i++, group++){
+        x = _mm_loadu_ps(group->xyz[0]);
+        y = _mm_loadu_ps(group->xyz[1]);
+        z = _mm_loadu_ps(group->xyz[2]);
+
+        accX = accY = accZ = pad = _mm_setzero_ps();
+
+        for(k = 0; k < skin->numWeights; k++){
+            w = _mm_loadu_ps(group->weights[k]);
+
+            accX = G2_SkinRowSIMD(bones, group->bones[k], 0, x, y, z, w, accX);
+            accY = G2_SkinRowSIMD(bones, group->bones[k], 1, x, y, z, w, accY);
+            accZ = G2_SkinRowSIMD(bones, group->bones[k], 2, x, y, z, w, accZ);
+        }
+
+        if(scaled){
+            accX = _mm_mul_ps(accX, _mm_set1_ps(scale[0]));
+            accY = _mm_mul_ps(accY, _mm_set1_ps(scale[1]));
+            accZ = _mm_mul_ps(accZ, _mm_set1_ps(scale[2]));
+        }
+
+        // Back to one vertex per register.
+        _MM_TRANSPOSE4_PS(accX, accY, accZ, pad);
+        _mm_storeu_ps(transformedVerts + i * 16 + 0, accX);
+        _mm_storeu_ps(transformedVerts + i * 16 + 4, accY);
+        _mm_storeu_ps(transformedVerts + i * 16 + 8, accZ);
+        _mm_storeu_ps(transformedVerts + i * 16 + 12, pad);
+    }
+}
+#endif // idx64
+
+/*
+==================
+G2_TransformEachSurface
+
+Transforms all vertexes for the
+given surface.
+
+The transformed verts are stored as
+x, y, z and a pad for every vertex,
+the texture coordinates are read from
+the model when needed.
+==================
+*/
+
+void G2_TransformEachSurface(CGhoul2Model_t *model, const mdxmSurface_t *surface, int lod, vec3_t scale)
+{
+    float                   *transformedVerts;
+#if idx64
+    const surfaceSkin_t     *skin;
+    int                     numSurfaces;
+#endif // idx64
+
+    transformedVerts = model->mTransformedVertsArray[surface->thisSurfaceIndex];
+
+#if idx64
+    if(r_g2SimdSkinning->integer && model->currentModel->surfaceSkins){
+        numSurfaces = ((mdxmHeader_t *)model->currentModel->modelData)->numSurfaces;
+        skin = &model->currentModel->surfaceSkins[lod * numSurfaces + surface->thisSurfaceIndex];
+
+        if(skin->groups){
+            G2_SkinSurfaceSIMD(model, surface, skin, transformedVerts, scale);
+            return;
+        }
+    }
+#endif // idx64
+
+    G2_SkinSurface(model, surface, transformedVerts, scale);
+}
+
+/*
+==============
+G2_AllocTransformedVerts
+
+Gives the model a single block for the
+transformed verts of all its surfaces,
+along with the pointers to them and their
+stamps.
+==============
+*/
+
+static void G2_AllocTransformedVerts(CGhoul2Model_t *model)
+{
+    float           *transformedVerts;
+    int             numSurfaces;
+    int             headerSize, size;
+    int             i;
+
+    numSurfaces = model->numTransformedVerts;
+    headerSize = PAD(numSurfaces * (sizeof(void *) + 2 * sizeof(int)), 16);
+
+    size = headerSize;
+    for(i = 0; i < numSurfaces; i++){
+        size += G2_SurfaceVertsSize(model, i) * sizeof(float);
     }
 
+    model->mTransformedVertsArray = G2_Alloc(size, model->currentModel->name);
+    model->mSurfaceVertsStamp = (int *)(model->mTransformedVertsArray + numSurfaces);
+    model->mSurfaceTreeStamp = model->mSurfaceVertsStamp + numSurfaces;
+    Com_Memset(model->mSurfaceVertsStamp, 0, 2 * numSurfaces * sizeof(int));
+
+    transformedVerts = (float *)((byte *)model->mTransformedVertsArray + headerSize);
+    for(i = 0; i < numSurfaces; i++){
+        model->mTransformedVertsArray[i] = transformedVerts;
+        transformedVerts += G2_SurfaceVertsSize(model, i);
+    }
 }
 
 /*
@@ -272,6 +468,9 @@ G2_TransformModel
 Main calling point for the model transform
 for collision detection. At this point all
 of the skeleton has been transformed.
+
+Surfaces are only skinned once a ray comes
+near them, in G2_TraceSurfaces_r.
 ==============
 */
 
@@ -291,22 +490,606 @@ void G2_TransformModel(CGhoul2Model_t *model, vec3_t scale, int useLod)
         }
     }
 
-    //
-    // Try rendering out this Ghoul II model.
-    //
-
     // Decide the LOD.
     lod = G2_DecideTraceLod(model, useLod);
 
     // Give us space for the transformed vertex array to be put in.
-    // If it is not allocated already that is.
-    if(model->mTransformedVertsArray == NULL){
-        model->mTransformedVertsArray = Z_TagMalloc(model->numTransformedVerts * sizeof(void *), TAG_GHOUL2);
-        Com_Memset(model->mTransformedVertsArray, 0, model->numTransformedVerts * sizeof(void *));
+    // If it is not allocated already for this mesh that is.
+    if(model->mTransformedVertsArray == NULL || model->mVertsModel != model->currentModel){
+        if(model->mTransformedVertsArray){
+            G2_Free(model->mTransformedVertsArray);
+        }
+
+        G2_AllocTransformedVerts(model);
+        model->mVertsModel = NULL;
+    }
+
+    // The verts are still skinned for these bones,
+    // this LOD and scale, no need to do it again.
+    if(r_g2CollisionCache->integer && model->mVertsModel == model->currentModel
+        && model->mVertsTouch == model->mBoneCache->mCurrentTouch
+        && model->mVertsLod == lod && VectorCompare(model->mVertsScale, correctScale))
+    {
+        g2CollisionStats.meshHits++;
+        return;
+    }
+
+    // Every surface that gets traced has to be skinned again.
+    model->mVertsStamp++;
+
+    model->mVertsModel = model->currentModel;
+    model->mVertsTouch = model->mBoneCache->mCurrentTouch;
+    model->mVertsLod = lod;
+    VectorCopy(correctScale, model->mVertsScale);
+}
+
+/*
+=============================================
+-------------------------
+Surface bounds functions.
+-------------------------
+=============================================
+*/
+
+/*
+==============
+G2_BuildSurfaceBounds
+
+For every surface and every bone it
+references, works out a sphere around
+the vertexes weighted to that bone.
+
+A skinned vertex is a weighted average
+of its bones applied to it, so it can't
+end up outside the spheres once these
+are moved by their bones.
+==============
+*/
+
+void G2_BuildSurfaceBounds(model_t *mod)
+{
+    mdxmHeader_t        *mdxm;
+    mdxmLOD_t           *lod;
+    mdxmSurface_t       *surf;
+    mdxmVertex_t        *v;
+    boneSphere_t        *sphere;
+    vec3_t              mins[1 << iG2_BITS_PER_BONEREF];
+    vec3_t              maxs[1 << iG2_BITS_PER_BONEREF];
+    qboolean            used[1 << iG2_BITS_PER_BONEREF];
+    qboolean            bounded;
+    int                 numSpheres, numRefs;
+    int                 iNumWeights, iBoneIndex;
+    float               fTotalWeight, dist;
+    int                 i, j, k, l;
+
+    mdxm = mod->modelData;
+
+    //
+    // Count the bone references of all surfaces.
+    //
+    numSpheres = 0;
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++){
+            numSpheres += surf->numBoneReferences;
+            surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd);
+        }
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+
+    mod->boneSpheres = Z_TagMalloc((numSpheres + 1) * sizeof(boneSphere_t), TAG_RENDERER);
+    mod->boneSphereOffsets = Z_TagMalloc(mdxm->numLODs * mdxm->numSurfaces * sizeof(int), TAG_RENDERER);
+    for(i = 0; i < mdxm->numLODs * mdxm->numSurfaces; i++){
+        mod->boneSphereOffsets[i] = -1;
+    }
+
+    //
+    // Bound the vertexes of every bone reference.
+    //
+    sphere = mod->boneSpheres;
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++, surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd)){
+            if(surf->thisSurfaceIndex < 0 || surf->thisSurfaceIndex >= mdxm->numSurfaces){
+                continue;
+            }
+
+            // Only the first bone references can be used by a vertex.
+            numRefs = surf->numBoneReferences;
+            if(numRefs > (1 << iG2_BITS_PER_BONEREF)){
+                numRefs = 1 << iG2_BITS_PER_BONEREF;
+            }
+
+            for(k = 0; k < numRefs; k++){
+                ClearBounds(mins[k], maxs[k]);
+                used[k] = qfalse;
+            }
+
+            bounded = qtrue;
+            v = (mdxmVertex_t *)((byte *)surf + surf->ofsVerts);
+            for(j = 0; j < surf->numVerts && bounded; j++, v++){
+                iNumWeights = G2_GetVertWeights(v);
+                fTotalWeight = 0.0f;
+
+                for(k = 0; k < iNumWeights; k++){
+                    iBoneIndex = G2_GetVertBoneIndex(v, k);
+                    if(iBoneIndex >= numRefs){
+                        bounded = qfalse;
+                        break;
+                    }
+
+                    G2_GetVertBoneWeight(v, k, &fTotalWeight, iNumWeights);
+                    AddPointToBounds(v->vertCoords, mins[iBoneIndex], maxs[iBoneIndex]);
+                    used[iBoneIndex] = qtrue;
+                }
+
+                // The last weight makes up the rest, if the others
+                // add up to more than 1 it isn't an average anymore.
+                if(fTotalWeight > 1.0f){
+                    bounded = qfalse;
+                }
+            }
+
+            if(!bounded){
+                continue;
+            }
+
+            for(k = 0; k < numRefs; k++){
+                if(used[k]){
+                    VectorAdd(mins[k], maxs[k], sphere[k].center);
+                    VectorScale(sphere[k].center, 0.5f, sphere[k].center);
+                }
+                sphere[k].radius = used[k] ? 0.0f : -1.0f;
+            }
+
+            v = (mdxmVertex_t *)((byte *)surf + surf->ofsVerts);
+            for(j = 0; j < surf->numVerts; j++, v++){
+                iNumWeights = G2_GetVertWeights(v);
+                for(k = 0; k < iNumWeights; k++){
+                    iBoneIndex = G2_GetVertBoneIndex(v, k);
+                    dist = Distance(v->vertCoords, sphere[iBoneIndex].center);
+                    if(dist > sphere[iBoneIndex].radius){
+                        sphere[iBoneIndex].radius = dist;
+                    }
+                }
+            }
+
+            for(k = numRefs; k < surf->numBoneReferences; k++){
+                sphere[k].radius = -1.0f;
+            }
+
+            mod->boneSphereOffsets[l * mdxm->numSurfaces + surf->thisSurfaceIndex] = sphere - mod->boneSpheres;
+            sphere += surf->numBoneReferences;
+        }
+
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+}
+
+/*
+==============
+G2_BuildSkinGroups
+
+Rearranges the vertexes of every surface
+in groups of four for G2_SkinSurfaceSIMD,
+each one holding the coordinates, weights
+and bone references as one row for every
+vertex.
+==============
+*/
+
+void G2_BuildSkinGroups(model_t *mod)
+{
+#if idx64
+    mdxmHeader_t        *mdxm;
+    mdxmLOD_t           *lod;
+    mdxmSurface_t       *surf;
+    mdxmVertex_t        *v;
+    surfaceSkin_t       *skin;
+    skinGroup_t         *groups, *group;
+    int                 numGroups, lane, firstBone;
+    int                 iNumWeights, iBoneIndex;
+    float               fTotalWeight;
+    int                 i, j, k, l;
+
+    mdxm = mod->modelData;
+
+    //
+    // Count the groups of all surfaces.
+    //
+    numGroups = 0;
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++){
+            numGroups += (surf->numVerts + 3) >> 2;
+            surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd);
+        }
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+
+    groups = Z_TagMalloc((numGroups + 1) * sizeof(skinGroup_t), TAG_RENDERER);
+    mod->surfaceSkins = Z_TagMalloc(mdxm->numLODs * mdxm->numSurfaces * sizeof(surfaceSkin_t), TAG_RENDERER);
+    Com_Memset(mod->surfaceSkins, 0, mdxm->numLODs * mdxm->numSurfaces * sizeof(surfaceSkin_t));
+
+    //
+    // Fill them in.
+    //
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++, surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd)){
+            if(surf->thisSurfaceIndex < 0 || surf->thisSurfaceIndex >= mdxm->numSurfaces){
+                continue;
+            }
+
+            skin = &mod->surfaceSkins[l * mdxm->numSurfaces + surf->thisSurfaceIndex];
+            firstBone = -1;
+            Com_Memset(groups, 0, ((surf->numVerts + 3) >> 2) * sizeof(skinGroup_t));
+
+            v = (mdxmVertex_t *)((byte *)surf + surf->ofsVerts);
+            for(j = 0; j < surf->numVerts; j++, v++){
+                group = &groups[j >> 2];
+                lane = j & 3;
+
+                group->xyz[0][lane] = v->vertCoords[0];
+                group->xyz[1][lane] = v->vertCoords[1];
+                group->xyz[2][lane] = v->vertCoords[2];
+
+                iNumWeights = G2_GetVertWeights(v);
+                fTotalWeight = 0.0f;
+
+                for(k = 0; k < iNumWeights; k++){
+                    iBoneIndex = G2_GetVertBoneIndex(v, k);
+                    if(iBoneIndex >= surf->numBoneReferences){
+                        break;
+                    }
+
+                    group->bones[k][lane] = iBoneIndex;
+                    group->weights[k][lane] = G2_GetVertBoneWeight(v, k, &fTotalWeight, iNumWeights);
+                    skin->usedBones |= 1u << iBoneIndex;
+                }
+
+                // Leave this surface to G2_SkinSurface.
+                if(k < iNumWeights){
+                    break;
+                }
+
+                // The weights this vertex doesn't have
+                // add nothing with the first bone.
+                for(; k < iMAX_G2_BONEWEIGHTS_PER_VERT; k++){
+                    group->bones[k][lane] = group->bones[0][lane];
+                }
+
+                if(iNumWeights > skin->numWeights){
+                    skin->numWeights = iNumWeights;
+                }
+                if(firstBone == -1){
+                    firstBone = group->bones[0][lane];
+                }
+            }
+
+            if(j < surf->numVerts || firstBone == -1){
+                skin->usedBones = 0;
+                skin->numWeights = 0;
+                continue;
+            }
+
+            // Same for the padding of the last group.
+            for(j = surf->numVerts; j & 3; j++){
+                for(k = 0; k < iMAX_G2_BONEWEIGHTS_PER_VERT; k++){
+                    groups[j >> 2].bones[k][j & 3] = firstBone;
+                }
+            }
+
+            skin->groups = groups;
+            groups += (surf->numVerts + 3) >> 2;
+        }
+
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+#endif // idx64
+}
+
+/*
+==============
+G2_BuildPolyNode
+
+Adds a node for the given polys to the tree,
+splitting them at the middle of their centers
+along the longest side until few enough are
+left for a leaf. Returns the index of the node.
+==============
+*/
+
+static int G2_BuildPolyNode(surfaceTree_t *tree, int *polys, int numPolys, vec3_t *centers, int depth)
+{
+    polyNode_t  *node;
+    vec3_t      mins, maxs;
+    float       mid;
+    int         nodeNum, axis;
+    int         i, numLeft, temp;
+
+    nodeNum = tree->numNodes++;
+    node = &tree->nodes[nodeNum];
+
+    ClearBounds(mins, maxs);
+    for(i = 0; i < numPolys; i++){
+        AddPointToBounds(centers[polys[i]], mins, maxs);
+    }
+
+    axis = 0;
+    for(i = 1; i < 3; i++){
+        if(maxs[i] - mins[i] > maxs[axis] - mins[axis]){
+            axis = i;
+        }
+    }
+
+    if(numPolys <= G2_POLYTREE_LEAF_POLYS || depth == G2_POLYTREE_MAX_DEPTH || maxs[axis] == mins[axis]){
+        node->child = polys - tree->polys;
+        node->numPolys = numPolys;
+        return nodeNum;
+    }
+
+    mid = (mins[axis] + maxs[axis]) * 0.5f;
+    numLeft = 0;
+    for(i = 0; i < numPolys; i++){
+        if(centers[polys[i]][axis] < mid){
+            temp = polys[i];
+            polys[i] = polys[numLeft];
+            polys[numLeft++] = temp;
+        }
+    }
+
+    // Just halve them if they all fall on one side.
+    if(numLeft == 0 || numLeft == numPolys){
+        numLeft = numPolys / 2;
+    }
+
+    node->numPolys = 0;
+    G2_BuildPolyNode(tree, polys, numLeft, centers, depth + 1);
+    tree->nodes[nodeNum].child = G2_BuildPolyNode(tree, polys + numLeft, numPolys - numLeft, centers, depth + 1);
+
+    return nodeNum;
+}
+
+/*
+==============
+G2_BuildPolyTrees
+
+Sorts the polys of every surface with enough
+of them into a tree of boxes, using the
+vertexes as they are in the mesh file. Only
+the layout of the tree is kept, the boxes are
+refit to the skinned vertexes of each model
+by G2_RefitPolyTree.
+==============
+*/
+
+void G2_BuildPolyTrees(model_t *mod)
+{
+    mdxmHeader_t        *mdxm;
+    mdxmLOD_t           *lod;
+    mdxmSurface_t       *surf;
+    mdxmVertex_t        *verts;
+    mdxmTriangle_t      *tris;
+    surfaceTree_t       *tree;
+    polyNode_t          *nodes;
+    int                 *polys;
+    vec3_t              *centers;
+    int                 numPolys, maxPolys;
+    int                 i, j, k, l;
+
+    mdxm = mod->modelData;
+
+    //
+    // Count the polys of all surfaces that get a tree.
+    //
+    numPolys = maxPolys = 0;
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++){
+            if(surf->numTriangles >= G2_POLYTREE_MIN_POLYS){
+                numPolys += surf->numTriangles;
+                if(surf->numTriangles > maxPolys){
+                    maxPolys = surf->numTriangles;
+                }
+            }
+            surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd);
+        }
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+
+    mod->surfaceTrees = Z_TagMalloc(mdxm->numLODs * mdxm->numSurfaces * sizeof(surfaceTree_t), TAG_RENDERER);
+    Com_Memset(mod->surfaceTrees, 0, mdxm->numLODs * mdxm->numSurfaces * sizeof(surfaceTree_t));
+
+    if(!numPolys){
+        return;
+    }
+
+    // A tree never has more than twice
+    // the nodes as it has polys.
+    nodes = Z_TagMalloc(numPolys * 2 * sizeof(polyNode_t), TAG_RENDERER);
+    polys = Z_TagMalloc(numPolys * sizeof(int), TAG_RENDERER);
+    centers = Z_Malloc(maxPolys * sizeof(vec3_t));
+
+    //
+    // Build them.
+    //
+    lod = (mdxmLOD_t *)((byte *)mdxm + mdxm->ofsLODs);
+    for(l = 0; l < mdxm->numLODs; l++){
+        surf = (mdxmSurface_t *)((byte *)lod + sizeof(mdxmLOD_t) + (mdxm->numSurfaces * sizeof(mdxmLODSurfOffset_t)));
+        for(i = 0; i < mdxm->numSurfaces; i++, surf = (mdxmSurface_t *)((byte *)surf + surf->ofsEnd)){
+            if(surf->numTriangles < G2_POLYTREE_MIN_POLYS){
+                continue;
+            }
+            if(surf->thisSurfaceIndex < 0 || surf->thisSurfaceIndex >= mdxm->numSurfaces){
+                continue;
+            }
+
+            verts = (mdxmVertex_t *)((byte *)surf + surf->ofsVerts);
+            tris = (mdxmTriangle_t *)((byte *)surf + surf->ofsTriangles);
+
+            for(j = 0; j < surf->numTriangles; j++){
+                VectorClear(centers[j]);
+                for(k = 0; k < 3; k++){
+                    if(tris[j].indexes[k] < 0 || tris[j].indexes[k] >= surf->numVerts){
+                        break;
+                    }
+                    VectorAdd(centers[j], verts[tris[j].indexes[k]].vertCoords, centers[j]);
+                }
+                if(k < 3){
+                    break;
+                }
+
+                polys[j] = j;
+            }
+
+            // Leave surfaces with bad polys to the plain loop.
+            if(j < surf->numTriangles){
+                continue;
+            }
+
+            tree = &mod->surfaceTrees[l * mdxm->numSurfaces + surf->thisSurfaceIndex];
+            tree->nodes = nodes;
+            tree->polys = polys;
+            G2_BuildPolyNode(tree, polys, surf->numTriangles, centers, 0);
+
+            nodes += tree->numNodes;
+            polys += surf->numTriangles;
+        }
+
+        lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
+    }
+
+    Z_Free(centers);
+}
+
+/*
+==============
+G2_SurfaceBounds
+
+Bounds of the skinned surface in model
+space. Returns qfalse if the surface has
+no usable bounds.
+==============
+*/
+
+static qboolean G2_SurfaceBounds(CGhoul2Model_t *model, const mdxmSurface_t *surface, int lod, vec3_t mins, vec3_t maxs)
+{
+    const mdxmHeader_t  *mdxm;
+    const boneSphere_t  *sphere;
+    const int           *piBoneReferences;
+    mdxaBone_t          *bone;
+    vec3_t              center;
+    float               radius, temp;
+    int                 offset, i, j;
+
+    mdxm = model->currentModel->modelData;
+    offset = model->currentModel->boneSphereOffsets[lod * mdxm->numSurfaces + surface->thisSurfaceIndex];
+    if(offset < 0){
+        return qfalse;
+    }
+
+    sphere = model->currentModel->boneSpheres + offset;
+    piBoneReferences = (int *)((byte *)surface + surface->ofsBoneReferences);
+
+    ClearBounds(mins, maxs);
+    for(i = 0; i < surface->numBoneReferences; i++, sphere++){
+        if(sphere->radius < 0.0f){
+            continue;
+        }
+
+        bone = G2_BoneEval(model->mBoneCache, piBoneReferences[i]);
+
+        // The bone can stretch the sphere by no more than the
+        // Frobenius norm of its rotation part.
+        radius = 0.0f;
+        for(j = 0; j < 3; j++){
+            center[j] = DotProduct(bone->matrix[j], sphere->center) + bone->matrix[j][3];
+            radius += DotProduct(bone->matrix[j], bone->matrix[j]);
+        }
+        radius = sphere->radius * sqrt(radius);
+
+        for(j = 0; j < 3; j++){
+            if(center[j] - radius < mins[j]){
+                mins[j] = center[j] - radius;
+            }
+            if(center[j] + radius > maxs[j]){
+                maxs[j] = center[j] + radius;
+            }
+        }
+    }
+
+    // Scale them like the verts, and leave
+    // some room for rounding errors.
+    for(j = 0; j < 3; j++){
+        mins[j] *= model->mVertsScale[j];
+        maxs[j] *= model->mVertsScale[j];
+        if(mins[j] > maxs[j]){
+            temp = mins[j];
+            mins[j] = maxs[j];
+            maxs[j] = temp;
+        }
+
+        mins[j] -= 1.0f;
+        maxs[j] += 1.0f;
+    }
+
+    return qtrue;
+}
+
+/*
+==============
+G2_SegmentHitsBounds
+
+Returns qfalse if the segment from
+start to end misses the box.
+==============
+*/
+
+static qboolean G2_SegmentHitsBounds(const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs)
+{
+    float   enter, leave;
+    float   t1, t2, temp, dir;
+    int     i;
+
+    enter = 0.0f;
+    leave = 1.0f;
+
+    for(i = 0; i < 3; i++){
+        dir = end[i] - start[i];
+
+        if(dir == 0.0f){
+            if(start[i] < mins[i] || start[i] > maxs[i]){
+                return qfalse;
+            }
+            continue;
+        }
+
+        t1 = (mins[i] - start[i]) / dir;
+        t2 = (maxs[i] - start[i]) / dir;
+        if(t1 > t2){
+            temp = t1;
+            t1 = t2;
+            t2 = temp;
+        }
+
+        if(t1 > enter){
+            enter = t1;
+        }
+        if(t2 < leave){
+            leave = t2;
+        }
+        if(enter > leave){
+            return qfalse;
+        }
     }
 
-    // Recursively transform the model surfaces.
-    G2_TransformSurfaces_r(model, 0, lod, correctScale);
+    return qtrue;
 }
 
 /*
@@ -322,15 +1105,14 @@ static void G2_InitTraceSurf(CTraceSurface_t *TS, CGhoul2Model_t *model, int lod
                              int entNum, skin_t *skin, int traceFlags)
 {
     // Save info off our Ghoul II model.
+    TS->model = model;
     TS->currentModel = model->currentModel;
-    TS->transformedVertsArray = model->mTransformedVertsArray;
 
     // Copy the rays.
     VectorCopy(rayStart, TS->rayStart);
     VectorCopy(rayEnd, TS->rayEnd);
 
     // Set remaining variables.
-    TS->surfaceNum = 0;
     TS->lod = lod;
     TS->worldMatrix = worldMatrix;
     TS->collRecMap = collRecMap;
@@ -469,38 +1251,218 @@ static void G2_BuildHitPointST(const vec3_t A, const float SA, const float TA,
     }
 }
 
+/*
+==============
+G2_RefitPolyTree
+
+Fits the boxes of the poly tree of a
+surface around its skinned vertexes.
+==============
+*/
+
+static void G2_RefitPolyTree(const surfaceTree_t *tree, const mdxmSurface_t *surface, const float *verts, float *boxes)
+{
+    const mdxmTriangle_t    *tris;
+    const polyNode_t        *node;
+    const float             *vert, *first, *second;
+    float                   *box;
+    vec3_t                  mins, maxs;
+    int                     i, j, k;
+
+    tris = (mdxmTriangle_t *)((byte *)surface + surface->ofsTriangles);
+
+    // Children come after their parents,
+    // so go through the nodes backwards.
+    for(i = tree->numNodes - 1; i >= 0; i--){
+        node = &tree->nodes[i];
+        box = boxes + i * 8;
+
+        if(!node->numPolys){
+            first = boxes + (i + 1) * 8;
+            second = boxes + node->child * 8;
+
+            for(j = 0; j < 3; j++){
+                box[j] = first[j] < second[j] ? first[j] : second[j];
+                box[j + 4] = first[j + 4] > second[j + 4] ? first[j + 4] : second[j + 4];
+            }
+            continue;
+        }
+
+        vert = verts + tris[tree->polys[node->child]].indexes[0] * 4;
+        VectorCopy(vert, mins);
+        VectorCopy(vert, maxs);
+
+        for(j = 0; j < node->numPolys; j++){
+            for(k = 0; k < 3; k++){
+                vert = verts + tris[tree->polys[node->child + j]].indexes[k] * 4;
+                mins[0] = vert[0] < mins[0] ? vert[0] : mins[0];
+                mins[1] = vert[1] < mins[1] ? vert[1] : mins[1];
+                mins[2] = vert[2] < mins[2] ? vert[2] : mins[2];
+                maxs[0] = vert[0] > maxs[0] ? vert[0] : maxs[0];
+                maxs[1] = vert[1] > maxs[1] ? vert[1] : maxs[1];
+                maxs[2] = vert[2] > maxs[2] ? vert[2] : maxs[2];
+            }
+        }
+
+        // Leave some room for rounding errors.
+        for(j = 0; j < 3; j++){
+            box[j] = mins[j] - G2_POLYTREE_EPSILON;
+            box[j + 4] = maxs[j] + G2_POLYTREE_EPSILON;
+        }
+    }
+}
+
+/*
+==============
+G2_PolyTreeCandidates
+
+Gathers the polys in all leaves of the tree
+the ray goes through, sorted by index so they
+are tested in the same order as without the
+tree. Returns -1 if there are more than
+maxPolys of them.
+==============
+*/
+
+static int G2_PolyTreeCandidates(const surfaceTree_t *tree, const float *boxes, const vec3_t start, const vec3_t end,
+                                 int *polys, int maxPolys)
+{
+    const polyNode_t    *node;
+    const float         *box;
+    vec3_t              invDir;
+    qboolean            flat[3];
+    float               enter, leave, t1, t2, temp;
+    int                 stack[G2_POLYTREE_MAX_DEPTH + 1];
+    int                 numStack, nodeNum, numPolys;
+    int                 i, j, poly;
+
+    for(i = 0; i < 3; i++){
+        flat[i] = end[i] == start[i];
+        invDir[i] = flat[i] ? 0.0f : 1.0f / (end[i] - start[i]);
+    }
+
+    numPolys = 0;
+    numStack = 0;
+    stack[numStack++] = 0;
+
+    while(numStack){
+        nodeNum = stack[--numStack];
+        node = &tree->nodes[nodeNum];
+        box = boxes + nodeNum * 8;
+
+        // Does the ray go through the box?
+        enter = 0.0f;
+        leave = 1.0f;
+        for(i = 0; i < 3; i++){
+            if(flat[i]){
+                if(start[i] < box[i] || start[i] > box[i + 4]){
+                    break;
+                }
+                continue;
+            }
+
+            t1 = (box[i] - start[i]) * invDir[i];
+            t2 = (box[i + 4] - start[i]) * invDir[i];
+            if(t1 > t2){
+                temp = t1;
+                t1 = t2;
+                t2 = temp;
+            }
+
+            if(t1 > enter){
+                enter = t1;
+            }
+            if(t2 < leave){
+                leave = t2;
+            }
+            if(enter > leave){
+                break;
+            }
+        }
+
+        if(i < 3){
+            continue;
+        }
+
+        if(!node->numPolys){
+            stack[numStack++] = node->child;
+            stack[numStack++] = nodeNum + 1;
+            continue;
+        }
+
+        if(numPolys + node->numPolys > maxPolys){
+            return -1;
+        }
+
+        // Insert the polys in order.
+        for(i = 0; i < node->numPolys; i++){
+            poly = tree->polys[node->child + i];
+            for(j = numPolys; j > 0 && polys[j - 1] > poly; j--){
+                polys[j] = polys[j - 1];
+            }
+            polys[j] = poly;
+            numPolys++;
+        }
+    }
+
+    return numPolys;
+}
+
 /*
 ==============
 G2_TracePolys
 
 Trace through the polys of a surface
-to see what we've hit.
+to see what we've hit. With a poly tree,
+only the polys in the leaves the ray goes
+through are tested.
 ==============
 */
 
-static qboolean G2_TracePolys(mdxmSurface_t *surface, mdxmSurfHierarchy_t *surfInfo, CTraceSurface_t *TS)
+static qboolean G2_TracePolys(mdxmSurface_t *surface, mdxmSurfHierarchy_t *surfInfo, CTraceSurface_t *TS, const surfaceTree_t *tree)
 {
     mdxmTriangle_t      *tris;
-    int                 i, j, x, numTris;
+    mdxmVertexTexCoord_t *texCoords;
+    int                 candidates[MAX_POLYTREE_CANDIDATES];
+    int                 i, j, x, c, numTris;
     float               face, xPos, yPos;
     float               *verts;
     float               *pointA, *pointB, *pointC;
+    float               *stA, *stB, *stC;
     vec3_t              hitPoint, normal, distVect;
     CollisionRecord_t   *newCol;
     shader_t            *shader;
     hitRegData_t        *hitRegData;
 
     tris    = (mdxmTriangle_t *)((byte *)surface + surface->ofsTriangles);
-    verts   = TS->transformedVertsArray[surface->thisSurfaceIndex];
+    verts   = TS->model->mTransformedVertsArray[surface->thisSurfaceIndex];
     numTris = surface->numTriangles;
 
+    // The texture coordinates follow the vertexes.
+    texCoords = (mdxmVertexTexCoord_t *)((byte *)surface + surface->ofsVerts + surface->numVerts * sizeof(mdxmVertex_t));
+
+    // Only go through the polys near the ray, if the
+    // surface has a tree and not too many of them are.
+    if(tree){
+        numTris = G2_PolyTreeCandidates(tree, verts + ((surface->numVerts + 3) & ~3) * 4, TS->rayStart, TS->rayEnd,
+            candidates, MAX_POLYTREE_CANDIDATES);
+        if(numTris < 0){
+            numTris = surface->numTriangles;
+            tree = NULL;
+        }
+    }
+
+    g2CollisionStats.polysTested += numTris;
+
     // Iterate through the tris and
     // transform each vertex.
-    for(i = 0; i < numTris; i++){
+    for(c = 0; c < numTris; c++){
+        i = tree ? candidates[c] : c;
+
         // Determine the actual coordinates for this triangle.
-        pointA = &verts[(tris[i].indexes[0] * 5)];
-        pointB = &verts[(tris[i].indexes[1] * 5)];
-        pointC = &verts[(tris[i].indexes[2] * 5)];
+        pointA = &verts[(tris[i].indexes[0] * 4)];
+        pointB = &verts[(tris[i].indexes[1] * 4)];
+        pointC = &verts[(tris[i].indexes[2] * 4)];
 
         // Did we hit it?
         if(G2_SegmentTriangleTest(TS->rayStart, TS->rayEnd, pointA, pointB, pointC, hitPoint, normal, &face)){
@@ -539,9 +1501,12 @@ static qboolean G2_TracePolys(mdxmSurface_t *surface, mdxmSurfHierarchy_t *surfI
 
                 // Determine our location within the texture
                 // and the barycentric coordinates.
-                G2_BuildHitPointST(pointA, pointA[3], pointA[4],
-                                   pointB, pointB[3], pointB[4],
-                                   pointC, pointC[3], pointC[4],
+                stA = texCoords[tris[i].indexes[0]].texCoords;
+                stB = texCoords[tris[i].indexes[1]].texCoords;
+                stC = texCoords[tris[i].indexes[2]].texCoords;
+                G2_BuildHitPointST(pointA, stA[0], stA[1],
+                                   pointB, stB[0], stB[1],
+                                   pointC, stC[0], stC[1],
                                    hitPoint, &xPos, &yPos,
                                    &newCol->mBarycentricI,
                                    &newCol->mBarycentricJ);
@@ -602,6 +1567,73 @@ static qboolean G2_TracePolys(mdxmSurface_t *surface, mdxmSurfHierarchy_t *surfI
     return qfalse;
 }
 
+/*
+==============
+G2_TraceSurface
+
+Traces every ray that is still going
+against a surface. The surface bounds
+are worked out once for all of them,
+and the surface is only skinned when a
+ray gets past them.
+==============
+*/
+
+static void G2_TraceSurface(mdxmSurface_t *surface, mdxmSurfHierarchy_t *surfInfo, CTraceSurface_t *TS, int numRays)
+{
+    CGhoul2Model_t  *model;
+    surfaceTree_t   *tree;
+    float           *verts;
+    vec3_t          mins, maxs;
+    qboolean        bounded;
+    int             numSurfaces;
+    int             i;
+
+    model = TS->model;
+    bounded = r_g2SurfaceCull->integer && G2_SurfaceBounds(model, surface, TS->lod, mins, maxs);
+
+    tree = NULL;
+    if(r_g2PolyTree->integer && model->currentModel->surfaceTrees){
+        numSurfaces = ((mdxmHeader_t *)model->currentModel->modelData)->numSurfaces;
+        tree = &model->currentModel->surfaceTrees[TS->lod * numSurfaces + surface->thisSurfaceIndex];
+        if(!tree->nodes){
+            tree = NULL;
+        }
+    }
+
+    for(i = 0; i < numRays; i++){
+        if(TS[i].stopRec){
+            continue;
+        }
+
+        if(bounded && !G2_SegmentHitsBounds(TS[i].rayStart, TS[i].rayEnd, mins, maxs)){
+            g2CollisionStats.surfacesCulled++;
+            continue;
+        }
+
+        if(model->mSurfaceVertsStamp[surface->thisSurfaceIndex] != model->mVertsStamp){
+            G2_TransformEachSurface(model, surface, TS->lod, model->mVertsScale);
+            model->mSurfaceVertsStamp[surface->thisSurfaceIndex] = model->mVertsStamp;
+            g2CollisionStats.surfacesSkinned++;
+        }
+
+        // Same for the boxes of the poly tree.
+        if(tree && model->mSurfaceTreeStamp[surface->thisSurfaceIndex] != model->mVertsStamp){
+            verts = model->mTransformedVertsArray[surface->thisSurfaceIndex];
+            G2_RefitPolyTree(tree, surface, verts, verts + ((surface->numVerts + 3) & ~3) * 4);
+            model->mSurfaceTreeStamp[surface->thisSurfaceIndex] = model->mVertsStamp;
+        }
+
+        // Make sure we have (initialized) collision records.
+        // This is always a point trace, so trace the polys in this surface.
+        if(TS[i].collRecMap && G2_TracePolys(surface, surfInfo, &TS[i], tree) && (TS[i].traceFlags == G2_RETURNONHIT)){
+            // We hit one, and we want this ray to return instantly
+            // because the G2_RETURNONHIT flag is set.
+            TS[i].stopRec = qtrue;
+        }
+    }
+}
+
 /*
 ==============
 G2_TraceSurfaces_r
@@ -611,7 +1643,7 @@ to determine what we've hit.
 ==============
 */
 
-static void G2_TraceSurfaces_r(CTraceSurface_t *TS)
+static void G2_TraceSurfaces_r(CTraceSurface_t *TS, int numRays, int surfaceNum)
 {
     mdxmSurface_t               *surface;
     mdxmHierarchyOffsets_t      *surfIndexes;
@@ -621,7 +1653,7 @@ static void G2_TraceSurfaces_r(CTraceSurface_t *TS)
     // Back track and get the surface info structures for this surface.
 
     // Get surface.
-    surface = G2_FindSurfaceFromModel(TS->currentModel, TS->surfaceNum, TS->lod);
+    surface = G2_FindSurfaceFromModel(TS->currentModel, surfaceNum, TS->lod);
 
     // Get surface index and hierarchy info.
     surfIndexes = (mdxmHierarchyOffsets_t *)((byte *)TS->currentModel->modelData + sizeof(mdxmHeader_t));
@@ -633,17 +1665,7 @@ static void G2_TraceSurfaces_r(CTraceSurface_t *TS)
 
     // If this surface is not off, try to hit it.
     if(!offFlags){
-        // Make sure we have (initialized) collision records.
-        if(TS->collRecMap){
-            // This is always a point trace.
-            // So trace the polys in this surface.
-            if(G2_TracePolys(surface, surfInfo, TS) && (TS->traceFlags == G2_RETURNONHIT)){
-                // We hit one, and we want to return instantly
-                // because the G2_RETURNONHIT flag is set.
-                TS->stopRec = qtrue;
-                return;
-            }
-        }
+        G2_TraceSurface(surface, surfInfo, TS, numRays);
     }
 
     // If we are turning off all descendants,
@@ -652,10 +1674,17 @@ static void G2_TraceSurfaces_r(CTraceSurface_t *TS)
         return;
     }
 
-    // Recursively call for all children.
-    for(i = 0; i < surfInfo->numChildren && !TS->stopRec; i++){
-        TS->surfaceNum = surfInfo->childIndexes[i];
-        G2_TraceSurfaces_r(TS);
+    // Recursively call for all children, until
+    // none of the rays have to go on.
+    for(i = 0; i < surfInfo->numChildren; i++){
+        while(numRays && TS[numRays - 1].stopRec){
+            numRays--;
+        }
+        if(!numRays){
+            break;
+        }
+
+        G2_TraceSurfaces_r(TS, numRays, surfInfo->childIndexes[i]);
     }
 }
 
@@ -663,16 +1692,20 @@ static void G2_TraceSurfaces_r(CTraceSurface_t *TS)
 ==============
 G2_TraceModel
 
-Trace against this
-Ghoul II model.
+Trace up to MAX_G2_TRACE_RAYS rays
+against this Ghoul II model, each ray
+filling its own MAX_G2_COLLISIONS
+collision records.
 ==============
 */
 
-void G2_TraceModel(CGhoul2Model_t *model, vec3_t rayStart, vec3_t rayEnd, mdxaBone_t *worldMatrix, CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod)
+void G2_TraceModel(CGhoul2Model_t *model, vec3_t *rayStarts, vec3_t *rayEnds, int numRays, mdxaBone_t *worldMatrix, CollisionRecord_t *collRecMaps,
+                   int entNum, int traceFlags, int useLod)
 {
     skin_t          *skin;
-    CTraceSurface_t TS;
+    CTraceSurface_t TS[MAX_G2_TRACE_RAYS];
     int             lod;
+    int             i;
 
     //
     // Try tracing against this
@@ -689,9 +1722,12 @@ void G2_TraceModel(CGhoul2Model_t *model, vec3_t rayStart, vec3_t rayEnd, mdxaBo
         skin = NULL;
     }
 
-    // Initialize our trace surface structure.
-    G2_InitTraceSurf(&TS, model, lod, rayStart, rayEnd, worldMatrix, collRecMap, entNum, skin, traceFlags);
+    // Initialize our trace surface structures.
+    for(i = 0; i < numRays; i++){
+        G2_InitTraceSurf(&TS[i], model, lod, rayStarts[i], rayEnds[i], worldMatrix,
+            collRecMaps + i * MAX_G2_COLLISIONS, entNum, skin, traceFlags);
+    }
 
     // Start the surface recursion loop.
-    G2_TraceSurfaces_r(&TS);
+    G2_TraceSurfaces_r(TS, numRays, 0);
 }
@@ -71,6 +71,7 @@ typedef enum {
 //=============================================
 
 #define     G2_MAX_BONES_IN_LIST            256
+#define     MAX_G2_TRACE_RAYS               32      // Rays traced together through the surface hierarchy.
 
 typedef     struct      boneInfo_s          boneInfo_t;
 typedef     struct      CBoneCalc_s         CBoneCalc_t;
@@ -80,6 +81,16 @@ typedef     struct      CTraceSurface_s     CTraceSurface_t;
 
 typedef     struct      CGhoul2Model_s      CGhoul2Model_t;
 
+typedef struct {
+    int                 calls;                      // G2API_CollisionDetect and G2API_CollisionDetectMulti calls
+    int                 rays;
+    int                 skeletonHits;               // calls that reused the evaluated bones
+    int                 meshHits;                   // calls that reused the skinned mesh
+    int                 surfacesCulled;             // surfaces the ray missed the bounds of
+    int                 surfacesSkinned;
+    int                 polysTested;
+} g2CollisionStats_t;
+
 //=============================================
 //
 // Main Ghoul II structures
@@ -121,12 +132,12 @@ struct CBoneCache_s {
     CGhoul2Model_t      *parent;
     mdxaBone_t          rootMatrix;
     int                 incomingTime;
+    int                 mPoseVersion;               // model pose the current touch was evaluated for
 
     int                 mCurrentTouch;
 };
 
 struct CTraceSurface_s {
-    int                 surfaceNum;
     const model_t       *currentModel;
     int                 lod;
     vec3_t              rayStart;
@@ -135,7 +146,7 @@ struct CTraceSurface_s {
     CollisionRecord_t   *collRecMap;
     int                 entNum;
     skin_t              *skin;
-    void                **transformedVertsArray;
+    CGhoul2Model_t      *model;
     int                 traceFlags;
 
     qboolean            stopRec;
@@ -155,6 +166,20 @@ struct CGhoul2Model_s {
     void                **mTransformedVertsArray;
     int                 numTransformedVerts;
 
+    // What the transformed verts are skinned for. Surfaces are
+    // only skinned once a ray gets near them, mSurfaceVertsStamp
+    // tells which ones are up to date with mVertsStamp, and
+    // mSurfaceTreeStamp which poly tree boxes are.
+    const model_t       *mVertsModel;
+    int                 mVertsTouch;
+    int                 mVertsLod;
+    vec3_t              mVertsScale;
+    int                 mVertsStamp;
+    int                 *mSurfaceVertsStamp;
+    int                 *mSurfaceTreeStamp;
+
+    int                 mPoseVersion;               // bumped whenever a bone override changes
+
     qboolean            mValid;
     const model_t       *currentModel;
     int                 currentModelSize;
@@ -167,10 +192,20 @@ struct CGhoul2Model_s {
 
 //=============================================
 
+//
+// tr_g2_alloc.c
+//
+
+void                    *G2_Alloc                   ( int size, const char *name );
+void                    G2_Free                     ( void *ptr );
+void                    G2_ShrinkArena              ( void );
+
 //
 // tr_g2_api.c
 //
 
+extern g2CollisionStats_t g2CollisionStats;
+
 void                    G2API_ListBones             ( CGhoul2Model_t *model );
 void                    G2API_ListSurfaces          ( CGhoul2Model_t *model );
 
@@ -186,6 +221,11 @@ qboolean                G2API_GetAnimFileName       ( CGhoul2Model_t *model, cha
 
 void                    G2API_CollisionDetect       ( CollisionRecord_t *collRecMap, CGhoul2Model_t *model, const vec3_t angles, const vec3_t position,
                                                       int frameNumber, int entNum, vec3_t rayStart, vec3_t rayEnd, vec3_t scale, int traceFlags, int useLod );
+void                    G2API_CollisionDetectMulti  ( CollisionRecord_t *collRecMaps, CGhoul2Model_t *model, const vec3_t angles, const vec3_t position,
+                                                      int frameNumber, int entNum, vec3_t *rayStarts, vec3_t *rayEnds, int numRays,
+                                                      vec3_t scale, int traceFlags, int useLod );
+
+void                    G2API_CollisionStats        ( void );
 
 qhandle_t               G2API_RegisterSkin          ( const char *skinName, int numPairs, const char *skinPairs );
 qboolean                G2API_SetSkin               ( CGhoul2Model_t *model, qhandle_t customSkin );
@@ -208,14 +248,35 @@ void                    G2_BoneGenerateMatrix       ( const model_t *modAnim, bo
 
 void                    G2_TransformSkeleton        ( CGhoul2Model_t *model, const int frameNum );
 
+void                    G2_BuildBonePool            ( model_t *mod );
+void                    G2_BonePoolInfo_f           ( void );
+
 //
 // tr_g2_collision.c
 //
 
+void                    G2_BuildSurfaceBounds       ( model_t *mod );
+void                    G2_BuildSkinGroups          ( model_t *mod );
+void                    G2_BuildPolyTrees           ( model_t *mod );
 void                    G2_TransformModel           ( CGhoul2Model_t *model, vec3_t scale, int useLod );
+void                    G2_TransformEachSurface     ( CGhoul2Model_t *model, const mdxmSurface_t *surface, int lod, vec3_t scale );
+
+void                    G2_SkinSurface              ( CGhoul2Model_t *model, const mdxmSurface_t *surface, float *transformedVerts, vec3_t scale );
+#if idx64
+void                    G2_SkinSurfaceSIMD          ( CGhoul2Model_t *model, const mdxmSurface_t *surface, const surfaceSkin_t *skin,
+                                                      float *transformedVerts, vec3_t scale );
+#endif // idx64
+
+void                    G2_TraceModel               ( CGhoul2Model_t *model, vec3_t *rayStarts, vec3_t *rayEnds, int numRays, mdxaBone_t *worldMatrix,
+                                                      CollisionRecord_t *collRecMaps, int entNum, int traceFlags, int useLod );
+
+//
+// tr_g2_bench.c
+//
 
-void                    G2_TraceModel               ( CGhoul2Model_t *model, vec3_t rayStart, vec3_t rayEnd, mdxaBone_t *worldMatrix,
-                                                      CollisionRecord_t *collRecMap, int entNum, int traceFlags, int useLod );
+void                    G2_SkinBench_f              ( void );
+void                    G2_RayBench_f               ( void );
+void                    G2_HitBench_f               ( void );
 
 //
 // tr_g2_misc.c
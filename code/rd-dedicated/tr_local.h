@@ -50,6 +50,34 @@ typedef enum {
     MOD_MDXA
 } modtype_t;
 
+typedef struct {
+    vec3_t                  center;             // In the space the bone matrix transforms from.
+    float                   radius;             // -1 when no vertex is weighted to the bone.
+} boneSphere_t;
+
+typedef struct {
+    float                   xyz[3][4];          // x, y and z of four vertexes.
+    float                   weights[iMAX_G2_BONEWEIGHTS_PER_VERT][4];
+    int                     bones[iMAX_G2_BONEWEIGHTS_PER_VERT][4];     // Bone reference of each weight.
+} skinGroup_t;
+
+typedef struct {
+    skinGroup_t             *groups;            // (numVerts + 3) / 4 of them, NULL if the surface can't use them.
+    int                     numWeights;         // Most weights any vertex has.
+    unsigned int            usedBones;          // Bit for every bone reference the vertexes use.
+} surfaceSkin_t;
+
+typedef struct {
+    int                     child;              // Inner nodes: the second child, the first one follows the node. Leaves: first in the poly list.
+    int                     numPolys;           // 0 for inner nodes.
+} polyNode_t;
+
+typedef struct {
+    polyNode_t              *nodes;             // Parents come before their children. NULL if the surface has too few polys.
+    int                     *polys;             // Poly indexes of the leaves, in order.
+    int                     numNodes;
+} surfaceTree_t;
+
 typedef struct {
     char                    name[MAX_QPATH];
     modtype_t               type;
@@ -58,6 +86,15 @@ typedef struct {
     void                    *modelData;         // Only if type == MOD_GL2A (Ghoul II animation file) or type == MOD_GL2M (Ghoul II mesh file).
 
     int                     numLods;
+
+    // Ghoul II mesh files only, see G2_BuildSurfaceBounds.
+    boneSphere_t            *boneSpheres;       // One for each bone reference of each surface.
+    int                     *boneSphereOffsets; // First sphere of a surface, by (lod * numSurfaces + surface). -1 when unbounded.
+    surfaceSkin_t           *surfaceSkins;      // By (lod * numSurfaces + surface), see G2_BuildSkinGroups.
+    surfaceTree_t           *surfaceTrees;      // By (lod * numSurfaces + surface), see G2_BuildPolyTrees.
+
+    // Ghoul II animation files only, see G2_BuildBonePool.
+    mdxaBone_t              *bonePool;          // The compressed bone pool expanded into matrices, NULL if not built.
 } model_t;
 
 typedef struct {
@@ -127,6 +164,11 @@ void                R_LoadPNG                       ( const char *name, byte **p
 
 // CVARs.
 extern cvar_t       *r_verbose;                     // Used for verbose debug spew.
+extern cvar_t       *r_g2CollisionCache;            // Reuse skinned Ghoul II meshes between collision checks.
+extern cvar_t       *r_g2SurfaceCull;               // Skip Ghoul II surfaces whose bounds a ray misses.
+extern cvar_t       *r_g2SimdSkinning;              // Skin Ghoul II collision meshes four vertexes at a time.
+extern cvar_t       *r_g2PolyTree;                  // Only test the Ghoul II polys whose boxes a ray goes through.
+extern cvar_t       *r_g2BonePool;                  // Expand Ghoul II bone pools into matrices when loading animation files.
 
 // Functions.
 void                R_Init                          ( void );
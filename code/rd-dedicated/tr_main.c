@@ -23,11 +23,17 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 // tr_main.c - Main control flow for each frame.
 
 #include "tr_local.h"
+#include "tr_g2_local.h"
 
 trGlobals_t     tr;
 
 // CVAR definitions.
 cvar_t  *r_verbose;
+cvar_t  *r_g2CollisionCache;
+cvar_t  *r_g2SurfaceCull;
+cvar_t  *r_g2SimdSkinning;
+cvar_t  *r_g2PolyTree;
+cvar_t  *r_g2BonePool;
 
 // Local function definitions.
 static void          R_Register                      ( void );
@@ -47,6 +53,12 @@ static void R_Register()
 #else
     r_verbose = Cvar_Get("r_verbose", "1", CVAR_CHEAT);
 #endif // NDEBUG
+
+    r_g2CollisionCache = Cvar_Get("r_g2CollisionCache", "1", 0);
+    r_g2SurfaceCull = Cvar_Get("r_g2SurfaceCull", "1", 0);
+    r_g2SimdSkinning = Cvar_Get("r_g2SimdSkinning", "1", 0);
+    r_g2PolyTree = Cvar_Get("r_g2PolyTree", "1", 0);
+    r_g2BonePool = Cvar_Get("r_g2BonePool", "0", CVAR_ARCHIVE);
 }
 
 /*
@@ -66,6 +78,9 @@ void R_Init()
     // for the renderer, if any allocated.
     Z_FreeTags(TAG_RENDERER);
 
+    // Release the Ghoul II slabs no longer in use.
+    G2_ShrinkArena();
+
     // Register CVARs.
     R_Register();
 
@@ -22,7 +22,7 @@ along with this program; if not, see <http://www.gnu.org/licenses/>.
 */
 // tr_model.c - Server-side model functions.
 
-#include "tr_local.h"
+#include "tr_g2_local.h"
 
 #define LL(x) x=LittleLong(x)
 #define LF(x) x=LittleFloat(x)
@@ -297,6 +297,9 @@ static qboolean R_LoadMDXA(model_t *mod, void *buffer, int bufferSize, const cha
     }
 #endif // Q3_BIG_ENDIAN
 
+    // Expand the bone pool if requested.
+    G2_BuildBonePool(mod);
+
     return qtrue;
 }
 
@@ -490,5 +493,10 @@ static qboolean R_LoadMDXM(model_t *mod, void *buffer, int bufferSize, const cha
         lod = (mdxmLOD_t *)((byte *)lod + lod->ofsEnd);
     }
 
+    // Prepare the surfaces for collision detection.
+    G2_BuildSurfaceBounds(mod);
+    G2_BuildSkinGroups(mod);
+    G2_BuildPolyTrees(mod);
+
     return qtrue;
 }
@@ -36,9 +36,21 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define MAX_ENT_CLUSTERS    16
 
+// What traces against an entity depend on. Relinking with the same
+// values leaves the trace results cached around it alone.
+typedef struct {
+    vec3_t      absmin, absmax;
+    vec3_t      origin, angles;
+    vec3_t      mins, maxs;
+    int         contents;
+    int         ownerNum;
+    int         bmodel;
+    int         modelindex;
+    int         capsule;
+} entityTraceState_t;
+
 typedef struct svEntity_s {
     struct worldSector_s *worldSector;
-    struct svEntity_s *nextEntityInWorldSector;
 
     entityState_t   baseline;       // for delta compression of initial sighting
     int         numClusters;        // if -1, use headnode instead
@@ -46,6 +58,12 @@ typedef struct svEntity_s {
     int         lastCluster;        // if all the clusters don't fit in clusternums
     int         areanum, areanum2;
     int         snapshotCounter;    // used to prevent double adding from portal views
+
+    qboolean    leafsValid;         // clusters and areas came from linkMins / linkMaxs
+    vec3_t      linkMins, linkMaxs; // abs box of the last full leaf walk
+    float       leafMargin;         // how far its faces can move and keep the same leafs
+
+    entityTraceState_t  traceState; // as of the last link, while it has a worldSector
 } svEntity_t;
 
 typedef enum {
@@ -67,6 +85,13 @@ typedef struct {
     int             timeResidual;       // <= 1000 / sv_frame->value
     int             nextFrameTime;      // when time > nextFrameTime, process world
     char            *configstrings[MAX_CONFIGSTRINGS];
+    qboolean        csDirty[MAX_CONFIGSTRINGS];         // changed since the last SV_FlushConfigstrings
+    int             csDirtyList[MAX_CONFIGSTRINGS];     // indexes of dirty configstrings, in order of first change
+    int             numDirtyConfigstrings;
+    int             csBroadcasts;       // configstring updates broadcast to the clients
+    int             csSuppressed;       // updates overwritten before they were broadcast
+    int             linksFull;          // SV_LinkEntity calls that walked the BSP
+    int             linksReused;        // calls that kept the leafs of the last walk
     svEntity_t      svEntities[MAX_GENTITIES];
 
     char            *entityParsePoint;  // used during game VM init
@@ -115,18 +140,27 @@ typedef enum {
 
 typedef struct netchan_buffer_s {
     msg_t           msg;
-    byte            msgBuffer[MAX_MSGLEN];
 
     char            clientCommandString[MAX_STRING_CHARS];  // valid command string for SV_Netchan_Encode
 
     struct netchan_buffer_s *next;
+
+    byte            msgBuffer[1];       // variable sized, allocated from the netchan queue pool
 } netchan_buffer_t;
 
+// Reliable server commands are stored once, in a ring shared by all clients
+// and sized to their length, and referenced from the ring of every client
+// they were added to, so a broadcast command is only copied once.
+typedef struct {
+    int             refCount;           // client ring slots and callers referencing it
+    char            *string;            // in the shared command text
+} reliableCommand_t;
+
 typedef struct client_s {
     clientState_t   state;
     char            userinfo[MAX_INFO_STRING];      // name, etc
 
-    char            reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
+    reliableCommand_t   *reliableCommands[MAX_RELIABLE_COMMANDS];   // NULL for empty slots
     int             reliableSequence;       // last added reliable message, not necessarily sent or acknowledged yet
     int             reliableAcknowledge;    // last acknowledged reliable message
     int             reliableSent;           // last sent reliable message, not necessarily acknowledged yet
@@ -187,14 +221,11 @@ typedef struct client_s {
 // of service attack that could cycle all of them
 // out before legitimate users connected
 #define MAX_CHALLENGES  2048
-// Allow a certain amount of challenges to have the same IP address
-// to make it a bit harder to DOS one single IP address from connecting
-// while not allowing a single ip to grab all challenge resources
-#define MAX_CHALLENGES_MULTI (MAX_CHALLENGES / 2)
+#define CHALLENGE_HASH_SIZE (MAX_CHALLENGES * 2)    // must be a power of two
 
 #define AUTHORIZE_TIMEOUT   5000
 
-typedef struct {
+typedef struct challenge_s {
     netadr_t    adr;
     int         challenge;
     int         clientChallenge;        // challenge number coming from the client
@@ -203,8 +234,22 @@ typedef struct {
     int         firstTime;          // time the adr was first used, for authorize timeout checks
     qboolean    wasrefused;
     qboolean    connected;
+
+    int         hash;               // -1 if not in the hash table
+    struct challenge_s  *hashPrev, *hashNext;   // challenges with the same address hash
+    struct challenge_s  *agePrev, *ageNext;     // all challenges, oldest first
 } challenge_t;
 
+// Challenges are hashed by address so getchallenge and connect packets
+// don't have to scan the whole array, and kept on a list ordered by
+// the time they were handed out so the oldest one can be reused directly
+typedef struct {
+    challenge_t challenges[MAX_CHALLENGES];
+    challenge_t *hashTable[CHALLENGE_HASH_SIZE];
+    challenge_t age;                    // list head, age.ageNext is the oldest challenge
+    unsigned int hashSeed;
+} challengeTable_t;
+
 // this structure will be cleared only when the game dll changes
 typedef struct {
     qboolean    initialized;                // sv_init has completed
@@ -218,9 +263,9 @@ typedef struct {
     int         nextSnapshotEntities;       // next snapshotEntities to use
     entityState_t   *snapshotEntities;      // [numSnapshotEntities]
     int         nextHeartbeatTime;
-    challenge_t challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
+    challengeTable_t    challenges;         // to prevent invalid IPs from connecting
     netadr_t    redirectAddress;            // for rcon return messages
-    int         masterResolveTime[MAX_MASTER_SERVERS]; // next svs.time that server should do dns lookup for master server
+    qboolean    masterHeartbeatPending[MAX_MASTER_SERVERS]; // heartbeat is held back until the master's name resolves
 } serverStatic_t;
 
 #define SERVER_MAXBANS  1024
@@ -267,6 +312,9 @@ extern  cvar_t  *sv_gametype;
 extern  cvar_t  *sv_pure;
 extern  cvar_t  *sv_floodProtect;
 extern  cvar_t  *sv_mapcycle;
+extern  cvar_t  *sv_traceBatchJobs;
+extern  cvar_t  *sv_entityGrid;
+extern  cvar_t  *sv_traceCache;
 extern  cvar_t  *sv_lanForceRate;
 extern  cvar_t  *sv_banFile;
 
@@ -300,6 +348,12 @@ extern leakyBucket_t outboundLeakyBucket;
 qboolean SVC_RateLimit( leakyBucket_t *bucket, int burst, int period );
 qboolean SVC_RateLimitAddress( netadr_t from, int burst, int period );
 
+reliableCommand_t *SV_AllocReliableCommand( const char *cmd );
+void SV_ReleaseReliableCommand( reliableCommand_t *rc );
+void SV_AddReliableCommand( client_t *client, reliableCommand_t *cmd );
+void SV_FreeReliableCommands( client_t *client );
+const char *SV_ReliableCommand( client_t *client, int sequence );
+
 void SV_FinalMessage (char *message);
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
 
@@ -319,6 +373,8 @@ int SV_RateMsec(client_t *client);
 void SV_SetConfigstring( int index, const char *val );
 void SV_GetConfigstring( int index, char *buffer, int bufferSize );
 void SV_UpdateConfigstrings( client_t *client );
+void SV_FlushConfigstrings( void );
+void SV_ConfigstringStats_f( void );
 
 void SV_SetUserinfo( int index, const char *val );
 void SV_GetUserinfo( int index, char *buffer, int bufferSize );
@@ -331,6 +387,13 @@ void SV_SpawnServer( char *server, qboolean killBots );
 //
 // sv_client.c
 //
+void SV_InitChallenges( challengeTable_t *table );
+challenge_t *SV_FindAddressChallenge( challengeTable_t *table, netadr_t from );
+challenge_t *SV_NewChallenge( challengeTable_t *table, netadr_t from );
+challenge_t *SV_FindChallenge( challengeTable_t *table, netadr_t from, int challenge );
+void SV_ClearChallenge( challengeTable_t *table, challenge_t *challenge );
+void SV_ChallengeBench_f( void );
+
 void SV_GetChallenge(netadr_t from);
 
 void SV_DirectConnect( netadr_t from );
@@ -430,6 +493,12 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_AreaBench_f( void );
+void SV_TraceStress_f( void );
+void SV_TraceBatchBench_f( void );
+void SV_NodeBench_f( void );
+void SV_BrushBench_f( void );
+void SV_TerrainBench_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -457,6 +526,19 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
 
+void SV_InvalidateTraceCache( void );
+// forgets every SV_Trace result sv_traceCache has kept
+
+void SV_InvalidateTraceCacheBox( const vec3_t mins, const vec3_t maxs );
+// forgets the kept SV_Trace results that searched the box for entities
+
+void SV_TraceCacheStats( void );
+
+int SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests );
+// SV_Trace for every request, sharing the entity search between requests
+// that are close to each other
+
+
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule );
 // clip to a specific entity
 
@@ -467,3 +549,4 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg);
 int SV_Netchan_TransmitNextFragment(client_t *client);
 qboolean SV_Netchan_Process( client_t *client, msg_t *msg );
 void SV_Netchan_FreeQueue(client_t *client);
+void SV_Netchan_Shutdown(void);
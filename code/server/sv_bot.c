@@ -574,7 +574,7 @@ SV_BotGetConsoleMessage
 int SV_BotGetConsoleMessage( int client, char *buf, int size )
 {
     client_t    *cl;
-    int         index;
+    const char  *msg;
 
     cl = &svs.clients[client];
     cl->lastPacketTime = svs.time;
@@ -584,13 +584,13 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
     }
 
     cl->reliableAcknowledge++;
-    index = cl->reliableAcknowledge & ( MAX_RELIABLE_COMMANDS - 1 );
+    msg = SV_ReliableCommand( cl, cl->reliableAcknowledge );
 
-    if ( !cl->reliableCommands[index][0] ) {
+    if ( !msg[0] ) {
         return qfalse;
     }
 
-    Q_strncpyz( buf, cl->reliableCommands[index], size );
+    Q_strncpyz( buf, msg, size );
     return qtrue;
 }
 
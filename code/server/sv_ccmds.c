@@ -1521,6 +1521,18 @@ void SV_AddOperatorCommands( void ) {
     Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
     Cmd_AddCommand ("map_restart", SV_MapRestart_f);
     Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+    Cmd_AddCommand ("areabench", SV_AreaBench_f);
+    Cmd_AddCommand ("csstats", SV_ConfigstringStats_f);
+    Cmd_AddCommand ("challengebench", SV_ChallengeBench_f);
+    Cmd_AddCommand ("tracestress", SV_TraceStress_f);
+    Cmd_AddCommand ("tracebatchbench", SV_TraceBatchBench_f);
+    Cmd_AddCommand ("nodebench", SV_NodeBench_f);
+    Cmd_AddCommand ("brushbench", SV_BrushBench_f);
+    Cmd_AddCommand ("terrainbench", SV_TerrainBench_f);
+    Cmd_AddCommand ("g2skinbench", G2_SkinBench_f);
+    Cmd_AddCommand ("g2bonepool", G2_BonePoolInfo_f);
+    Cmd_AddCommand ("g2raybench", G2_RayBench_f);
+    Cmd_AddCommand ("g2hitbench", G2_HitBench_f);
     Cmd_AddCommand ("map", SV_Map_f);
     Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
@@ -1571,6 +1583,18 @@ void SV_RemoveOperatorCommands( void ) {
     Cmd_RemoveCommand ("dumpuser");
     Cmd_RemoveCommand ("map_restart");
     Cmd_RemoveCommand ("sectorlist");
+    Cmd_RemoveCommand ("areabench");
+    Cmd_RemoveCommand ("csstats");
+    Cmd_RemoveCommand ("challengebench");
+    Cmd_RemoveCommand ("tracestress");
+    Cmd_RemoveCommand ("tracebatchbench");
+    Cmd_RemoveCommand ("nodebench");
+    Cmd_RemoveCommand ("brushbench");
+    Cmd_RemoveCommand ("terrainbench");
+    Cmd_RemoveCommand ("g2skinbench");
+    Cmd_RemoveCommand ("g2bonepool");
+    Cmd_RemoveCommand ("g2raybench");
+    Cmd_RemoveCommand ("g2hitbench");
     Cmd_RemoveCommand ("say");
 #endif
 }
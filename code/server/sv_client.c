@@ -25,6 +25,358 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static void SV_CloseDownload( client_t *cl );
 
+/*
+=============================================================================
+
+CHALLENGE TABLE
+
+=============================================================================
+*/
+
+/*
+=================
+SV_HashForChallengeAddress
+=================
+*/
+static int SV_HashForChallengeAddress( challengeTable_t *table, netadr_t adr ) {
+    byte            *ip = NULL;
+    int             size = 0;
+    int             i;
+    unsigned int    hash;
+
+    switch ( adr.type ) {
+        case NA_IP:  ip = adr.ip;  size = 4;  break;
+        case NA_IP6: ip = adr.ip6; size = 16; break;
+        default: break;
+    }
+
+    // FNV-1a over the address and port, seeded
+    // so the chains can't be lined up from outside
+    hash = 2166136261u ^ table->hashSeed;
+    for ( i = 0; i < size; i++ ) {
+        hash = ( hash ^ ip[i] ) * 16777619u;
+    }
+    if ( size ) {
+        hash = ( hash ^ ( adr.port & 0xff ) ) * 16777619u;
+        hash = ( hash ^ ( adr.port >> 8 ) ) * 16777619u;
+    }
+
+    return ( hash ^ ( hash >> 16 ) ) & ( CHALLENGE_HASH_SIZE - 1 );
+}
+
+/*
+=================
+SV_UnhashChallenge
+=================
+*/
+static void SV_UnhashChallenge( challengeTable_t *table, challenge_t *challenge ) {
+    if ( challenge->hash < 0 ) {
+        return;
+    }
+
+    if ( challenge->hashPrev != NULL ) {
+        challenge->hashPrev->hashNext = challenge->hashNext;
+    } else {
+        table->hashTable[ challenge->hash ] = challenge->hashNext;
+    }
+
+    if ( challenge->hashNext != NULL ) {
+        challenge->hashNext->hashPrev = challenge->hashPrev;
+    }
+
+    challenge->hashPrev = challenge->hashNext = NULL;
+    challenge->hash = -1;
+}
+
+/*
+=================
+SV_LinkChallengeAge
+
+Moves a challenge to the newest or the oldest end of the age list
+=================
+*/
+static void SV_LinkChallengeAge( challengeTable_t *table, challenge_t *challenge, qboolean newest ) {
+    challenge_t *head = &table->age;
+
+    if ( challenge->ageNext ) {
+        challenge->agePrev->ageNext = challenge->ageNext;
+        challenge->ageNext->agePrev = challenge->agePrev;
+    }
+
+    if ( newest ) {
+        challenge->agePrev = head->agePrev;
+        challenge->ageNext = head;
+    } else {
+        challenge->agePrev = head;
+        challenge->ageNext = head->ageNext;
+    }
+    challenge->agePrev->ageNext = challenge;
+    challenge->ageNext->agePrev = challenge;
+}
+
+/*
+=================
+SV_InitChallenges
+=================
+*/
+void SV_InitChallenges( challengeTable_t *table ) {
+    int     i;
+
+    Com_Memset( table, 0, sizeof( *table ) );
+
+    table->hashSeed = ( ((unsigned int)rand() << 16) ^ (unsigned int)rand() ) ^ Sys_Milliseconds();
+    table->age.agePrev = table->age.ageNext = &table->age;
+
+    for ( i = 0; i < MAX_CHALLENGES; i++ ) {
+        table->challenges[i].hash = -1;
+        SV_LinkChallengeAge( table, &table->challenges[i], qtrue );
+    }
+}
+
+/*
+=================
+SV_FindAddressChallenge
+
+Returns the challenge the given address was handed out and
+hasn't connected with yet, or NULL. It becomes the newest one,
+so an address asking again keeps its slot instead of taking
+another one
+=================
+*/
+challenge_t *SV_FindAddressChallenge( challengeTable_t *table, netadr_t from ) {
+    challenge_t *c;
+
+    for ( c = table->hashTable[ SV_HashForChallengeAddress( table, from ) ]; c; c = c->hashNext ) {
+        if ( !c->connected && NET_CompareAdr( from, c->adr ) ) {
+            SV_LinkChallengeAge( table, c, qtrue );
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================
+SV_NewChallenge
+
+Takes the oldest challenge for the given address
+and makes it the newest one
+=================
+*/
+challenge_t *SV_NewChallenge( challengeTable_t *table, netadr_t from ) {
+    challenge_t *challenge;
+    int         hash;
+
+    challenge = table->age.ageNext;
+    SV_UnhashChallenge( table, challenge );
+
+    challenge->adr = from;
+
+    // add to the head of the relevant hash chain
+    hash = SV_HashForChallengeAddress( table, from );
+    challenge->hash = hash;
+    challenge->hashPrev = NULL;
+    challenge->hashNext = table->hashTable[ hash ];
+    if ( table->hashTable[ hash ] != NULL ) {
+        table->hashTable[ hash ]->hashPrev = challenge;
+    }
+    table->hashTable[ hash ] = challenge;
+
+    SV_LinkChallengeAge( table, challenge, qtrue );
+
+    return challenge;
+}
+
+/*
+=================
+SV_FindChallenge
+
+Returns the challenge handed out to the given address, or NULL
+=================
+*/
+challenge_t *SV_FindChallenge( challengeTable_t *table, netadr_t from, int challenge ) {
+    challenge_t *c;
+
+    for ( c = table->hashTable[ SV_HashForChallengeAddress( table, from ) ]; c; c = c->hashNext ) {
+        if ( c->challenge == challenge && NET_CompareAdr( from, c->adr ) ) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================
+SV_ClearChallenge
+
+Invalidates a challenge, it will be the first one to be reused
+=================
+*/
+void SV_ClearChallenge( challengeTable_t *table, challenge_t *challenge ) {
+    SV_UnhashChallenge( table, challenge );
+
+    Com_Memset( &challenge->adr, 0, sizeof( challenge->adr ) );
+    challenge->challenge = 0;
+    challenge->clientChallenge = 0;
+    challenge->time = 0;
+    challenge->pingTime = 0;
+    challenge->firstTime = 0;
+    challenge->wasrefused = qfalse;
+    challenge->connected = qfalse;
+
+    SV_LinkChallengeAge( table, challenge, qfalse );
+}
+
+/*
+=================
+SV_LinearNewChallenge
+
+Allocation and lookup as done before the challenge table
+was hashed, for comparison by SV_ChallengeBench_f
+=================
+*/
+static challenge_t *SV_LinearNewChallenge( challenge_t *challenges, netadr_t from ) {
+    int         i;
+    int         oldest;
+    int         oldestTime;
+    challenge_t *challenge;
+    qboolean    wasfound = qfalse;
+
+    oldest = 0;
+    oldestTime = 0x7fffffff;
+
+    challenge = &challenges[0];
+    for ( i = 0 ; i < MAX_CHALLENGES ; i++, challenge++ ) {
+        if ( !challenge->connected && NET_CompareAdr( from, challenge->adr ) ) {
+            wasfound = qtrue;
+        }
+
+        if ( wasfound && i >= MAX_CHALLENGES / 2 ) {
+            break;
+        }
+
+        if ( challenge->time < oldestTime ) {
+            oldestTime = challenge->time;
+            oldest = i;
+        }
+    }
+
+    challenges[oldest].adr = from;
+    return &challenges[oldest];
+}
+
+static challenge_t *SV_LinearFindChallenge( challenge_t *challenges, netadr_t from, int challenge ) {
+    int     i;
+
+    for ( i = 0; i < MAX_CHALLENGES; i++ ) {
+        if ( NET_CompareAdr( from, challenges[i].adr ) && challenges[i].challenge == challenge ) {
+            return &challenges[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+=================
+SV_ChallengeBench_f
+
+Feeds a generated getchallenge and connect flood from random
+addresses through the hashed table and the old linear scan,
+and reports the CPU time each would take at the given rate.
+
+This only measures the challenge table itself. The rate limiters
+in front of SV_GetChallenge and the packet handling are left out,
+as a flood through them would mostly be dropped and the replies
+would go out to the generated addresses
+=================
+*/
+void SV_ChallengeBench_f( void ) {
+    challengeTable_t    *table;
+    challenge_t         *linear, *c;
+    netadr_t            *recent;
+    unsigned int        seed;
+    int                 rate, seconds, packets;
+    int                 i, j, start, found;
+    int                 msec[2];
+    double              usec[2];
+
+    rate = 50000;
+    seconds = 2;
+    if ( Cmd_Argc() > 1 ) {
+        rate = atoi( Cmd_Argv(1) );
+    }
+    if ( Cmd_Argc() > 2 ) {
+        seconds = atoi( Cmd_Argv(2) );
+    }
+    if ( rate < 1 || seconds < 1 ) {
+        Com_Printf( "Usage: challengebench [packets per second] [seconds]\n" );
+        return;
+    }
+    packets = rate * seconds;
+
+    table = Z_Malloc( sizeof( *table ) );
+    linear = Z_Malloc( MAX_CHALLENGES * sizeof( *linear ) );
+    recent = Z_Malloc( MAX_CHALLENGES * sizeof( *recent ) );
+
+    SV_InitChallenges( table );
+
+    // every packet hands out a challenge to a new address, and
+    // every fourth one is a connect from a recent address
+    for ( j = 0; j < 2; j++ ) {
+        seed = 1;
+        found = 0;
+        start = Sys_Milliseconds();
+
+        for ( i = 0; i < packets; i++ ) {
+            netadr_t    *adr = &recent[ i & ( MAX_CHALLENGES - 1 ) ];
+
+            seed = seed * 1664525 + 1013904223;
+            Com_Memset( adr, 0, sizeof( *adr ) );
+            adr->type = NA_IP;
+            Com_Memcpy( adr->ip, &seed, sizeof( adr->ip ) );
+            adr->port = seed >> 16;
+
+            if ( j ) {
+                c = SV_LinearNewChallenge( linear, *adr );
+            } else {
+                c = SV_FindAddressChallenge( table, *adr );
+                if ( !c ) {
+                    c = SV_NewChallenge( table, *adr );
+                }
+            }
+            c->challenge = i;
+            c->time = 1 + (int)( (long long)i * 1000 / rate );
+
+            if ( ( i & 3 ) == 3 ) {
+                int k = i - (int)( seed % ( MAX_CHALLENGES / 2 ) );
+
+                if ( k < 0 ) {
+                    continue;
+                }
+                adr = &recent[ k & ( MAX_CHALLENGES - 1 ) ];
+                if ( j ? SV_LinearFindChallenge( linear, *adr, k ) : SV_FindChallenge( table, *adr, k ) ) {
+                    found++;
+                }
+            }
+        }
+
+        msec[j] = Sys_Milliseconds() - start;
+        usec[j] = msec[j] * 1000.0 / packets;
+
+        Com_Printf( "%s: %i packets, %i connects matched, %i msec, %.3f usec/packet, %.1f%% of a core\n",
+            j ? "linear" : "hashed", packets, found, msec[j], usec[j], usec[j] * rate / 10000.0 );
+    }
+
+    Com_Printf( "saved %.1f%% of a core at %i packets/sec\n", ( usec[1] - usec[0] ) * rate / 10000.0, rate );
+
+    Z_Free( recent );
+    Z_Free( linear );
+    Z_Free( table );
+}
+
 /*
 =================
 SV_GetChallenge
@@ -50,13 +402,9 @@ to hi-jack client connections.
 
 void SV_GetChallenge(netadr_t from)
 {
-    int     i;
-    int     oldest;
-    int     oldestTime;
-    int     oldestClientTime;
     int     clientChallenge;
     challenge_t *challenge;
-    qboolean wasfound = qfalse;
+    qboolean    newChallenge;
 
     // Prevent using getchallenge as an amplifier
     if ( SVC_RateLimitAddress( from, 10, 1000 ) ) {
@@ -72,51 +420,32 @@ void SV_GetChallenge(netadr_t from)
         return;
     }
 
-    oldest = 0;
-    oldestClientTime = oldestTime = 0x7fffffff;
-
-    // see if we already have a challenge for this ip
-    challenge = &svs.challenges[0];
     clientChallenge = atoi(Cmd_Argv(1));
 
-    for(i = 0 ; i < MAX_CHALLENGES ; i++, challenge++)
-    {
-        if(!challenge->connected && NET_CompareAdr(from, challenge->adr))
-        {
-            wasfound = qtrue;
-
-            if(challenge->time < oldestClientTime)
-                oldestClientTime = challenge->time;
-        }
-
-        if(wasfound && i >= MAX_CHALLENGES_MULTI)
-        {
-            i = MAX_CHALLENGES;
-            break;
-        }
-
-        if(challenge->time < oldestTime)
-        {
-            oldestTime = challenge->time;
-            oldest = i;
-        }
-    }
+    // see if we already have a challenge for this ip
+    challenge = SV_FindAddressChallenge( &svs.challenges, from );
 
-    if (i == MAX_CHALLENGES)
-    {
+    if ( !challenge ) {
         // this is the first time this client has asked for a challenge
-        challenge = &svs.challenges[oldest];
-        challenge->clientChallenge = clientChallenge;
-        challenge->adr = from;
+        challenge = SV_NewChallenge( &svs.challenges, from );
         challenge->firstTime = svs.time;
         challenge->connected = qfalse;
+        newChallenge = qtrue;
+    } else {
+        // asking again keeps the challenge number, so an earlier response
+        // still in flight stays valid, and the ping keeps counting from the
+        // first request. After a refused connect the client starts over.
+        newChallenge = challenge->wasrefused;
     }
 
-    // always generate a new challenge number, so the client cannot circumvent sv_maxping
-    challenge->challenge = ( ((unsigned int)rand() << 16) ^ (unsigned int)rand() ) ^ svs.time;
-    challenge->wasrefused = qfalse;
+    if ( newChallenge ) {
+        // generate a new challenge number, so the client cannot circumvent sv_maxping
+        challenge->challenge = ( ((unsigned int)rand() << 16) ^ (unsigned int)rand() ) ^ svs.time;
+        challenge->pingTime = svs.time;
+        challenge->wasrefused = qfalse;
+    }
+    challenge->clientChallenge = clientChallenge;
     challenge->time = svs.time;
-    challenge->pingTime = svs.time;
     NET_OutOfBandPrint(NS_SERVER, challenge->adr, "challengeResponse %d %d %d",
                challenge->challenge, clientChallenge, com_protocol->integer);
 }
@@ -246,22 +575,15 @@ void SV_DirectConnect( netadr_t from ) {
         int ping;
         challenge_t *challengeptr;
 
-        for (i=0; i<MAX_CHALLENGES; i++)
-        {
-            if (NET_CompareAdr(from, svs.challenges[i].adr))
-            {
-                if(challenge == svs.challenges[i].challenge)
-                    break;
-            }
-        }
+        challengeptr = SV_FindChallenge(&svs.challenges, from, challenge);
 
-        if (i == MAX_CHALLENGES)
+        if (!challengeptr)
         {
             NET_OutOfBandPrint( NS_SERVER, from, "print\nNo or bad challenge for your address.\n" );
             return;
         }
 
-        challengeptr = &svs.challenges[i];
+        i = challengeptr - svs.challenges.challenges;
 
         if(challengeptr->wasrefused)
         {
@@ -377,6 +699,7 @@ gotnewcl:
     // build a new connection
     // accept the new client
     // this is the only place a client_t is ever initialized
+    SV_FreeReliableCommands( newcl );
     *newcl = temp;
     clientNum = newcl - svs.clients;
     ent = SV_GentityNum( clientNum );
@@ -472,16 +795,10 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 
     if ( !isBot ) {
         // see if we already have a challenge for this ip
-        challenge = &svs.challenges[0];
+        challenge = SV_FindChallenge(&svs.challenges, drop->netchan.remoteAddress, drop->challenge);
 
-        for (i = 0 ; i < MAX_CHALLENGES ; i++, challenge++)
-        {
-            if(NET_CompareAdr(drop->netchan.remoteAddress, challenge->adr))
-            {
-                Com_Memset(challenge, 0, sizeof(*challenge));
-                break;
-            }
-        }
+        if(challenge)
+            SV_ClearChallenge(&svs.challenges, challenge);
     }
 
     // Free all allocated data on the client structure
@@ -502,6 +819,7 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 
         // bots shouldn't go zombie, as there's no real net connection.
         drop->state = CS_FREE;
+        SV_FreeReliableCommands( drop );
     } else {
         Com_DPrintf( "Going to CS_ZOMBIE for %s\n", drop->name );
         drop->state = CS_ZOMBIE;        // become free in a few seconds
@@ -1498,7 +1816,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
     // also use the message acknowledge
     key ^= cl->messageAcknowledge;
     // also use the last acknowledged server command in the key
-    key ^= MSG_HashKey(cl->reliableCommands[ cl->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ], 32);
+    key ^= MSG_HashKey(SV_ReliableCommand( cl, cl->reliableAcknowledge ), 32);
 
     Com_Memset( &nullcmd, 0, sizeof(nullcmd) );
     oldcmd = &nullcmd;
@@ -220,6 +220,7 @@ void SV_AdjustAreaPortalState( sharedEntity_t *ent, qboolean open ) {
         return;
     }
     CM_AdjustAreaPortalState( svEnt->areanum, svEnt->areanum2, open );
+    SV_InvalidateTraceCache();
 }
 
 
@@ -405,6 +406,9 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
     case G_TRACECAPSULE:
         SV_Trace( VMA(1), VMA(2), VMA(3), VMA(4), VMA(5), args[6], args[7], /*int capsule*/ qtrue );
         return 0;
+    case G_TRACE_BATCH:
+        SV_TraceBatch( VMA(1), VMA(2), args[3] );
+        return 0;
     case G_POINT_CONTENTS:
         return SV_PointContents( VMA(1), args[2] );
     case G_SET_BRUSH_MODEL:
@@ -866,6 +870,10 @@ intptr_t SV_GameSystemCalls( intptr_t *args ) {
         G2API_CollisionDetect(VMA(1), VMA(2), (const float *)VMA(3), (const float *)VMA(4), args[5], args[6],
                              (float *)VMA(7), (float *)VMA(8), (float *)VMA(9), args[10], args[11]);
         return 0;
+    case G_G2_COLLISIONDETECT_MULTI:
+        G2API_CollisionDetectMulti(VMA(1), VMA(2), (const float *)VMA(3), (const float *)VMA(4), args[5], args[6],
+                                  VMA(7), VMA(8), args[9], (float *)VMA(10), args[11], args[12]);
+        return 0;
     case G_G2_REGISTERSKIN:
         return G2API_RegisterSkin((const char *)VMA(1), args[2], (const char *)VMA(3));
     case G_G2_SETSKIN:
@@ -25,48 +25,75 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 /*
 ===============
-SV_SendConfigstring
+SV_NextConfigstringCommand
 
-Creates and sends the server command necessary to update the CS index for the
-given client
+Creates the next server command necessary to update the CS index, a single
+cs for a short configstring or a bcs0/bcs1/bcs2 series for a long one.
+sent starts at 0 and is advanced past the part covered by the command.
+Returns qfalse once all commands have been created
 ===============
 */
-static void SV_SendConfigstring(client_t *client, int index)
+static qboolean SV_NextConfigstringCommand(int index, int *sent, char *msg, int msgSize)
 {
     int maxChunkSize = MAX_STRING_CHARS - 24;
-    int len;
+    int len, remaining;
+    char    *cmd;
+    char    buf[MAX_STRING_CHARS];
 
     len = strlen(sv.configstrings[index]);
 
-    if( len >= maxChunkSize ) {
-        int     sent = 0;
-        int     remaining = len;
-        char    *cmd;
-        char    buf[MAX_STRING_CHARS];
-
-        while (remaining > 0 ) {
-            if ( sent == 0 ) {
-                cmd = "bcs0";
-            }
-            else if( remaining < maxChunkSize ) {
-                cmd = "bcs2";
-            }
-            else {
-                cmd = "bcs1";
-            }
-            Q_strncpyz( buf, &sv.configstrings[index][sent],
-                maxChunkSize );
-
-            SV_SendServerCommand( client, "%s %i \"%s\"\n", cmd,
-                index, buf );
-
-            sent += (maxChunkSize - 1);
-            remaining -= (maxChunkSize - 1);
+    if( len < maxChunkSize ) {
+        if ( *sent ) {
+            return qfalse;
         }
-    } else {
+
         // standard cs, just send it
-        SV_SendServerCommand( client, "cs %i \"%s\"\n", index,
+        Com_sprintf( msg, msgSize, "cs %i \"%s\"\n", index,
             sv.configstrings[index] );
+        *sent = len + 1;
+        return qtrue;
+    }
+
+    remaining = len - *sent;
+    if ( remaining <= 0 ) {
+        return qfalse;
+    }
+
+    if ( *sent == 0 ) {
+        cmd = "bcs0";
+    }
+    else if( remaining < maxChunkSize ) {
+        cmd = "bcs2";
+    }
+    else {
+        cmd = "bcs1";
+    }
+    Q_strncpyz( buf, &sv.configstrings[index][*sent],
+        maxChunkSize );
+
+    Com_sprintf( msg, msgSize, "%s %i \"%s\"\n", cmd,
+        index, buf );
+
+    *sent += (maxChunkSize - 1);
+    return qtrue;
+}
+
+/*
+===============
+SV_SendConfigstring
+
+Sends the server commands necessary to update the CS index to the
+given client
+===============
+*/
+static void SV_SendConfigstring(client_t *client, int index)
+{
+    char    msg[MAX_STRING_CHARS];
+    int     sent;
+
+    sent = 0;
+    while ( SV_NextConfigstringCommand( index, &sent, msg, sizeof( msg ) ) ) {
+        SV_AddServerCommand( client, msg );
     }
 }
 
@@ -99,14 +126,84 @@ void SV_UpdateConfigstrings(client_t *client)
 
 /*
 ===============
-SV_SetConfigstring
+SV_BroadcastConfigstring
 
+Sends the current value of a configstring to all relevant clients
 ===============
 */
-void SV_SetConfigstring (int index, const char *val) {
-    int     i;
+static void SV_BroadcastConfigstring( int index ) {
+    int         i;
     client_t    *client;
+    reliableCommand_t   *rc;
+    char        msg[MAX_STRING_CHARS];
+    int         sent;
+
+    for (i = 0, client = svs.clients; i < sv_maxclients->integer ; i++, client++) {
+        if ( client->state == CS_PRIMED ) {
+            client->csUpdated[ index ] = qtrue;
+        }
+    }
 
+    // each command is created once and shared by all clients
+    sent = 0;
+    while ( SV_NextConfigstringCommand( index, &sent, msg, sizeof( msg ) ) ) {
+        rc = SV_AllocReliableCommand( msg );
+
+        for (i = 0, client = svs.clients; i < sv_maxclients->integer ; i++, client++) {
+            if ( client->state < CS_ACTIVE ) {
+                continue;
+            }
+            // do not always send server info to all clients
+            if ( index == CS_SERVERINFO && client->gentity && (client->gentity->r.svFlags & SVF_NOSERVERINFO) ) {
+                continue;
+            }
+
+            SV_AddReliableCommand( client, rc );
+        }
+
+        SV_ReleaseReliableCommand( rc );
+    }
+
+    sv.csBroadcasts++;
+}
+
+/*
+===============
+SV_FlushConfigstrings
+
+Broadcasts the final value of every configstring changed since the
+last flush.  Called at the end of each server frame, and before any
+other reliable command is queued so the clients see the updates in
+the same order as the game module made them
+===============
+*/
+void SV_FlushConfigstrings( void ) {
+    int     i, count, index;
+
+    count = sv.numDirtyConfigstrings;
+    if ( !count ) {
+        return;
+    }
+
+    // clear the count first, the broadcast below queues
+    // server commands which would flush again
+    sv.numDirtyConfigstrings = 0;
+
+    for ( i = 0; i < count; i++ ) {
+        index = sv.csDirtyList[i];
+        sv.csDirty[index] = qfalse;
+
+        SV_BroadcastConfigstring( index );
+    }
+}
+
+/*
+===============
+SV_SetConfigstring
+
+===============
+*/
+void SV_SetConfigstring (int index, const char *val) {
     if ( index < 0 || index >= MAX_CONFIGSTRINGS ) {
         Com_Error (ERR_DROP, "SV_SetConfigstring: bad index %i", index);
     }
@@ -124,24 +221,17 @@ void SV_SetConfigstring (int index, const char *val) {
     Z_Free( sv.configstrings[index] );
     sv.configstrings[index] = CopyString( val );
 
-    // send it to all the clients if we aren't
-    // spawning a new server
+    // mark it for broadcasting at the end of the frame
+    // if we aren't spawning a new server, only the
+    // final value set during the frame is sent
     if ( sv.state == SS_GAME || sv.restarting ) {
-
-        // send the data to all relevant clients
-        for (i = 0, client = svs.clients; i < sv_maxclients->integer ; i++, client++) {
-            if ( client->state < CS_ACTIVE ) {
-                if ( client->state == CS_PRIMED )
-                    client->csUpdated[ index ] = qtrue;
-                continue;
-            }
-            // do not always send server info to all clients
-            if ( index == CS_SERVERINFO && client->gentity && (client->gentity->r.svFlags & SVF_NOSERVERINFO) ) {
-                continue;
-            }
-
-            SV_SendConfigstring(client, index);
+        if ( sv.csDirty[index] ) {
+            sv.csSuppressed++;
+            return;
         }
+
+        sv.csDirty[index] = qtrue;
+        sv.csDirtyList[sv.numDirtyConfigstrings++] = index;
     }
 }
 
@@ -167,6 +257,33 @@ void SV_GetConfigstring( int index, char *buffer, int bufferSize ) {
 }
 
 
+/*
+===============
+SV_ConfigstringStats_f
+
+Reports how many configstring updates were coalesced
+===============
+*/
+void SV_ConfigstringStats_f( void ) {
+    int     total;
+
+    // make sure server is running
+    if ( !com_sv_running->integer ) {
+        Com_Printf( "Server is not running.\n" );
+        return;
+    }
+
+    total = sv.csBroadcasts + sv.csSuppressed;
+
+    Com_Printf( "%i configstring updates broadcast\n", sv.csBroadcasts );
+    Com_Printf( "%i configstring updates suppressed", sv.csSuppressed );
+    if ( total ) {
+        Com_Printf( " (%.1f%%)", 100.0f * sv.csSuppressed / total );
+    }
+    Com_Printf( "\n%i configstrings pending\n", sv.numDirtyConfigstrings );
+}
+
+
 /*
 ===============
 SV_SetUserinfo
@@ -276,6 +393,7 @@ static void SV_Startup( void ) {
         // we don't need nearly as many when playing locally
         svs.numSnapshotEntities = sv_maxclients->integer * 4 * MAX_SNAPSHOT_ENTITIES;
     }
+    SV_InitChallenges( &svs.challenges );
     svs.initialized = qtrue;
 
     // Don't respect sv_killserver unless a server is actually running
@@ -330,6 +448,13 @@ void SV_ChangeMaxClients( void ) {
         }
     }
 
+    // release the commands of the clients that aren't kept
+    for ( i = 0 ; i < oldMaxClients ; i++ ) {
+        if ( i >= count || svs.clients[i].state < CS_CONNECTED ) {
+            SV_FreeReliableCommands( &svs.clients[i] );
+        }
+    }
+
     // free old clients arrays
     Z_Free( svs.clients );
 
@@ -516,7 +641,8 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
     sv.checksumFeedServerId = sv.serverId;
     Cvar_Set( "sv_serverid", va("%i", sv.serverId ) );
 
-    // clear physics interaction links
+    // clear physics interaction links, a latched sv_entityGrid takes effect here
+    Cvar_Get ("sv_entityGrid", "0", CVAR_ARCHIVE | CVAR_LATCH);
     SV_ClearWorld ();
 
     // media configstring setting should be done during
@@ -708,6 +834,9 @@ void SV_Init (void)
     sv_mapcycle = Cvar_Get ("sv_mapcycle", "none", CVAR_ARCHIVE);
     sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
     sv_banFile = Cvar_Get("sv_banFile", "serverbans.dat", CVAR_ARCHIVE);
+    sv_traceBatchJobs = Cvar_Get ("sv_traceBatchJobs", "0", CVAR_ARCHIVE);
+    sv_entityGrid = Cvar_Get ("sv_entityGrid", "0", CVAR_ARCHIVE | CVAR_LATCH);
+    sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE);
 
     // initialize bot cvars so they are listed and can be set before loading the botlib
     SV_BotInitCvars();
@@ -786,10 +915,14 @@ void SV_Shutdown( char *finalmsg ) {
         int index;
 
         for(index = 0; index < sv_maxclients->integer; index++)
+        {
             SV_FreeClient(&svs.clients[index]);
+            SV_FreeReliableCommands(&svs.clients[index]);
+        }
 
         Z_Free(svs.clients);
     }
+    SV_Netchan_Shutdown();
     Com_Memset( &svs, 0, sizeof( svs ) );
 
     Cvar_Set( "sv_running", "0" );
@@ -53,6 +53,9 @@ cvar_t  *sv_gametype;
 cvar_t  *sv_pure;
 cvar_t  *sv_floodProtect;
 cvar_t  *sv_mapcycle;
+cvar_t  *sv_traceBatchJobs;     // smallest trace batch that is spread over the job threads
+cvar_t  *sv_entityGrid;         // link entities into a loose grid rather than the sector tree
+cvar_t  *sv_traceCache;         // reuse SV_Trace results until an entity they could touch changes
 cvar_t  *sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
 cvar_t  *sv_banFile;
 
@@ -62,35 +65,299 @@ int serverBansCount = 0;
 /*
 =============================================================================
 
-EVENT MESSAGES
+RELIABLE COMMANDS
 
 =============================================================================
 */
 
+#define RELIABLE_COMMAND_SLOTS  ( MAX_CLIENTS * MAX_RELIABLE_COMMANDS * 2 )   // must be a power of two
+#define RELIABLE_COMMAND_TEXT   ( MAX_CLIENTS * MAX_RELIABLE_COMMANDS * 256 )
+
+// Commands are taken from the head of the ring in sequence, with their text
+// packed after each other in a ring of its own. Both are given back at the
+// tail once nothing references the oldest command any more.
+static reliableCommand_t    reliableCommands[RELIABLE_COMMAND_SLOTS];
+static char                 reliableText[RELIABLE_COMMAND_TEXT];
+static int                  reliableHead;           // sequence of the next command
+static int                  reliableTail;           // sequence of the oldest command that may be referenced
+static int                  reliableTextHead;       // where the text of the next command goes
+
+static qboolean reliableCommandsExhausted;      // dropping a client that ran out of command memory
+
 /*
-===============
-SV_ExpandNewlines
+======================
+SV_ReclaimReliableCommands
 
-Converts newlines to "\n" so a line prints nicer
-===============
+Gives back the oldest commands that aren't referenced any more
+======================
 */
-static char *SV_ExpandNewlines( char *in ) {
-    static  char    string[1024];
-    int     l;
+static void SV_ReclaimReliableCommands( void ) {
+    while ( reliableTail != reliableHead && !reliableCommands[ reliableTail & (RELIABLE_COMMAND_SLOTS-1) ].refCount ) {
+        reliableTail++;
+    }
 
-    l = 0;
-    while ( *in && l < sizeof(string) - 3 ) {
-        if ( *in == '\n' ) {
-            string[l++] = '\\';
-            string[l++] = 'n';
-        } else {
-            string[l++] = *in;
+    if ( reliableTail == reliableHead ) {
+        reliableTextHead = 0;
+    }
+}
+
+/*
+======================
+SV_ReliableCommandSpace
+
+Returns where a command of size bytes would go,
+or NULL if it or the number of slots doesn't fit
+======================
+*/
+static char *SV_ReliableCommandSpace( int size, int slots ) {
+    int     tailText;
+
+    if ( reliableHead - reliableTail > RELIABLE_COMMAND_SLOTS - slots ) {
+        return NULL;
+    }
+
+    if ( reliableHead == reliableTail ) {
+        return size <= RELIABLE_COMMAND_TEXT ? reliableText : NULL;
+    }
+
+    tailText = reliableCommands[ reliableTail & (RELIABLE_COMMAND_SLOTS-1) ].string - reliableText;
+    if ( reliableTextHead > tailText ) {
+        // the free text is at the end and the start of the ring
+        if ( reliableTextHead + size <= RELIABLE_COMMAND_TEXT ) {
+            return reliableText + reliableTextHead;
         }
-        in++;
+        if ( size <= tailText ) {
+            return reliableText;
+        }
+        return NULL;
     }
-    string[l] = 0;
 
-    return string;
+    if ( reliableTextHead + size <= tailText ) {
+        return reliableText + reliableTextHead;
+    }
+    return NULL;
+}
+
+/*
+======================
+SV_StoreReliableCommand
+
+Copies a command to the given space at the head of the ring
+======================
+*/
+static reliableCommand_t *SV_StoreReliableCommand( const char *cmd, int len, char *text ) {
+    reliableCommand_t   *rc;
+
+    rc = &reliableCommands[ reliableHead & (RELIABLE_COMMAND_SLOTS-1) ];
+    reliableHead++;
+
+    rc->refCount = 1;
+    rc->string = text;
+    Com_Memcpy( rc->string, cmd, len );
+    rc->string[len] = 0;
+
+    reliableTextHead = ( text - reliableText ) + len + 1;
+
+    return rc;
+}
+
+/*
+======================
+SV_MoveReliableCommand
+
+Copies a command that holds up the tail of the ring to
+the head, if it is only referenced by client rings
+======================
+*/
+static qboolean SV_MoveReliableCommand( reliableCommand_t *rc ) {
+    reliableCommand_t   *moved;
+    client_t            *client;
+    char                *text;
+    int                 i, j, len, refs;
+
+    refs = 0;
+    for ( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
+        for ( j = 0; j < MAX_RELIABLE_COMMANDS; j++ ) {
+            if ( client->reliableCommands[j] == rc ) {
+                refs++;
+            }
+        }
+    }
+    if ( refs != rc->refCount ) {
+        return qfalse;
+    }
+
+    len = strlen( rc->string );
+    text = SV_ReliableCommandSpace( len + 1, 1 );
+    if ( !text ) {
+        return qfalse;
+    }
+
+    moved = SV_StoreReliableCommand( rc->string, len, text );
+    moved->refCount = rc->refCount;
+    rc->refCount = 0;
+
+    for ( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
+        for ( j = 0; j < MAX_RELIABLE_COMMANDS; j++ ) {
+            if ( client->reliableCommands[j] == rc ) {
+                client->reliableCommands[j] = moved;
+            }
+        }
+    }
+
+    return qtrue;
+}
+
+/*
+======================
+SV_CompactReliableCommands
+
+Moves the commands that are still referenced from the tail
+of the ring to the head until size bytes fit, so a client
+that keeps an old command doesn't hold up the whole ring
+======================
+*/
+static void SV_CompactReliableCommands( int size ) {
+    int     stop;
+
+    // don't move anything twice
+    stop = reliableHead;
+    while ( stop - reliableTail > 0 && !SV_ReliableCommandSpace( size, 2 ) ) {
+        if ( !SV_MoveReliableCommand( &reliableCommands[ reliableTail & (RELIABLE_COMMAND_SLOTS-1) ] ) ) {
+            break;
+        }
+        SV_ReclaimReliableCommands();
+    }
+}
+
+/*
+======================
+SV_DropReliableCommandLagger
+
+Drops the client furthest behind on its commands to
+make room for more, returns qfalse if there is none
+======================
+*/
+static qboolean SV_DropReliableCommandLagger( void ) {
+    client_t    *client, *lagger;
+    int         i, ack;
+
+    lagger = NULL;
+    for ( i = 0, client = svs.clients; i < sv_maxclients->integer; i++, client++ ) {
+        if ( client->state < CS_PRIMED ) {
+            continue;
+        }
+        if ( !lagger || client->reliableSequence - client->reliableAcknowledge > lagger->reliableSequence - lagger->reliableAcknowledge ) {
+            lagger = client;
+        }
+    }
+    if ( !lagger ) {
+        return qfalse;
+    }
+
+    // keep the acknowledged command, the netchan still encodes with it
+    ack = lagger->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1);
+    for ( i = 0; i < MAX_RELIABLE_COMMANDS; i++ ) {
+        if ( i != ack ) {
+            SV_ReleaseReliableCommand( lagger->reliableCommands[i] );
+            lagger->reliableCommands[i] = NULL;
+        }
+    }
+    SV_ReclaimReliableCommands();
+
+    reliableCommandsExhausted = qtrue;
+    Com_Printf( S_COLOR_YELLOW "WARNING: out of memory for server commands, dropping %s\n", lagger->name );
+    SV_DropClient( lagger, "Server command overflow" );
+    reliableCommandsExhausted = qfalse;
+
+    return qtrue;
+}
+
+/*
+======================
+SV_AllocReliableCommand
+
+Copies a command into the shared ring, the caller owns the first
+reference. Returns NULL if there isn't enough room left for it
+======================
+*/
+reliableCommand_t *SV_AllocReliableCommand( const char *cmd ) {
+    char    *text;
+    int     len;
+
+    len = strlen( cmd );
+    if ( len > MAX_STRING_CHARS - 1 ) {
+        len = MAX_STRING_CHARS - 1;
+    }
+
+    // leave room for moving an old command out of the way
+    SV_ReclaimReliableCommands();
+    text = SV_ReliableCommandSpace( len + 1 + MAX_STRING_CHARS, 2 );
+    if ( !text ) {
+        SV_CompactReliableCommands( len + 1 + MAX_STRING_CHARS );
+        text = SV_ReliableCommandSpace( len + 1 + MAX_STRING_CHARS, 2 );
+    }
+
+    while ( !text && !reliableCommandsExhausted && SV_DropReliableCommandLagger() ) {
+        SV_CompactReliableCommands( len + 1 + MAX_STRING_CHARS );
+        text = SV_ReliableCommandSpace( len + 1 + MAX_STRING_CHARS, 2 );
+    }
+
+    // the commands of a drop may use up what was left
+    if ( !text ) {
+        text = SV_ReliableCommandSpace( len + 1, 1 );
+        if ( !text ) {
+            return NULL;
+        }
+    }
+
+    return SV_StoreReliableCommand( cmd, len, text );
+}
+
+/*
+======================
+SV_ReleaseReliableCommand
+======================
+*/
+void SV_ReleaseReliableCommand( reliableCommand_t *rc ) {
+    if ( !rc ) {
+        return;
+    }
+
+    // given back to the ring once it reaches the tail
+    rc->refCount--;
+}
+
+/*
+======================
+SV_FreeReliableCommands
+
+Releases all commands referenced by a client's ring,
+before the client structure is reinitialized or freed
+======================
+*/
+void SV_FreeReliableCommands( client_t *client ) {
+    int     i;
+
+    for ( i = 0; i < MAX_RELIABLE_COMMANDS; i++ ) {
+        SV_ReleaseReliableCommand( client->reliableCommands[i] );
+        client->reliableCommands[i] = NULL;
+    }
+}
+
+/*
+======================
+SV_ReliableCommand
+
+Returns the command string stored for the given reliable sequence
+======================
+*/
+const char *SV_ReliableCommand( client_t *client, int sequence ) {
+    reliableCommand_t   *rc;
+
+    rc = client->reliableCommands[ sequence & (MAX_RELIABLE_COMMANDS-1) ];
+
+    return rc ? rc->string : "";
 }
 
 /*
@@ -107,11 +374,12 @@ static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd )
     for ( i = client->reliableSent+1; i <= client->reliableSequence; i++ ) {
         index = i & ( MAX_RELIABLE_COMMANDS - 1 );
         //
-        if ( !Q_strncmp(cmd, client->reliableCommands[ index ], strlen("cs")) ) {
+        if ( !Q_strncmp(cmd, SV_ReliableCommand( client, i ), strlen("cs")) ) {
             sscanf(cmd, "cs %i", &csnum1);
-            sscanf(client->reliableCommands[ index ], "cs %i", &csnum2);
+            sscanf(SV_ReliableCommand( client, i ), "cs %i", &csnum2);
             if ( csnum1 == csnum2 ) {
-                Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+                SV_ReleaseReliableCommand( client->reliableCommands[ index ] );
+                client->reliableCommands[ index ] = SV_AllocReliableCommand( cmd );
                 /*
                 if ( client->netchan.remoteAddress.type != NA_BOT ) {
                     Com_Printf( "WARNING: client %i removed double pending config string %i: %s\n", client-svs.clients, csnum1, cmd );
@@ -125,15 +393,50 @@ static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd )
 }
 #endif
 
+/*
+=============================================================================
+
+EVENT MESSAGES
+
+=============================================================================
+*/
+
+/*
+===============
+SV_ExpandNewlines
+
+Converts newlines to "\n" so a line prints nicer
+===============
+*/
+static char *SV_ExpandNewlines( char *in ) {
+    static  char    string[1024];
+    int     l;
+
+    l = 0;
+    while ( *in && l < sizeof(string) - 3 ) {
+        if ( *in == '\n' ) {
+            string[l++] = '\\';
+            string[l++] = 'n';
+        } else {
+            string[l++] = *in;
+        }
+        in++;
+    }
+    string[l] = 0;
+
+    return string;
+}
+
 /*
 ======================
-SV_AddServerCommand
+SV_AddReliableCommand
 
-The given command will be transmitted to the client, and is guaranteed to
-not have future snapshot_t executed before it is executed
+Adds a reference to a stored command to the client's ring.
+A NULL command couldn't be stored, the client is dropped as
+it would miss it otherwise
 ======================
 */
-void SV_AddServerCommand( client_t *client, const char *cmd ) {
+void SV_AddReliableCommand( client_t *client, reliableCommand_t *cmd ) {
     int     index, i;
 
     // this is very ugly but it's also a waste to for instance send multiple config string updates
@@ -142,10 +445,28 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 //      return;
 //  }
 
+    // configstring updates queued before this command must reach the client first
+    if ( sv.numDirtyConfigstrings ) {
+        SV_FlushConfigstrings();
+    }
+
     // do not send commands until the gamestate has been sent
     if( client->state < CS_PRIMED )
         return;
 
+    if ( !cmd ) {
+        // the commands of the drop itself won't fit either
+        if ( reliableCommandsExhausted ) {
+            return;
+        }
+
+        reliableCommandsExhausted = qtrue;
+        Com_Printf( S_COLOR_YELLOW "WARNING: out of memory for server commands, dropping %s\n", client->name );
+        SV_DropClient( client, "Server command overflow" );
+        reliableCommandsExhausted = qfalse;
+        return;
+    }
+
     client->reliableSequence++;
     // if we would be losing an old command that hasn't been acknowledged,
     // we must drop the connection
@@ -154,14 +475,33 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
     if ( client->reliableSequence - client->reliableAcknowledge == MAX_RELIABLE_COMMANDS + 1 ) {
         Com_Printf( "===== pending server commands =====\n" );
         for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
-            Com_Printf( "cmd %5d: %s\n", i, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+            Com_Printf( "cmd %5d: %s\n", i, SV_ReliableCommand( client, i ) );
         }
-        Com_Printf( "cmd %5d: %s\n", i, cmd );
+        Com_Printf( "cmd %5d: %s\n", i, cmd->string );
         SV_DropClient( client, "Server command overflow" );
         return;
     }
     index = client->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
-    Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
+
+    cmd->refCount++;
+    SV_ReleaseReliableCommand( client->reliableCommands[ index ] );
+    client->reliableCommands[ index ] = cmd;
+}
+
+/*
+======================
+SV_AddServerCommand
+
+The given command will be transmitted to the client, and is guaranteed to
+not have future snapshot_t executed before it is executed
+======================
+*/
+void SV_AddServerCommand( client_t *client, const char *cmd ) {
+    reliableCommand_t   *rc;
+
+    rc = SV_AllocReliableCommand( cmd );
+    SV_AddReliableCommand( client, rc );
+    SV_ReleaseReliableCommand( rc );
 }
 
 
@@ -178,6 +518,7 @@ void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...) {
     va_list     argptr;
     byte        message[MAX_MSGLEN];
     client_t    *client;
+    reliableCommand_t   *rc;
     int         j;
 
     va_start (argptr,fmt);
@@ -202,10 +543,12 @@ void QDECL SV_SendServerCommand(client_t *cl, const char *fmt, ...) {
         Com_Printf ("broadcast: %s\n", SV_ExpandNewlines((char *)message) );
     }
 
-    // send the data to all relevant clients
+    // store the command once and reference it from all relevant clients
+    rc = SV_AllocReliableCommand( (char *)message );
     for (j = 0, client = svs.clients; j < sv_maxclients->integer ; j++, client++) {
-        SV_AddServerCommand( client, (char *)message );
+        SV_AddReliableCommand( client, rc );
     }
+    SV_ReleaseReliableCommand( rc );
 }
 
 
@@ -217,6 +560,47 @@ MASTER SERVER FUNCTIONS
 ==============================================================================
 */
 
+/*
+================
+SV_ResolveMasterAddress
+
+Looks the master's name up through the resolver cache, this never blocks.
+Returns qfalse while the first lookup for the name is still pending.
+================
+*/
+static qboolean SV_ResolveMasterAddress(int master, netadr_t *adr, qboolean *known, netadrtype_t family)
+{
+    netadr_t    resolved;
+    int         res;
+
+    res = NET_StringToAdrAsync(sv_master[master]->string, &resolved, family);
+
+    if(res < 0)
+        return qfalse;
+
+    if(res == 2)
+    {
+        // if no port was specified, use the default master port
+        resolved.port = BigShort(PORT_MASTER);
+    }
+    else if(!res)
+        resolved.type = NA_BAD;
+
+    // the cache is asked on every heartbeat, only report what changed
+    if(!*known || resolved.type != adr->type || (res && !NET_CompareAdr(resolved, *adr)))
+    {
+        if(res)
+            Com_Printf( "%s resolved to %s\n", sv_master[master]->string, NET_AdrToStringwPort(resolved));
+        else
+            Com_Printf( "%s has no %s address.\n", sv_master[master]->string, family == NA_IP6 ? "IPv6" : "IPv4");
+    }
+
+    *adr = resolved;
+    *known = qtrue;
+
+    return qtrue;
+}
+
 /*
 ================
 SV_MasterHeartbeat
@@ -227,20 +611,26 @@ We will also have a heartbeat sent when a server
 changes from empty to non-empty, and full to non-full,
 but not on every player enter or exit.
 
+Master names are resolved on the resolver thread, a heartbeat
+stays pending and is retried every frame until its lookup is done.
+The cached addresses are refreshed in the background after
+net_resolveTTL seconds.
+
 When the server shuts down, a heartbeat is sent twice
 to the master servers configured. If this server is
 the legacy master server (the official SoF2 master server),
-the appropriate replacement command is sent.
+the appropriate replacement command is sent. Masters that
+have not been resolved yet are skipped then.
 ================
 */
 #define HEARTBEAT_MSEC  300*1000
-#define MASTERDNS_MSEC  24*60*60*1000
 void SV_MasterHeartbeat(const char *message, qboolean shutdown)
 {
     static netadr_t adr[MAX_MASTER_SERVERS][2]; // [2] for v4 and v6 address for the same address string.
+    static qboolean known[MAX_MASTER_SERVERS][2];
     int         i;
-    int         res;
     int         netenabled;
+    qboolean    resolving;
     char        *command;
 
     netenabled = Cvar_VariableIntegerValue("net_enabled");
@@ -249,59 +639,48 @@ void SV_MasterHeartbeat(const char *message, qboolean shutdown)
     if (!com_dedicated || com_dedicated->integer != 2 || !(netenabled & (NET_ENABLEV4 | NET_ENABLEV6)))
         return;     // only dedicated servers send heartbeats
 
-    // if not time yet, don't send anything
-    if ( svs.time < svs.nextHeartbeatTime )
-        return;
+    // start a new round of heartbeats when it's time
+    if ( svs.time >= svs.nextHeartbeatTime )
+    {
+        svs.nextHeartbeatTime = svs.time + HEARTBEAT_MSEC;
 
-    svs.nextHeartbeatTime = svs.time + HEARTBEAT_MSEC;
+        for (i = 0; i < MAX_MASTER_SERVERS; i++)
+            svs.masterHeartbeatPending[i] = qtrue;
+    }
 
     // send to group masters
     for (i = 0; i < MAX_MASTER_SERVERS; i++)
     {
+        if(!svs.masterHeartbeatPending[i])
+            continue;
+
         if(!sv_master[i]->string[0])
+        {
+            svs.masterHeartbeatPending[i] = qfalse;
             continue;
+        }
 
-        // see if we haven't already resolved the name or if it's been over 24 hours
-        // resolving usually causes hitches on win95, so only do it when needed
-        if (sv_master[i]->modified || svs.time > svs.masterResolveTime[i])
+        // forget the old addresses when the name changes
+        if(sv_master[i]->modified)
         {
             sv_master[i]->modified = qfalse;
-            svs.masterResolveTime[i] = svs.time + MASTERDNS_MSEC;
-
-            if(netenabled & NET_ENABLEV4)
-            {
-                Com_Printf("Resolving %s (IPv4)\n", sv_master[i]->string);
-                res = NET_StringToAdr(sv_master[i]->string, &adr[i][0], NA_IP);
+            Com_Memset(adr[i], 0, sizeof(adr[i]));
+            known[i][0] = known[i][1] = qfalse;
+        }
 
-                if(res == 2)
-                {
-                    // if no port was specified, use the default master port
-                    adr[i][0].port = BigShort(PORT_MASTER);
-                }
+        resolving = qfalse;
 
-                if(res)
-                    Com_Printf( "%s resolved to %s\n", sv_master[i]->string, NET_AdrToStringwPort(adr[i][0]));
-                else
-                    Com_Printf( "%s has no IPv4 address.\n", sv_master[i]->string);
-            }
+        if((netenabled & NET_ENABLEV4) && !SV_ResolveMasterAddress(i, &adr[i][0], &known[i][0], NA_IP))
+            resolving = qtrue;
 
-            if(netenabled & NET_ENABLEV6)
-            {
-                Com_Printf("Resolving %s (IPv6)\n", sv_master[i]->string);
-                res = NET_StringToAdr(sv_master[i]->string, &adr[i][1], NA_IP6);
+        if((netenabled & NET_ENABLEV6) && !SV_ResolveMasterAddress(i, &adr[i][1], &known[i][1], NA_IP6))
+            resolving = qtrue;
 
-                if(res == 2)
-                {
-                    // if no port was specified, use the default master port
-                    adr[i][1].port = BigShort(PORT_MASTER);
-                }
+        // try again next frame, unless we're going down
+        if(resolving && !shutdown)
+            continue;
 
-                if(res)
-                    Com_Printf( "%s resolved to %s\n", sv_master[i]->string, NET_AdrToStringwPort(adr[i][1]));
-                else
-                    Com_Printf( "%s has no IPv6 address.\n", sv_master[i]->string);
-            }
-        }
+        svs.masterHeartbeatPending[i] = qfalse;
 
         if(adr[i][0].type == NA_BAD && adr[i][1].type == NA_BAD)
         {
@@ -961,6 +1340,7 @@ static void SV_CheckTimeouts( void ) {
             // using the client id cause the cl->name is empty at this point
             Com_DPrintf( "Going from CS_ZOMBIE to CS_FREE for client %d\n", i );
             cl->state = CS_FREE;    // can now be reused
+            SV_FreeReliableCommands( cl );
             continue;
         }
         if ( cl->state >= CS_CONNECTED && cl->lastPacketTime < droppoint) {
@@ -969,6 +1349,7 @@ static void SV_CheckTimeouts( void ) {
             if ( ++cl->timeoutCount > 5 ) {
                 SV_DropClient (cl, "timed out");
                 cl->state = CS_FREE;    // don't bother with zombie state
+                SV_FreeReliableCommands( cl );
             }
         } else {
             cl->timeoutCount = 0;
@@ -1136,9 +1517,15 @@ void SV_Frame( int msec ) {
         sv.time += frameMsec;
 
         // let everything in the world think and move
+        SV_InvalidateTraceCache();
         VM_Call (gvm, GAME_RUN_FRAME, sv.time);
     }
 
+    if ( com_showtrace->integer ) {
+        SV_TraceCacheStats();
+        G2API_CollisionStats();
+    }
+
     if ( com_speeds->integer ) {
         time_game = Sys_Milliseconds () - startTime;
     }
@@ -1146,6 +1533,9 @@ void SV_Frame( int msec ) {
     // check timeouts
     SV_CheckTimeouts();
 
+    // broadcast the configstrings changed during this frame
+    SV_FlushConfigstrings();
+
     // send messages back to the clients
     SV_SendClientMessages();
 
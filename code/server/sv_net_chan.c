@@ -109,7 +109,7 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
     msg->bit = sbit;
     msg->readcount = srdc;
 
-    string = (byte *)client->reliableCommands[ reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ];
+    string = (byte *)SV_ReliableCommand( client, reliableAcknowledge );
     index = 0;
     //
     key = client->challenge ^ serverId ^ messageAcknowledge;
@@ -129,6 +129,8 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
     }
 }
 
+static packetPool_t sv_netchanQueuePool;
+
 /*
 =================
 SV_Netchan_FreeQueue
@@ -141,13 +143,25 @@ void SV_Netchan_FreeQueue(client_t *client)
     for(netbuf = client->netchan_start_queue; netbuf; netbuf = next)
     {
         next = netbuf->next;
-        Z_Free(netbuf);
+        NET_PacketPoolFree(&sv_netchanQueuePool, netbuf);
     }
 
     client->netchan_start_queue = NULL;
     client->netchan_end_queue = &client->netchan_start_queue;
 }
 
+/*
+=================
+SV_Netchan_Shutdown
+
+Frees the queue pool once every client's queue has been freed
+=================
+*/
+void SV_Netchan_Shutdown(void)
+{
+    NET_ShutdownPacketPool(&sv_netchanQueuePool);
+}
+
 /*
 =================
 SV_Netchan_TransmitNextInQueue
@@ -173,7 +187,7 @@ void SV_Netchan_TransmitNextInQueue(client_t *client)
     else
         Com_DPrintf("#462 Netchan_TransmitNextFragment: remaining queued message\n");
 
-    Z_Free(netbuf);
+    NET_PacketPoolFree(&sv_netchanQueuePool, netbuf);
 }
 
 /*
@@ -219,12 +233,36 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 
     if(client->netchan.unsentFragments || client->netchan_start_queue)
     {
+        static const int slotSizes[] = { 2048, 4096, MAX_MSGLEN };
+        static const int numSlots[] = { 256, 128, 64 };
         netchan_buffer_t *netbuf;
+        int i;
+
         Com_DPrintf("#462 SV_Netchan_Transmit: unsent fragments, stacked\n");
-        netbuf = (netchan_buffer_t *) Z_Malloc(sizeof(netchan_buffer_t));
+
+        if(!sv_netchanQueuePool.numSlabs)
+        {
+            int sizes[ARRAY_LEN(slotSizes)];
+
+            // reserve room for the buffer header in every slot
+            for(i = 0; i < ARRAY_LEN(slotSizes); i++)
+                sizes[i] = offsetof(netchan_buffer_t, msgBuffer) + slotSizes[i];
+
+            NET_InitPacketPool(&sv_netchanQueuePool, "netchan fragment queue", sizes, numSlots, ARRAY_LEN(slotSizes));
+        }
+
+        netbuf = NET_PacketPoolAlloc(&sv_netchanQueuePool, offsetof(netchan_buffer_t, msgBuffer) + msg->cursize);
+        if(!netbuf)
+        {
+            // an unreliable snapshot is simply lost, a gamestate
+            // is sent again when the client acknowledges a later message
+            Com_Printf(S_COLOR_YELLOW "WARNING: netchan queue full, dropped a message for %s\n", client->name);
+            return;
+        }
 
         // store the msg, we can't store it encoded, as the encoding depends on stuff we still have to finish sending
-        MSG_Copy(&netbuf->msg, netbuf->msgBuffer, sizeof( netbuf->msgBuffer ), msg);
+        MSG_Copy(&netbuf->msg, netbuf->msgBuffer, msg->cursize, msg);
+        netbuf->msg.maxsize = msg->cursize;
         Q_strncpyz(netbuf->clientCommandString, client->lastClientCommandString,
                    sizeof(netbuf->clientCommandString));
 
@@ -218,11 +218,14 @@ SV_UpdateServerCommandsToClient
 void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
     int     i;
 
+    // make sure pending configstring updates go out with this message
+    SV_FlushConfigstrings();
+
     // write any unacknowledged serverCommands
     for ( i = client->reliableAcknowledge + 1 ; i <= client->reliableSequence ; i++ ) {
         MSG_WriteByte( msg, svc_serverCommand );
         MSG_WriteLong( msg, i );
-        MSG_WriteString( msg, client->reliableCommands[ i & (MAX_RELIABLE_COMMANDS-1) ] );
+        MSG_WriteString( msg, SV_ReliableCommand( client, i ) );
     }
     client->reliableSent = client->reliableSequence;
 }
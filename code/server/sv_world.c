@@ -23,6 +23,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "server.h"
 
+#if idx64
+#include <emmintrin.h>
+#endif
+
 /*
 ================
 SV_ClipHandleForEntity
@@ -58,6 +62,22 @@ the world is carved up with an evenly spaced, axially aligned bsp tree.  Entitie
 are kept in chains either at the final leafs, or at the first node that splits
 them, which prevents having to deal with multiple fragments of a single entity.
 
+With sv_entityGrid set, a loose grid over the world's x and y is used instead.
+Entities are kept in the cell that holds the center of their box, and may
+stick out of it by up to half a cell, so a query only has to look at the
+cells its box touches after being grown by half a cell. Entities too big for
+that go on a separate list that every query checks. The cells are resized
+as more entities get linked, aiming for a few entities per cell, so big open
+maps don't end up with hundreds of entities in a handful of sectors.
+
+Either way, an entity's worldSector is the sector or cell it is linked into.
+Each keeps the numbers of its entities in link order, along with a copy of
+their boxes laid out one array per axis, and of their contents and owners.
+Queries test those copies four at a time and never touch the game's
+entities, which are spread sv.gentitySize bytes apart. Like the box, the
+contents and owner an entity is clipped with are the ones it had when it
+was last linked.
+
 ===============================================================================
 */
 
@@ -65,15 +85,186 @@ typedef struct worldSector_s {
     int     axis;       // -1 = leaf node
     float   dist;
     struct worldSector_s    *children[2];
-    svEntity_t  *entities;
+
+    int     numEntities, maxEntities;
+    int     *entityNums;        // oldest first, queries return the newest first
+    int     *contents;          // r.contents of each entity
+    int     *owners;            // r.ownerNum of each entity
+    float   *bounds[6];         // absmin x y z, absmax x y z of each entity, unused
+                                // slots hold an empty box so queries can test whole groups of four
 } worldSector_t;
 
+#define SECTOR_MIN_ENTITIES 8   // keep a multiple of four
+#define SECTOR_EMPTY_BOUND  1e30f
+
 #define AREA_DEPTH  4
 #define AREA_NODES  64
 
 worldSector_t   sv_worldSectors[AREA_NODES];
 int         sv_numworldSectors;
 
+#define GRID_DENSITY        4       // linked entities per cell the grid is sized for
+#define GRID_MIN_CELLS      64
+#define GRID_MAX_CELLS      16384
+#define GRID_MIN_CELL_SIZE  64
+
+typedef struct {
+    qboolean        active;         // use the grid instead of sv_worldSectors
+    vec3_t          mins, maxs;     // world bounds, only x and y are gridded
+    float           cellSize;
+    int             size[2];        // cells along x and y
+    worldSector_t   *cells;         // size[0] * size[1], row by row
+    worldSector_t   large;          // entities too big for their cell
+    int             sizedFor;       // number of linked entities the cells were sized for
+} worldGrid_t;
+
+static worldGrid_t  sv_worldGrid;
+static int          sv_numLinkedEntities;
+static int          sv_areaEntityChecks;    // entities looked at by area queries, for areabench
+
+/*
+===============
+SV_SectorClearSlot
+===============
+*/
+static void SV_SectorClearSlot( worldSector_t *sec, int n ) {
+    int     i;
+
+    for ( i = 0 ; i < 3 ; i++ ) {
+        sec->bounds[i][n] = SECTOR_EMPTY_BOUND;
+        sec->bounds[i + 3][n] = -SECTOR_EMPTY_BOUND;
+    }
+    sec->contents[n] = 0;
+    sec->owners[n] = ENTITYNUM_NONE;
+}
+
+/*
+===============
+SV_SectorAddEntity
+===============
+*/
+static void SV_SectorAddEntity( worldSector_t *sec, int entityNum, const vec3_t absmin, const vec3_t absmax, int contents, int ownerNum ) {
+    int     *entityNums;
+    float   *bounds;
+    int     maxEntities;
+    int     i, n;
+
+    if ( sec->numEntities == sec->maxEntities ) {
+        maxEntities = sec->maxEntities ? sec->maxEntities * 2 : SECTOR_MIN_ENTITIES;
+        entityNums = Z_Malloc( maxEntities * ( 3 * sizeof( *entityNums ) + 6 * sizeof( *bounds ) ) );
+        bounds = (float *)( entityNums + 3 * maxEntities );
+
+        if ( sec->entityNums ) {
+            Com_Memcpy( entityNums, sec->entityNums, sec->numEntities * sizeof( *entityNums ) );
+            Com_Memcpy( entityNums + maxEntities, sec->contents, sec->numEntities * sizeof( *entityNums ) );
+            Com_Memcpy( entityNums + 2 * maxEntities, sec->owners, sec->numEntities * sizeof( *entityNums ) );
+            for ( i = 0 ; i < 6 ; i++ ) {
+                Com_Memcpy( bounds + i * maxEntities, sec->bounds[i], sec->numEntities * sizeof( *bounds ) );
+            }
+            Z_Free( sec->entityNums );
+        }
+
+        sec->entityNums = entityNums;
+        sec->contents = entityNums + maxEntities;
+        sec->owners = entityNums + 2 * maxEntities;
+        for ( i = 0 ; i < 6 ; i++ ) {
+            sec->bounds[i] = bounds + i * maxEntities;
+        }
+        sec->maxEntities = maxEntities;
+
+        for ( n = sec->numEntities ; n < maxEntities ; n++ ) {
+            SV_SectorClearSlot( sec, n );
+        }
+    }
+
+    n = sec->numEntities++;
+    sec->entityNums[n] = entityNum;
+    sec->contents[n] = contents;
+    sec->owners[n] = ownerNum;
+    for ( i = 0 ; i < 3 ; i++ ) {
+        sec->bounds[i][n] = absmin[i];
+        sec->bounds[i + 3][n] = absmax[i];
+    }
+}
+
+/*
+===============
+SV_SectorRemoveEntity
+
+Keeps the others in order, so queries return
+them in the same order as before.
+===============
+*/
+static qboolean SV_SectorRemoveEntity( worldSector_t *sec, int entityNum ) {
+    int     i, n, count;
+
+    for ( n = sec->numEntities - 1 ; n >= 0 ; n-- ) {
+        if ( sec->entityNums[n] == entityNum ) {
+            break;
+        }
+    }
+
+    if ( n < 0 ) {
+        return qfalse;
+    }
+
+    count = sec->numEntities - n - 1;
+    memmove( sec->entityNums + n, sec->entityNums + n + 1, count * sizeof( *sec->entityNums ) );
+    memmove( sec->contents + n, sec->contents + n + 1, count * sizeof( *sec->contents ) );
+    memmove( sec->owners + n, sec->owners + n + 1, count * sizeof( *sec->owners ) );
+    for ( i = 0 ; i < 6 ; i++ ) {
+        memmove( sec->bounds[i] + n, sec->bounds[i] + n + 1, count * sizeof( *sec->bounds[i] ) );
+    }
+    sec->numEntities--;
+    SV_SectorClearSlot( sec, sec->numEntities );
+
+    return qtrue;
+}
+
+/*
+===============
+SV_SectorFree
+===============
+*/
+static void SV_SectorFree( worldSector_t *sec ) {
+    if ( sec->entityNums ) {
+        Z_Free( sec->entityNums );
+    }
+    sec->entityNums = NULL;
+    sec->contents = sec->owners = NULL;
+    sec->numEntities = sec->maxEntities = 0;
+}
+
+/*
+===============
+SV_FreeWorldGrid
+===============
+*/
+static void SV_FreeWorldGrid( void ) {
+    int     i;
+
+    if ( sv_worldGrid.cells ) {
+        for ( i = 0 ; i < sv_worldGrid.size[0] * sv_worldGrid.size[1] ; i++ ) {
+            SV_SectorFree( &sv_worldGrid.cells[i] );
+        }
+        Z_Free( sv_worldGrid.cells );
+        sv_worldGrid.cells = NULL;
+    }
+    SV_SectorFree( &sv_worldGrid.large );
+}
+
+/*
+===============
+SV_LinkStats
+===============
+*/
+static void SV_LinkStats( void ) {
+    int     total;
+
+    total = sv.linksFull + sv.linksReused;
+    Com_Printf( "%i links since the map started, %i walked the BSP, %i kept their leafs (%.1f%%)\n",
+        total, sv.linksFull, sv.linksReused, total ? 100.0f * sv.linksReused / total : 0.0f );
+}
 
 /*
 ===============
@@ -81,19 +272,57 @@ SV_SectorList_f
 ===============
 */
 void SV_SectorList_f( void ) {
-    int             i, c;
+    int             i, c, total;
+    int             used, most, interior;
     worldSector_t   *sec;
-    svEntity_t      *ent;
 
-    for ( i = 0 ; i < AREA_NODES ; i++ ) {
-        sec = &sv_worldSectors[i];
+    if ( sv_worldGrid.active ) {
+        total = sv_worldGrid.size[0] * sv_worldGrid.size[1];
+        used = most = 0;
 
-        c = 0;
-        for ( ent = sec->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
-            c++;
+        for ( i = 0 ; i < total ; i++ ) {
+            c = sv_worldGrid.cells[i].numEntities;
+            if ( c ) {
+                used++;
+                Com_Printf( "cell %i %i: %i entities\n", i % sv_worldGrid.size[0], i / sv_worldGrid.size[0], c );
+            }
+            if ( c > most ) {
+                most = c;
+            }
         }
+
+        c = sv_worldGrid.large.numEntities;
+
+        Com_Printf( "grid: %i x %i cells of %.0f units, sized for %i entities\n",
+            sv_worldGrid.size[0], sv_worldGrid.size[1], sv_worldGrid.cellSize, sv_worldGrid.sizedFor );
+        Com_Printf( "%i linked entities, %i of %i cells used, %.1f per used cell, %i at most, %i too big for a cell\n",
+            sv_numLinkedEntities, used, total, used ? (float)( sv_numLinkedEntities - c ) / used : 0.0f, most, c );
+        SV_LinkStats();
+        return;
+    }
+
+    used = most = interior = 0;
+
+    for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
+        sec = &sv_worldSectors[i];
+
+        c = sec->numEntities;
         Com_Printf( "sector %i: %i entities\n", i, c );
+
+        if ( c ) {
+            used++;
+        }
+        if ( c > most ) {
+            most = c;
+        }
+        if ( sec->axis != -1 ) {
+            interior += c;
+        }
     }
+
+    Com_Printf( "sectors: %i linked entities, %i of %i sectors used, %i at most, %i on split planes\n",
+        sv_numLinkedEntities, used, sv_numworldSectors, most, interior );
+    SV_LinkStats();
 }
 
 /*
@@ -138,6 +367,192 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
     return anode;
 }
 
+/*
+===============
+SV_GridCoord
+
+The cell along axis that holds v, clamped to the grid so that
+entities outside the world bounds end up in the border cells.
+===============
+*/
+static int SV_GridCoord( float v, int axis ) {
+    int     c;
+
+    c = (int)floor( ( v - sv_worldGrid.mins[axis] ) / sv_worldGrid.cellSize );
+    if ( c < 0 ) {
+        return 0;
+    }
+    if ( c >= sv_worldGrid.size[axis] ) {
+        return sv_worldGrid.size[axis] - 1;
+    }
+    return c;
+}
+
+/*
+===============
+SV_SectorForEntity
+
+Finds the chain an entity with the given absolute box belongs in.
+===============
+*/
+static worldSector_t *SV_SectorForEntity( const vec3_t absmin, const vec3_t absmax ) {
+    worldSector_t   *node;
+    int             x, y;
+
+    if ( sv_worldGrid.active ) {
+        if ( absmax[0] - absmin[0] > sv_worldGrid.cellSize
+            || absmax[1] - absmin[1] > sv_worldGrid.cellSize ) {
+            return &sv_worldGrid.large;
+        }
+
+        x = SV_GridCoord( absmin[0] + 0.5f * ( absmax[0] - absmin[0] ), 0 );
+        y = SV_GridCoord( absmin[1] + 0.5f * ( absmax[1] - absmin[1] ), 1 );
+
+        return &sv_worldGrid.cells[y * sv_worldGrid.size[0] + x];
+    }
+
+    // find the first world sector node that the ent's box crosses
+    node = sv_worldSectors;
+    while (1)
+    {
+        if (node->axis == -1)
+            break;
+        if ( absmin[node->axis] > node->dist)
+            node = node->children[0];
+        else if ( absmax[node->axis] < node->dist)
+            node = node->children[1];
+        else
+            break;      // crosses the node
+    }
+
+    return node;
+}
+
+/*
+===============
+SV_SizeWorldGrid
+
+Sizes the grid cells for numEntities linked entities.
+===============
+*/
+static void SV_SizeWorldGrid( int numEntities ) {
+    float   area, width, height;
+    int     numCells;
+
+    // the cells must be empty by now
+    SV_FreeWorldGrid();
+
+    width = sv_worldGrid.maxs[0] - sv_worldGrid.mins[0];
+    height = sv_worldGrid.maxs[1] - sv_worldGrid.mins[1];
+    if ( width < 1 ) {
+        width = 1;
+    }
+    if ( height < 1 ) {
+        height = 1;
+    }
+    area = width * height;
+
+    numCells = numEntities / GRID_DENSITY;
+    if ( numCells < GRID_MIN_CELLS ) {
+        numCells = GRID_MIN_CELLS;
+    }
+    if ( numCells > GRID_MAX_CELLS ) {
+        numCells = GRID_MAX_CELLS;
+    }
+
+    sv_worldGrid.cellSize = sqrt( area / numCells );
+    if ( sv_worldGrid.cellSize < GRID_MIN_CELL_SIZE ) {
+        sv_worldGrid.cellSize = GRID_MIN_CELL_SIZE;
+    }
+
+    // a long thin map still can't get more cells than it was sized for
+    sv_worldGrid.size[0] = (int)ceil( width / sv_worldGrid.cellSize );
+    sv_worldGrid.size[1] = (int)ceil( height / sv_worldGrid.cellSize );
+    if ( sv_worldGrid.size[0] < 1 ) {
+        sv_worldGrid.size[0] = 1;
+    }
+    if ( sv_worldGrid.size[1] < 1 ) {
+        sv_worldGrid.size[1] = 1;
+    }
+
+    sv_worldGrid.cells = Z_Malloc( sv_worldGrid.size[0] * sv_worldGrid.size[1] * sizeof( *sv_worldGrid.cells ) );
+    sv_worldGrid.sizedFor = numCells * GRID_DENSITY;
+}
+
+/*
+===============
+SV_GatherSectorEntities
+
+Moves the sector's entities out to the arrays.
+===============
+*/
+static int SV_GatherSectorEntities( worldSector_t *sec, int *entityNums, int *contents, int *owners, vec3_t *bounds, int count ) {
+    int     i, j;
+
+    for ( i = 0 ; i < sec->numEntities ; i++, count++ ) {
+        entityNums[count] = sec->entityNums[i];
+        contents[count] = sec->contents[i];
+        owners[count] = sec->owners[i];
+        for ( j = 0 ; j < 3 ; j++ ) {
+            bounds[count * 2][j] = sec->bounds[j][i];
+            bounds[count * 2 + 1][j] = sec->bounds[j + 3][i];
+        }
+        SV_SectorClearSlot( sec, i );
+    }
+    sec->numEntities = 0;
+
+    return count;
+}
+
+/*
+===============
+SV_RelinkWorldEntities
+
+Empties whichever index is active and fills the requested one with every
+linked entity, after the grid was resized or the index changed.
+===============
+*/
+static void SV_RelinkWorldEntities( qboolean useGrid, int gridEntities ) {
+    int             entityNums[MAX_GENTITIES];
+    int             contents[MAX_GENTITIES];
+    int             owners[MAX_GENTITIES];
+    vec3_t          *bounds;
+    worldSector_t   *sec;
+    int             numLinked;
+    int             i;
+
+    bounds = Hunk_AllocateTempMemory( MAX_GENTITIES * 2 * sizeof( *bounds ) );
+
+    // the entities come back in a different order, which
+    // decides between entities hit at the same fraction
+    SV_InvalidateTraceCache();
+
+    numLinked = 0;
+    if ( sv_worldGrid.active ) {
+        numLinked = SV_GatherSectorEntities( &sv_worldGrid.large, entityNums, contents, owners, bounds, numLinked );
+        for ( i = 0 ; i < sv_worldGrid.size[0] * sv_worldGrid.size[1] ; i++ ) {
+            numLinked = SV_GatherSectorEntities( &sv_worldGrid.cells[i], entityNums, contents, owners, bounds, numLinked );
+        }
+    } else {
+        for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
+            numLinked = SV_GatherSectorEntities( &sv_worldSectors[i], entityNums, contents, owners, bounds, numLinked );
+        }
+    }
+
+    sv_worldGrid.active = useGrid;
+    if ( useGrid ) {
+        SV_SizeWorldGrid( gridEntities );
+    }
+
+    for ( i = 0 ; i < numLinked ; i++ ) {
+        sec = SV_SectorForEntity( bounds[i * 2], bounds[i * 2 + 1] );
+        SV_SectorAddEntity( sec, entityNums[i], bounds[i * 2], bounds[i * 2 + 1], contents[i], owners[i] );
+        sv.svEntities[entityNums[i]].worldSector = sec;
+    }
+
+    Hunk_FreeTempMemory( bounds );
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -147,14 +562,31 @@ SV_ClearWorld
 void SV_ClearWorld( void ) {
     clipHandle_t    h;
     vec3_t          mins, maxs;
+    int             i;
 
+    for ( i = 0 ; i < sv_numworldSectors ; i++ ) {
+        SV_SectorFree( &sv_worldSectors[i] );
+    }
     Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
     sv_numworldSectors = 0;
+    sv_numLinkedEntities = 0;
+    SV_InvalidateTraceCache();
 
     // get world map bounds
     h = CM_InlineModel( 0 );
     CM_ModelBounds( h, mins, maxs );
     SV_CreateworldSector( 0, mins, maxs );
+
+    SV_FreeWorldGrid();
+    Com_Memset( &sv_worldGrid, 0, sizeof( sv_worldGrid ) );
+
+    VectorCopy( mins, sv_worldGrid.mins );
+    VectorCopy( maxs, sv_worldGrid.maxs );
+
+    if ( sv_entityGrid->integer ) {
+        sv_worldGrid.active = qtrue;
+        SV_SizeWorldGrid( 0 );
+    }
 }
 
 
@@ -166,7 +598,6 @@ SV_UnlinkEntity
 */
 void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
     svEntity_t      *ent;
-    svEntity_t      *scan;
     worldSector_t   *ws;
 
     ent = SV_SvEntityForGentity( gEnt );
@@ -178,120 +609,99 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
         return;     // not linked in anywhere
     }
     ent->worldSector = NULL;
+    sv_numLinkedEntities--;
+    SV_InvalidateTraceCacheBox( ent->traceState.absmin, ent->traceState.absmax );
 
-    if ( ws->entities == ent ) {
-        ws->entities = ent->nextEntityInWorldSector;
-        return;
+    if ( !SV_SectorRemoveEntity( ws, ent - sv.svEntities ) ) {
+        Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
     }
+}
 
-    for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
-        if ( scan->nextEntityInWorldSector == ent ) {
-            scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-            return;
+/*
+===============
+SV_GetTraceState
+===============
+*/
+static void SV_GetTraceState( const sharedEntity_t *gEnt, entityTraceState_t *ts ) {
+    Com_Memset( ts, 0, sizeof( *ts ) );
+    VectorCopy( gEnt->r.absmin, ts->absmin );
+    VectorCopy( gEnt->r.absmax, ts->absmax );
+    VectorCopy( gEnt->r.currentOrigin, ts->origin );
+    VectorCopy( gEnt->r.currentAngles, ts->angles );
+    VectorCopy( gEnt->r.mins, ts->mins );
+    VectorCopy( gEnt->r.maxs, ts->maxs );
+    ts->contents = gEnt->r.contents;
+    ts->ownerNum = gEnt->r.ownerNum;
+    ts->bmodel = gEnt->r.bmodel;
+    ts->modelindex = gEnt->s.modelindex;
+    ts->capsule = ( gEnt->r.svFlags & SVF_CAPSULE ) != 0;
+}
+
+
+/*
+===============
+SV_SameLeafs
+
+True if an abs box still touches the leafs of the last full link,
+which is always the case when it did not move or moved less than
+the distance to the nearest plane the leaf walk tested.
+===============
+*/
+#define LEAF_MARGIN_EPSILON     0.125f
+static qboolean SV_SameLeafs( const svEntity_t *ent, const vec3_t absmin, const vec3_t absmax ) {
+    float   limit;
+    int     i;
+
+    if ( !ent->leafsValid ) {
+        return qfalse;
+    }
+
+    if ( VectorCompare( absmin, ent->linkMins ) && VectorCompare( absmax, ent->linkMaxs ) ) {
+        return qtrue;
+    }
+
+    limit = ent->leafMargin - LEAF_MARGIN_EPSILON;
+    for ( i = 0 ; i < 3 ; i++ ) {
+        if ( fabs( absmin[i] - ent->linkMins[i] ) >= limit ||
+            fabs( absmax[i] - ent->linkMaxs[i] ) >= limit ) {
+            return qfalse;
         }
     }
 
-    Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+    return qtrue;
 }
 
-
 /*
 ===============
-SV_LinkEntity
+SV_LinkToLeafs
 
+Finds the clusters and areas the abs box of an entity touches.
 ===============
 */
 #define MAX_TOTAL_ENT_LEAFS     128
-void SV_LinkEntity( sharedEntity_t *gEnt ) {
-    worldSector_t   *node;
+static void SV_LinkToLeafs( sharedEntity_t *gEnt, svEntity_t *ent ) {
     int         leafs[MAX_TOTAL_ENT_LEAFS];
     int         cluster;
     int         num_leafs;
-    int         i, j, k;
+    int         i;
     int         area;
     int         lastLeaf;
-    float       *origin, *angles;
-    svEntity_t  *ent;
-
-    ent = SV_SvEntityForGentity( gEnt );
-
-    if ( ent->worldSector ) {
-        SV_UnlinkEntity( gEnt );    // unlink from old position
-    }
 
-    // encode the size into the entityState_t for client prediction
-    if ( gEnt->r.bmodel ) {
-        gEnt->s.solid = SOLID_BMODEL;       // a solid_box will never create this value
-    } else if ( gEnt->r.contents & ( CONTENTS_SOLID | CONTENTS_BODY ) ) {
-        // assume that x/y are equal and symetric
-        i = gEnt->r.maxs[0];
-        if (i<1)
-            i = 1;
-        if (i>255)
-            i = 255;
+    // link to PVS leafs
+    ent->numClusters = 0;
+    ent->lastCluster = 0;
+    ent->areanum = -1;
+    ent->areanum2 = -1;
 
-        // z is not symetric
-        j = (-gEnt->r.mins[2]);
-        if (j<1)
-            j = 1;
-        if (j>255)
-            j = 255;
+    //get all leafs, including solids
+    num_leafs = CM_BoxLeafnumsMargin( gEnt->r.absmin, gEnt->r.absmax,
+        leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf, &ent->leafMargin );
 
-        // and z maxs can be negative...
-        k = (gEnt->r.maxs[2]+32);
-        if (k<1)
-            k = 1;
-        if (k>255)
-            k = 255;
+    sv.linksFull++;
+    ent->leafsValid = qfalse;
 
-        gEnt->s.solid = (k<<16) | (j<<8) | i;
-    } else {
-        gEnt->s.solid = 0;
-    }
-
-    // get the position
-    origin = gEnt->r.currentOrigin;
-    angles = gEnt->r.currentAngles;
-
-    // set the abs box
-    if ( gEnt->r.bmodel && (angles[0] || angles[1] || angles[2]) ) {
-        // expand for rotation
-        float       max;
-
-        max = RadiusFromBounds( gEnt->r.mins, gEnt->r.maxs );
-        for (i=0 ; i<3 ; i++) {
-            gEnt->r.absmin[i] = origin[i] - max;
-            gEnt->r.absmax[i] = origin[i] + max;
-        }
-    } else {
-        // normal
-        VectorAdd (origin, gEnt->r.mins, gEnt->r.absmin);
-        VectorAdd (origin, gEnt->r.maxs, gEnt->r.absmax);
-    }
-
-    // because movement is clipped an epsilon away from an actual edge,
-    // we must fully check even when bounding boxes don't quite touch
-    gEnt->r.absmin[0] -= 1;
-    gEnt->r.absmin[1] -= 1;
-    gEnt->r.absmin[2] -= 1;
-    gEnt->r.absmax[0] += 1;
-    gEnt->r.absmax[1] += 1;
-    gEnt->r.absmax[2] += 1;
-
-    // link to PVS leafs
-    ent->numClusters = 0;
-    ent->lastCluster = 0;
-    ent->areanum = -1;
-    ent->areanum2 = -1;
-
-    //get all leafs, including solids
-    num_leafs = CM_BoxLeafnums( gEnt->r.absmin, gEnt->r.absmax,
-        leafs, MAX_TOTAL_ENT_LEAFS, &lastLeaf );
-
-    // if none of the leafs were inside the map, the
-    // entity is outside the world and can be considered unlinked
-    if ( !num_leafs ) {
-        return;
+    if ( !num_leafs ) {
+        return;
     }
 
     // set areas, even from clusters that don't fit in the entity array
@@ -330,26 +740,135 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
         ent->lastCluster = CM_LeafCluster( lastLeaf );
     }
 
+
+    VectorCopy( gEnt->r.absmin, ent->linkMins );
+    VectorCopy( gEnt->r.absmax, ent->linkMaxs );
+    ent->leafsValid = qtrue;
+}
+
+/*
+===============
+SV_LinkEntity
+
+===============
+*/
+void SV_LinkEntity( sharedEntity_t *gEnt ) {
+    worldSector_t   *node;
+    int         i, j, k;
+    float       *origin, *angles;
+    svEntity_t  *ent;
+    entityTraceState_t  traceState;
+    qboolean    wasLinked;
+
+    ent = SV_SvEntityForGentity( gEnt );
+
+    // it is only moved out of its old position
+    // once the new one is known
+    wasLinked = ent->worldSector != NULL;
+
+    // encode the size into the entityState_t for client prediction
+    if ( gEnt->r.bmodel ) {
+        gEnt->s.solid = SOLID_BMODEL;       // a solid_box will never create this value
+    } else if ( gEnt->r.contents & ( CONTENTS_SOLID | CONTENTS_BODY ) ) {
+        // assume that x/y are equal and symetric
+        i = gEnt->r.maxs[0];
+        if (i<1)
+            i = 1;
+        if (i>255)
+            i = 255;
+
+        // z is not symetric
+        j = (-gEnt->r.mins[2]);
+        if (j<1)
+            j = 1;
+        if (j>255)
+            j = 255;
+
+        // and z maxs can be negative...
+        k = (gEnt->r.maxs[2]+32);
+        if (k<1)
+            k = 1;
+        if (k>255)
+            k = 255;
+
+        gEnt->s.solid = (k<<16) | (j<<8) | i;
+    } else {
+        gEnt->s.solid = 0;
+    }
+
+    // get the position
+    origin = gEnt->r.currentOrigin;
+    angles = gEnt->r.currentAngles;
+
+    // set the abs box
+    if ( gEnt->r.bmodel && (angles[0] || angles[1] || angles[2]) ) {
+        // expand for rotation
+        float       max;
+
+        max = RadiusFromBounds( gEnt->r.mins, gEnt->r.maxs );
+        for (i=0 ; i<3 ; i++) {
+            gEnt->r.absmin[i] = origin[i] - max;
+            gEnt->r.absmax[i] = origin[i] + max;
+        }
+    } else {
+        // normal
+        VectorAdd (origin, gEnt->r.mins, gEnt->r.absmin);
+        VectorAdd (origin, gEnt->r.maxs, gEnt->r.absmax);
+    }
+
+    // because movement is clipped an epsilon away from an actual edge,
+    // we must fully check even when bounding boxes don't quite touch
+    gEnt->r.absmin[0] -= 1;
+    gEnt->r.absmin[1] -= 1;
+    gEnt->r.absmin[2] -= 1;
+    gEnt->r.absmax[0] += 1;
+    gEnt->r.absmax[1] += 1;
+    gEnt->r.absmax[2] += 1;
+
+    // most entities stay inside the same leafs from one link to the
+    // next, so their clusters and areas can be kept as they are
+    if ( SV_SameLeafs( ent, gEnt->r.absmin, gEnt->r.absmax ) ) {
+        sv.linksReused++;
+    } else {
+        SV_LinkToLeafs( gEnt, ent );
+
+        // if none of the leafs were inside the map, the
+        // entity is outside the world and can be considered unlinked
+        if ( !ent->leafsValid ) {
+            SV_UnlinkEntity( gEnt );
+            return;
+        }
+    }
+
     gEnt->r.linkcount++;
 
-    // find the first world sector node that the ent's box crosses
-    node = sv_worldSectors;
-    while (1)
-    {
-        if (node->axis == -1)
-            break;
-        if ( gEnt->r.absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if ( gEnt->r.absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;      // crosses the node
+    // nothing a trace looks at changed, so it can stay where it
+    // is, and so can the traces cached around it
+    SV_GetTraceState( gEnt, &traceState );
+    if ( wasLinked && !memcmp( &traceState, &ent->traceState, sizeof( traceState ) ) ) {
+        gEnt->r.linked = qtrue;
+        return;
+    }
+
+    if ( wasLinked ) {
+        SV_UnlinkEntity( gEnt );    // unlink from old position
     }
 
+    // the grid has filled up past what its cells were sized for
+    if ( sv_worldGrid.active && sv_numLinkedEntities >= 2 * sv_worldGrid.sizedFor
+        && sv_worldGrid.sizedFor < GRID_MAX_CELLS * GRID_DENSITY && sv_worldGrid.cellSize > GRID_MIN_CELL_SIZE ) {
+        SV_RelinkWorldEntities( qtrue, sv_numLinkedEntities + 1 );
+    }
+
+    node = SV_SectorForEntity( gEnt->r.absmin, gEnt->r.absmax );
+
     // link it in
     ent->worldSector = node;
-    ent->nextEntityInWorldSector = node->entities;
-    node->entities = ent;
+    SV_SectorAddEntity( node, ent - sv.svEntities, gEnt->r.absmin, gEnt->r.absmax, gEnt->r.contents, gEnt->r.ownerNum );
+    sv_numLinkedEntities++;
+
+    ent->traceState = traceState;
+    SV_InvalidateTraceCacheBox( traceState.absmin, traceState.absmax );
 
     gEnt->r.linked = qtrue;
 }
@@ -368,42 +887,164 @@ typedef struct {
     const float *mins;
     const float *maxs;
     int         *list;
+    float       **bounds;               // if set, gets the packed box of each listed entity
+    int         *contents, *owners;     // if set, get the packed contents and owner of each listed entity
     int         count, maxcount;
+
+    qboolean    filter;                 // leave out what a trace with these wouldn't clip against
+    int         contentmask;
+    int         passEntityNum;
+    int         passOwnerNum;
+#if idx64
+    __m128      mins4[3], maxs4[3];     // mins and maxs, once per lane
+    __m128i     contentmask4, passEntityNum4, passOwnerNum4;
+#endif
 } areaParms_t;
 
 
 /*
 ====================
-SV_AreaEntities_r
+SV_AreaCopyPacked
+====================
+*/
+static void SV_AreaCopyPacked( const worldSector_t *node, int n, areaParms_t *ap ) {
+    int     k;
+
+    if ( ap->bounds ) {
+        for ( k = 0 ; k < 6 ; k++ ) {
+            ap->bounds[k][ap->count] = node->bounds[k][n];
+        }
+    }
+    if ( ap->contents ) {
+        ap->contents[ap->count] = node->contents[n];
+        ap->owners[ap->count] = node->owners[n];
+    }
+}
 
+/*
+====================
+SV_SkipPackedEntity
+
+True if a trace with the given contentmask and pass entity
+doesn't clip against an entity with these packed values.
+passEntityNum and passOwnerNum are -1 when there are none.
 ====================
 */
-static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
-    svEntity_t  *check, *next;
-    sharedEntity_t *gcheck;
+static qboolean SV_SkipPackedEntity( int entityNum, int contents, int ownerNum, int contentmask, int passEntityNum, int passOwnerNum ) {
+    // if it doesn't have any brushes of a type we
+    // are looking for, ignore it
+    if ( !( contentmask & contents ) ) {
+        return qtrue;
+    }
+
+    // don't clip against the pass entity, its own missiles
+    // and other missiles from its owner
+    return entityNum == passEntityNum || ownerNum == passEntityNum || ownerNum == passOwnerNum;
+}
+
+/*
+====================
+SV_AreaSectorEntities
+
+Adds the entities in one sector that touch the area, newest first.
+Returns qfalse once the list is full.
+====================
+*/
+static qboolean SV_AreaSectorEntities( worldSector_t *node, areaParms_t *ap ) {
+    int     i, n;
+#if idx64
+    __m128  out;
+    __m128i skip, owners;
+    int     touch;
+#endif
+
+    if ( !node->numEntities ) {
+        return qtrue;
+    }
+
+    sv_areaEntityChecks += node->numEntities;
+
+#if idx64
+    // the slots past numEntities are empty boxes that never touch
+    for ( i = ( node->numEntities + 3 ) & ~3 ; i > 0 ; ) {
+        i -= 4;
+
+        out = _mm_cmpgt_ps( _mm_loadu_ps( node->bounds[0] + i ), ap->maxs4[0] );
+        out = _mm_or_ps( out, _mm_cmpgt_ps( _mm_loadu_ps( node->bounds[1] + i ), ap->maxs4[1] ) );
+        out = _mm_or_ps( out, _mm_cmpgt_ps( _mm_loadu_ps( node->bounds[2] + i ), ap->maxs4[2] ) );
+        out = _mm_or_ps( out, _mm_cmplt_ps( _mm_loadu_ps( node->bounds[3] + i ), ap->mins4[0] ) );
+        out = _mm_or_ps( out, _mm_cmplt_ps( _mm_loadu_ps( node->bounds[4] + i ), ap->mins4[1] ) );
+        out = _mm_or_ps( out, _mm_cmplt_ps( _mm_loadu_ps( node->bounds[5] + i ), ap->mins4[2] ) );
+
+        if ( ap->filter ) {
+            // same as SV_SkipPackedEntity
+            skip = _mm_and_si128( _mm_loadu_si128( (const __m128i *)( node->contents + i ) ), ap->contentmask4 );
+            skip = _mm_cmpeq_epi32( skip, _mm_setzero_si128() );
+            skip = _mm_or_si128( skip, _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)( node->entityNums + i ) ), ap->passEntityNum4 ) );
+            owners = _mm_loadu_si128( (const __m128i *)( node->owners + i ) );
+            skip = _mm_or_si128( skip, _mm_cmpeq_epi32( owners, ap->passEntityNum4 ) );
+            skip = _mm_or_si128( skip, _mm_cmpeq_epi32( owners, ap->passOwnerNum4 ) );
+            out = _mm_or_ps( out, _mm_castsi128_ps( skip ) );
+        }
+
+        touch = ~_mm_movemask_ps( out ) & 15;
+
+        for ( n = i + 3 ; touch ; n-- ) {
+            if ( !( touch & ( 1 << ( n - i ) ) ) ) {
+                continue;
+            }
+            touch &= ~( 1 << ( n - i ) );
 
-    for ( check = node->entities  ; check ; check = next ) {
-        next = check->nextEntityInWorldSector;
+            if ( ap->count == ap->maxcount ) {
+                Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+                return qfalse;
+            }
 
-        gcheck = SV_GEntityForSvEntity( check );
+            ap->list[ap->count] = node->entityNums[n];
+            SV_AreaCopyPacked( node, n, ap );
+            ap->count++;
+        }
+    }
+#else
+    for ( n = node->numEntities - 1 ; n >= 0 ; n-- ) {
+        if ( node->bounds[0][n] > ap->maxs[0]
+        || node->bounds[1][n] > ap->maxs[1]
+        || node->bounds[2][n] > ap->maxs[2]
+        || node->bounds[3][n] < ap->mins[0]
+        || node->bounds[4][n] < ap->mins[1]
+        || node->bounds[5][n] < ap->mins[2]) {
+            continue;
+        }
 
-        if ( gcheck->r.absmin[0] > ap->maxs[0]
-        || gcheck->r.absmin[1] > ap->maxs[1]
-        || gcheck->r.absmin[2] > ap->maxs[2]
-        || gcheck->r.absmax[0] < ap->mins[0]
-        || gcheck->r.absmax[1] < ap->mins[1]
-        || gcheck->r.absmax[2] < ap->mins[2]) {
+        if ( ap->filter && SV_SkipPackedEntity( node->entityNums[n], node->contents[n], node->owners[n],
+            ap->contentmask, ap->passEntityNum, ap->passOwnerNum ) ) {
             continue;
         }
 
         if ( ap->count == ap->maxcount ) {
             Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
-            return;
+            return qfalse;
         }
 
-        ap->list[ap->count] = check - sv.svEntities;
+        ap->list[ap->count] = node->entityNums[n];
+        SV_AreaCopyPacked( node, n, ap );
         ap->count++;
     }
+#endif
+
+    return qtrue;
+}
+
+/*
+====================
+SV_AreaEntities_r
+
+====================
+*/
+static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
+    if ( !SV_AreaSectorEntities( node, ap ) ) {
+        return;
+    }
 
     if (node->axis == -1) {
         return;     // terminal node
@@ -418,6 +1059,68 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
     }
 }
 
+/*
+====================
+SV_AreaGridEntities
+
+Checks the big entities, then every cell an entity touching
+the area could be centered in.
+====================
+*/
+static void SV_AreaGridEntities( areaParms_t *ap ) {
+    float   half;
+    int     x0, x1, y0, y1;
+    int     x, y;
+
+    if ( !SV_AreaSectorEntities( &sv_worldGrid.large, ap ) ) {
+        return;
+    }
+
+    // a unit more to stay clear of rounding in the cell coords
+    half = 0.5f * sv_worldGrid.cellSize + 1;
+    x0 = SV_GridCoord( ap->mins[0] - half, 0 );
+    x1 = SV_GridCoord( ap->maxs[0] + half, 0 );
+    y0 = SV_GridCoord( ap->mins[1] - half, 1 );
+    y1 = SV_GridCoord( ap->maxs[1] + half, 1 );
+
+    for ( y = y0 ; y <= y1 ; y++ ) {
+        for ( x = x0 ; x <= x1 ; x++ ) {
+            if ( !SV_AreaSectorEntities( &sv_worldGrid.cells[y * sv_worldGrid.size[0] + x], ap ) ) {
+                return;
+            }
+        }
+    }
+}
+
+/*
+================
+SV_AreaQuery
+
+Runs a query set up in ap, whose count must be 0
+================
+*/
+static int SV_AreaQuery( areaParms_t *ap ) {
+#if idx64
+    int             i;
+
+    for ( i = 0 ; i < 3 ; i++ ) {
+        ap->mins4[i] = _mm_set1_ps( ap->mins[i] );
+        ap->maxs4[i] = _mm_set1_ps( ap->maxs[i] );
+    }
+    ap->contentmask4 = _mm_set1_epi32( ap->contentmask );
+    ap->passEntityNum4 = _mm_set1_epi32( ap->passEntityNum );
+    ap->passOwnerNum4 = _mm_set1_epi32( ap->passOwnerNum );
+#endif
+
+    if ( sv_worldGrid.active ) {
+        SV_AreaGridEntities( ap );
+    } else {
+        SV_AreaEntities_r( sv_worldSectors, ap );
+    }
+
+    return ap->count;
+}
+
 /*
 ================
 SV_AreaEntities
@@ -426,66 +1129,207 @@ SV_AreaEntities
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
     areaParms_t     ap;
 
+    Com_Memset( &ap, 0, sizeof( ap ) );
     ap.mins = mins;
     ap.maxs = maxs;
     ap.list = entityList;
-    ap.count = 0;
     ap.maxcount = maxcount;
 
-    SV_AreaEntities_r( sv_worldSectors, &ap );
-
-    return ap.count;
+    return SV_AreaQuery( &ap );
 }
 
+/*
+================
+SV_AreaBenchIndex
 
+Runs every query passes times against the current index and returns the
+time taken. sums gets a checksum of each query's entities, which doesn't
+depend on the order they were found in.
+================
+*/
+static int SV_AreaBenchIndex( const vec3_t *boxes, int numQueries, int passes, int *sums, int *checks ) {
+    int     list[MAX_GENTITIES];
+    int     i, j, k, num;
+    int     start, msec;
 
-//===========================================================================
+    sv_areaEntityChecks = 0;
 
+    start = Sys_Milliseconds();
+    for ( i = 0; i < passes; i++ ) {
+        for ( j = 0; j < numQueries; j++ ) {
+            SV_AreaEntities( boxes[j * 2], boxes[j * 2 + 1], list, MAX_GENTITIES );
+        }
+    }
+    msec = Sys_Milliseconds() - start;
 
-typedef struct {
-    vec3_t      boxmins, boxmaxs;// enclose the test object along entire move
-    const float *mins;
-    const float *maxs;  // size of the moving object
-    const float *start;
-    vec3_t      end;
-    trace_t     trace;
-    int         passEntityNum;
-    int         contentmask;
-    int         capsule;
-} moveclip_t;
+    *checks = sv_areaEntityChecks / passes;
+
+    for ( j = 0; j < numQueries; j++ ) {
+        num = SV_AreaEntities( boxes[j * 2], boxes[j * 2 + 1], list, MAX_GENTITIES );
+
+        sums[j] = num;
+        for ( k = 0; k < num; k++ ) {
+            sums[j] += ( list[k] + 1 ) * ( list[k] + 7919 );
+        }
+    }
 
+    return msec;
+}
 
 /*
-====================
-SV_ClipToEntity
+================
+SV_AreaBench_f
 
-====================
-*/
-void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule ) {
-    sharedEntity_t  *touch;
-    clipHandle_t    clipHandle;
-    float           *origin, *angles;
+areabench [queries] [passes]
 
-    touch = SV_GentityNum( entityNum );
+Times SV_AreaEntities with player sized boxes, short moves and shots
+against both the sector tree and the grid, and checks that they find
+the same entities
+================
+*/
+void SV_AreaBench_f( void ) {
+    vec3_t      *boxes;
+    int         *sums[2];
+    int         msec[2], checks[2];
+    vec3_t      worldMins, worldMaxs, start, end;
+    float       size;
+    qboolean    wasGrid;
+    unsigned int seed;
+    int         numQueries, passes, mismatches;
+    int         i, j;
+
+    if ( !com_sv_running->integer ) {
+        Com_Printf( "Server is not running.\n" );
+        return;
+    }
 
-    Com_Memset(trace, 0, sizeof(trace_t));
+    numQueries = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 4096;
+    passes = Cmd_Argc() > 2 ? atoi( Cmd_Argv(2) ) : 20;
 
-    // if it doesn't have any brushes of a type we
-    // are looking for, ignore it
-    if ( ! ( contentmask & touch->r.contents ) ) {
-        trace->fraction = 1.0;
+    if ( numQueries < 1 || passes < 1 ) {
+        Com_Printf( "Usage: areabench [queries] [passes]\n" );
         return;
     }
 
-    // might intersect, so do an exact clip
-    clipHandle = SV_ClipHandleForEntity (touch);
+    boxes = Hunk_AllocateTempMemory( numQueries * 2 * sizeof( *boxes ) );
+    sums[0] = Hunk_AllocateTempMemory( numQueries * sizeof( *sums[0] ) );
+    sums[1] = Hunk_AllocateTempMemory( numQueries * sizeof( *sums[1] ) );
 
-    origin = touch->r.currentOrigin;
-    angles = touch->r.currentAngles;
+    CM_ModelBounds( 0, worldMins, worldMaxs );
 
-    if ( !touch->r.bmodel ) {
-        angles = vec3_origin;   // boxes don't rotate
-    }
+    // a fixed seed so runs can be compared
+    seed = 1;
+#define BENCH_RAND()    ( seed = seed * 1664525 + 1013904223, ( seed >> 8 ) / (float)( 1 << 24 ) )
+
+    for ( i = 0; i < numQueries; i++ ) {
+        for ( j = 0; j < 3; j++ ) {
+            start[j] = worldMins[j] + BENCH_RAND() * ( worldMaxs[j] - worldMins[j] );
+        }
+
+        switch ( i & 3 ) {
+        case 0:     // shot
+            size = 4096;
+            break;
+        case 1:     // explosion
+            size = 512;
+            break;
+        default:    // move
+            size = 64;
+            break;
+        }
+
+        for ( j = 0; j < 3; j++ ) {
+            end[j] = start[j] + ( BENCH_RAND() - 0.5f ) * size;
+            boxes[i * 2][j] = ( start[j] < end[j] ? start[j] : end[j] ) - 16;
+            boxes[i * 2 + 1][j] = ( start[j] < end[j] ? end[j] : start[j] ) + 16;
+        }
+    }
+#undef BENCH_RAND
+
+    wasGrid = sv_worldGrid.active;
+
+    SV_RelinkWorldEntities( qfalse, 0 );
+    msec[0] = SV_AreaBenchIndex( boxes, numQueries, passes, sums[0], &checks[0] );
+
+    SV_RelinkWorldEntities( qtrue, sv_numLinkedEntities );
+    msec[1] = SV_AreaBenchIndex( boxes, numQueries, passes, sums[1], &checks[1] );
+
+    Com_Printf( "%i linked entities, %i queries, %i passes\n", sv_numLinkedEntities, numQueries, passes );
+    Com_Printf( "sectors: %i msec, %i entities checked per pass\n", msec[0], checks[0] );
+    Com_Printf( "grid:    %i msec, %i entities checked per pass, %i x %i cells of %.0f units\n",
+        msec[1], checks[1], sv_worldGrid.size[0], sv_worldGrid.size[1], sv_worldGrid.cellSize );
+
+    // put back whatever was in use
+    SV_RelinkWorldEntities( wasGrid, sv_numLinkedEntities );
+
+    mismatches = 0;
+    for ( i = 0; i < numQueries; i++ ) {
+        if ( sums[0][i] != sums[1][i] ) {
+            mismatches++;
+        }
+    }
+
+    if ( mismatches ) {
+        Com_Printf( S_COLOR_RED "FAILED: %i queries found different entities\n", mismatches );
+    } else {
+        Com_Printf( "PASSED: both find the same entities\n" );
+    }
+
+    Hunk_FreeTempMemory( sums[1] );
+    Hunk_FreeTempMemory( sums[0] );
+    Hunk_FreeTempMemory( boxes );
+}
+
+
+
+//===========================================================================
+
+
+typedef struct {
+    vec3_t      boxmins, boxmaxs;// enclose the test object along entire move
+    const float *mins;
+    const float *maxs;  // size of the moving object
+    const float *start;
+    vec3_t      end;
+    trace_t     trace;
+    int         passEntityNum;  // -1 for none
+    int         passOwnerNum;   // owner of the pass entity, -1 for none
+    int         contentmask;
+    int         capsule;
+} moveclip_t;
+
+
+/*
+====================
+SV_ClipToEntity
+
+====================
+*/
+void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, int capsule ) {
+    sharedEntity_t  *touch;
+    clipHandle_t    clipHandle;
+    float           *origin, *angles;
+
+    touch = SV_GentityNum( entityNum );
+
+    Com_Memset(trace, 0, sizeof(trace_t));
+
+    // if it doesn't have any brushes of a type we
+    // are looking for, ignore it
+    if ( ! ( contentmask & touch->r.contents ) ) {
+        trace->fraction = 1.0;
+        return;
+    }
+
+    // might intersect, so do an exact clip
+    clipHandle = SV_ClipHandleForEntity (touch);
+
+    origin = touch->r.currentOrigin;
+    angles = touch->r.currentAngles;
+
+    if ( !touch->r.bmodel ) {
+        angles = vec3_origin;   // boxes don't rotate
+    }
 
     CM_TransformedBoxTrace ( trace, (float *)start, (float *)end,
         (float *)mins, (float *)maxs, clipHandle,  contentmask,
@@ -499,55 +1343,26 @@ void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, con
 
 /*
 ====================
-SV_ClipMoveToEntities
+SV_ClipMoveToEntityList
 
+touchlist must hold the entities SV_AreaEntities returns for the
+clip's box, in the same order, less the ones SV_SkipPackedEntity
+skips for the clip.
 ====================
 */
-static void SV_ClipMoveToEntities( moveclip_t *clip ) {
-    int         i, num;
-    int         touchlist[MAX_GENTITIES];
+static void SV_ClipMoveToEntityList( moveclip_t *clip, const int *touchlist, int num ) {
+    int         i;
     sharedEntity_t *touch;
-    int         passOwnerNum;
     trace_t     trace;
     clipHandle_t    clipHandle;
     float       *origin, *angles;
 
-    num = SV_AreaEntities( clip->boxmins, clip->boxmaxs, touchlist, MAX_GENTITIES);
-
-    if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-        passOwnerNum = ( SV_GentityNum( clip->passEntityNum ) )->r.ownerNum;
-        if ( passOwnerNum == ENTITYNUM_NONE ) {
-            passOwnerNum = -1;
-        }
-    } else {
-        passOwnerNum = -1;
-    }
-
     for ( i=0 ; i<num ; i++ ) {
         if ( clip->trace.allsolid ) {
             return;
         }
         touch = SV_GentityNum( touchlist[i] );
 
-        // see if we should ignore this entity
-        if ( clip->passEntityNum != ENTITYNUM_NONE ) {
-            if ( touchlist[i] == clip->passEntityNum ) {
-                continue;   // don't clip against the pass entity
-            }
-            if ( touch->r.ownerNum == clip->passEntityNum ) {
-                continue;   // don't clip against own missiles
-            }
-            if ( touch->r.ownerNum == passOwnerNum ) {
-                continue;   // don't clip against other missiles from our owner
-            }
-        }
-
-        // if it doesn't have any brushes of a type we
-        // are looking for, ignore it
-        if ( ! ( clip->contentmask & touch->r.contents ) ) {
-            continue;
-        }
-
         // might intersect, so do an exact clip
         clipHandle = SV_ClipHandleForEntity (touch);
 
@@ -585,6 +1400,207 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 }
 
 
+/*
+====================
+SV_ClipMoveToEntities
+
+====================
+*/
+static void SV_ClipMoveToEntities( moveclip_t *clip ) {
+    int         touchlist[MAX_GENTITIES];
+    areaParms_t ap;
+    int         num;
+
+    // the entities the clip skips are left out by the query
+    Com_Memset( &ap, 0, sizeof( ap ) );
+    ap.mins = clip->boxmins;
+    ap.maxs = clip->boxmaxs;
+    ap.list = touchlist;
+    ap.maxcount = MAX_GENTITIES;
+    ap.filter = qtrue;
+    ap.contentmask = clip->contentmask;
+    ap.passEntityNum = clip->passEntityNum;
+    ap.passOwnerNum = clip->passOwnerNum;
+
+    num = SV_AreaQuery( &ap );
+
+    SV_ClipMoveToEntityList( clip, touchlist, num );
+}
+
+
+/*
+==================
+SV_InitMoveClip
+
+Sets up clip for the entity part of a trace whose world
+part has already been done.
+==================
+*/
+static void SV_InitMoveClip( moveclip_t *clip, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+    int         i;
+
+    clip->contentmask = contentmask;
+    clip->start = start;
+//  VectorCopy( clip->trace.endpos, clip->end );
+    VectorCopy( end, clip->end );
+    clip->mins = mins;
+    clip->maxs = maxs;
+    clip->capsule = capsule;
+
+    // don't clip against the pass entity, its own missiles
+    // and other missiles from its owner
+    clip->passEntityNum = -1;
+    clip->passOwnerNum = -1;
+    if ( passEntityNum != ENTITYNUM_NONE ) {
+        clip->passEntityNum = passEntityNum;
+        clip->passOwnerNum = SV_GentityNum( passEntityNum )->r.ownerNum;
+        if ( clip->passOwnerNum == ENTITYNUM_NONE ) {
+            clip->passOwnerNum = -1;
+        }
+    }
+
+    // create the bounding box of the entire move
+    // we can limit it to the part of the move not
+    // already clipped off by the world, which can be
+    // a significant savings for line of sight and shot traces
+    for ( i=0 ; i<3 ; i++ ) {
+        if ( end[i] > start[i] ) {
+            clip->boxmins[i] = clip->start[i] + clip->mins[i] - 1;
+            clip->boxmaxs[i] = clip->end[i] + clip->maxs[i] + 1;
+        } else {
+            clip->boxmins[i] = clip->end[i] + clip->mins[i] - 1;
+            clip->boxmaxs[i] = clip->start[i] + clip->maxs[i] + 1;
+        }
+    }
+}
+
+
+/*
+===============================================================================
+
+TRACE CACHE
+
+With sv_traceCache set, SV_Trace remembers its recent results and hands
+them out again for a call with exactly the same arguments. Each result
+keeps the box its trace searched for entities, and linking or unlinking
+an entity only forgets the results whose box it overlaps, before or
+after, and only when its bounds, contents, owner or collision model
+changed; a relink that changes none of those leaves it where it was.
+The trace only uses the contents and owner stored at link time, so a
+result is reused exactly while a fresh trace would give the same one.
+Everything is forgotten when an area portal changes, when the world is
+relinked and at the start of every game frame.
+
+===============================================================================
+*/
+
+#define TRACE_CACHE_SIZE    512     // must be a power of two
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    int         passEntityNum;
+    int         passOwnerNum;       // read from the pass entity at the time of the call
+    int         contentmask;
+    int         capsule;
+} traceKey_t;
+
+typedef struct {
+    traceKey_t  key;
+    int         generation;         // valid while this matches traceCacheGeneration
+    vec3_t      boxmins, boxmaxs;   // where the trace searched for entities
+    trace_t     trace;
+} traceCacheEntry_t;
+
+static traceCacheEntry_t    traceCache[TRACE_CACHE_SIZE];
+static int                  traceCacheGeneration = 1;
+static vec3_t               traceCacheMins, traceCacheMaxs;     // around every box of this generation
+static int                  traceCacheCalls, traceCacheHits;    // since the last com_showtrace report
+
+/*
+==================
+SV_InvalidateTraceCache
+==================
+*/
+void SV_InvalidateTraceCache( void ) {
+    traceCacheGeneration++;
+    VectorSet( traceCacheMins, 999999, 999999, 999999 );
+    VectorSet( traceCacheMaxs, -999999, -999999, -999999 );
+}
+
+/*
+==================
+SV_InvalidateTraceCacheBox
+
+Forgets the results of the traces that searched the box for entities,
+with the same inclusive test the area query uses
+==================
+*/
+void SV_InvalidateTraceCacheBox( const vec3_t mins, const vec3_t maxs ) {
+    traceCacheEntry_t   *entry;
+    int                 i;
+
+    // with the cache off nothing is looked at, start over cheaply
+    if ( !sv_traceCache->integer ) {
+        SV_InvalidateTraceCache();
+        return;
+    }
+
+    if ( mins[0] > traceCacheMaxs[0] || mins[1] > traceCacheMaxs[1] || mins[2] > traceCacheMaxs[2]
+        || maxs[0] < traceCacheMins[0] || maxs[1] < traceCacheMins[1] || maxs[2] < traceCacheMins[2] ) {
+        return;
+    }
+
+    for ( i = 0, entry = traceCache; i < TRACE_CACHE_SIZE; i++, entry++ ) {
+        if ( entry->generation != traceCacheGeneration ) {
+            continue;
+        }
+        if ( mins[0] > entry->boxmaxs[0] || mins[1] > entry->boxmaxs[1] || mins[2] > entry->boxmaxs[2]
+            || maxs[0] < entry->boxmins[0] || maxs[1] < entry->boxmins[1] || maxs[2] < entry->boxmins[2] ) {
+            continue;
+        }
+        entry->generation = 0;
+    }
+}
+
+/*
+==================
+SV_TraceCacheEntry
+
+The slot a trace goes in, whatever is stored there now
+==================
+*/
+static traceCacheEntry_t *SV_TraceCacheEntry( const traceKey_t *key ) {
+    const byte      *b;
+    unsigned int    hash;
+    int             i;
+
+    // FNV-1a over the raw key
+    hash = 2166136261u;
+    for ( i = 0, b = (const byte *)key; i < sizeof( *key ); i++ ) {
+        hash = ( hash ^ b[i] ) * 16777619u;
+    }
+
+    return &traceCache[hash & ( TRACE_CACHE_SIZE - 1 )];
+}
+
+/*
+==================
+SV_TraceCacheStats
+
+Prints and clears the counters, every frame while com_showtrace is set
+==================
+*/
+void SV_TraceCacheStats( void ) {
+    if ( sv_traceCache->integer ) {
+        Com_Printf( "%4i SV_Trace calls, %i from the cache (%.0f%%)\n", traceCacheCalls, traceCacheHits,
+            traceCacheCalls ? 100.0f * traceCacheHits / traceCacheCalls : 0.0f );
+    }
+
+    traceCacheCalls = 0;
+    traceCacheHits = 0;
+}
+
 /*
 ==================
 SV_Trace
@@ -594,8 +1610,9 @@ passEntityNum and entities owned by passEntityNum are explicitly not checked.
 ==================
 */
 void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
-    moveclip_t  clip;
-    int         i;
+    moveclip_t          clip;
+    traceKey_t          key;
+    traceCacheEntry_t   *entry;
 
     if ( !mins ) {
         mins = vec3_origin;
@@ -604,43 +1621,290 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
         maxs = vec3_origin;
     }
 
+    entry = NULL;
+    if ( sv_traceCache->integer ) {
+        Com_Memset( &key, 0, sizeof( key ) );
+        VectorCopy( start, key.start );
+        VectorCopy( end, key.end );
+        VectorCopy( mins, key.mins );
+        VectorCopy( maxs, key.maxs );
+        key.passEntityNum = passEntityNum;
+        key.passOwnerNum = passEntityNum != ENTITYNUM_NONE ? SV_GentityNum( passEntityNum )->r.ownerNum : -1;
+        key.contentmask = contentmask;
+        key.capsule = capsule;
+
+        traceCacheCalls++;
+
+        entry = SV_TraceCacheEntry( &key );
+        if ( entry->generation == traceCacheGeneration && !memcmp( &entry->key, &key, sizeof( key ) ) ) {
+            traceCacheHits++;
+            *results = entry->trace;
+            return;
+        }
+    }
+
     Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
     // clip to world
     CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
     clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-    if ( clip.trace.fraction == 0 ) {
-        *results = clip.trace;
-        return;     // blocked immediately by the world
+    SV_InitMoveClip( &clip, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+    if ( clip.trace.fraction != 0 ) {
+        // clip to other solid entities
+        SV_ClipMoveToEntities ( &clip );
     }
 
-    clip.contentmask = contentmask;
-    clip.start = start;
-//  VectorCopy( clip.trace.endpos, clip.end );
-    VectorCopy( end, clip.end );
-    clip.mins = mins;
-    clip.maxs = maxs;
-    clip.passEntityNum = passEntityNum;
-    clip.capsule = capsule;
+    if ( entry ) {
+        entry->key = key;
+        entry->generation = traceCacheGeneration;
+        VectorCopy( clip.boxmins, entry->boxmins );
+        VectorCopy( clip.boxmaxs, entry->boxmaxs );
+        AddPointToBounds( clip.boxmins, traceCacheMins, traceCacheMaxs );
+        AddPointToBounds( clip.boxmaxs, traceCacheMins, traceCacheMaxs );
+        entry->trace = clip.trace;
+    }
 
-    // create the bounding box of the entire move
-    // we can limit it to the part of the move not
-    // already clipped off by the world, which can be
-    // a significant savings for line of sight and shot traces
-    for ( i=0 ; i<3 ; i++ ) {
-        if ( end[i] > start[i] ) {
-            clip.boxmins[i] = clip.start[i] + clip.mins[i] - 1;
-            clip.boxmaxs[i] = clip.end[i] + clip.maxs[i] + 1;
-        } else {
-            clip.boxmins[i] = clip.end[i] + clip.mins[i] - 1;
-            clip.boxmaxs[i] = clip.start[i] + clip.maxs[i] + 1;
+    *results = clip.trace;
+}
+
+
+/*
+===============================================================================
+
+BATCHED TRACES
+
+===============================================================================
+*/
+
+#define MAX_TRACE_BATCH     128     // requests grouped together at a time
+#define TRACE_BATCH_CHUNK   8       // world traces per job
+#define TRACE_BATCH_SLACK   8.0f    // how much bigger than any member's own box a group's box may get
+
+typedef struct {
+    trace_t                 *results;
+    const traceRequest_t    *requests;
+    int                     numRequests;
+} traceBatchJob_t;
+
+/*
+==================
+SV_TraceBatchWorld
+
+Clips a chunk of the batch to the world, which
+may run on any thread.
+==================
+*/
+static void SV_TraceBatchWorld( void *data, int index ) {
+    traceBatchJob_t         *job = data;
+    const traceRequest_t    *req;
+    trace_t                 *tr;
+    int                     i, last;
+
+    i = index * TRACE_BATCH_CHUNK;
+    last = i + TRACE_BATCH_CHUNK;
+    if ( last > job->numRequests ) {
+        last = job->numRequests;
+    }
+
+    for ( ; i < last; i++ ) {
+        req = &job->requests[i];
+        tr = &job->results[i];
+
+        CM_BoxTrace( tr, req->start, req->end, (float *)req->mins, (float *)req->maxs,
+            0, req->contentmask, req->capsule );
+        tr->entityNum = tr->fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+    }
+}
+
+/*
+==================
+SV_BoxVolume
+==================
+*/
+static float SV_BoxVolume( const vec3_t mins, const vec3_t maxs ) {
+    return ( maxs[0] - mins[0] ) * ( maxs[1] - mins[1] ) * ( maxs[2] - mins[2] );
+}
+
+/*
+==================
+SV_TraceBatchEntities
+
+Clips up to MAX_TRACE_BATCH requests against the entities. Requests whose
+boxes are close are grouped, and each group searches the world sectors
+once for the union of their boxes. Every request then filters that list
+down to its own box and the entities it clips against, which keeps the
+order its own query would have returned, so the results are identical to
+single SV_Trace calls.
+
+Returns the number of sector searches made.
+==================
+*/
+static int SV_TraceBatchEntities( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+    moveclip_t              clips[MAX_TRACE_BATCH];
+    qboolean                done[MAX_TRACE_BATCH];
+    int                     members[MAX_TRACE_BATCH];
+    int                     touchlist[MAX_GENTITIES];
+    int                     memberlist[MAX_GENTITIES];
+    float                   touchBounds[6][MAX_GENTITIES];
+    float                   *bounds[6];
+    int                     touchContents[MAX_GENTITIES];
+    int                     touchOwners[MAX_GENTITIES];
+    areaParms_t             ap;
+    const traceRequest_t    *req;
+    moveclip_t              *clip;
+    vec3_t                  groupMins, groupMaxs;
+    vec3_t                  mins, maxs;
+    float                   smallest, volume, memberVolume;
+    int                     numMembers, numTouch, numList;
+    int                     searches;
+    int                     i, j, k, n;
+
+    for ( i = 0; i < numRequests; i++ ) {
+        // blocked immediately by the world
+        done[i] = results[i].fraction == 0;
+        if ( done[i] ) {
+            continue;
+        }
+
+        req = &requests[i];
+        Com_Memset( &clips[i], 0, sizeof( clips[i] ) );
+        clips[i].trace = results[i];
+        SV_InitMoveClip( &clips[i], req->start, req->mins, req->maxs, req->end,
+            req->passEntityNum, req->contentmask, req->capsule );
+    }
+
+    for ( k = 0; k < 6; k++ ) {
+        bounds[k] = touchBounds[k];
+    }
+
+    searches = 0;
+
+    for ( i = 0; i < numRequests; i++ ) {
+        if ( done[i] ) {
+            continue;
+        }
+
+        // gather everything that doesn't blow up the box too much
+        VectorCopy( clips[i].boxmins, groupMins );
+        VectorCopy( clips[i].boxmaxs, groupMaxs );
+        smallest = SV_BoxVolume( groupMins, groupMaxs );
+        members[0] = i;
+        numMembers = 1;
+        done[i] = qtrue;
+
+        for ( j = i + 1; j < numRequests; j++ ) {
+            if ( done[j] ) {
+                continue;
+            }
+
+            clip = &clips[j];
+            for ( k = 0; k < 3; k++ ) {
+                mins[k] = clip->boxmins[k] < groupMins[k] ? clip->boxmins[k] : groupMins[k];
+                maxs[k] = clip->boxmaxs[k] > groupMaxs[k] ? clip->boxmaxs[k] : groupMaxs[k];
+            }
+
+            volume = SV_BoxVolume( mins, maxs );
+            memberVolume = SV_BoxVolume( clip->boxmins, clip->boxmaxs );
+            if ( volume > TRACE_BATCH_SLACK * ( memberVolume < smallest ? memberVolume : smallest ) ) {
+                continue;
+            }
+
+            VectorCopy( mins, groupMins );
+            VectorCopy( maxs, groupMaxs );
+            if ( memberVolume < smallest ) {
+                smallest = memberVolume;
+            }
+            members[numMembers++] = j;
+            done[j] = qtrue;
+        }
+
+        Com_Memset( &ap, 0, sizeof( ap ) );
+        ap.mins = groupMins;
+        ap.maxs = groupMaxs;
+        ap.list = touchlist;
+        ap.bounds = bounds;
+        ap.contents = touchContents;
+        ap.owners = touchOwners;
+        ap.maxcount = MAX_GENTITIES;
+
+        numTouch = SV_AreaQuery( &ap );
+        searches++;
+
+        for ( n = 0; n < numMembers; n++ ) {
+            clip = &clips[members[n]];
+
+            // same tests as SV_AreaSectorEntities, on the packed values it copied out
+            for ( k = 0, numList = 0; k < numTouch; k++ ) {
+                if ( touchBounds[0][k] > clip->boxmaxs[0]
+                || touchBounds[1][k] > clip->boxmaxs[1]
+                || touchBounds[2][k] > clip->boxmaxs[2]
+                || touchBounds[3][k] < clip->boxmins[0]
+                || touchBounds[4][k] < clip->boxmins[1]
+                || touchBounds[5][k] < clip->boxmins[2] ) {
+                    continue;
+                }
+
+                if ( SV_SkipPackedEntity( touchlist[k], touchContents[k], touchOwners[k],
+                    clip->contentmask, clip->passEntityNum, clip->passOwnerNum ) ) {
+                    continue;
+                }
+
+                memberlist[numList++] = touchlist[k];
+            }
+
+            SV_ClipMoveToEntityList( clip, memberlist, numList );
+            results[members[n]] = clip->trace;
         }
     }
 
-    // clip to other solid entities
-    SV_ClipMoveToEntities ( &clip );
+    return searches;
+}
 
-    *results = clip.trace;
+/*
+==================
+SV_TraceBatch
+
+Traces every request as SV_Trace would. The world traces don't depend on
+each other and are spread over the job threads for batches of at least
+sv_traceBatchJobs requests; clipping against entities stays on the main
+thread, since temp box models are shared.
+
+Returns the number of sector searches made, for the benchmark.
+==================
+*/
+int SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int numRequests ) {
+    traceBatchJob_t job;
+    int             searches;
+    int             i, n;
+
+    if ( numRequests <= 0 ) {
+        return 0;
+    }
+
+    job.results = results;
+    job.requests = requests;
+    job.numRequests = numRequests;
+
+    n = ( numRequests + TRACE_BATCH_CHUNK - 1 ) / TRACE_BATCH_CHUNK;
+
+    if ( sv_traceBatchJobs->integer > 0 && numRequests >= sv_traceBatchJobs->integer ) {
+        Com_RunJobs( SV_TraceBatchWorld, &job, n );
+    } else {
+        for ( i = 0; i < n; i++ ) {
+            SV_TraceBatchWorld( &job, i );
+        }
+    }
+
+    searches = 0;
+    for ( i = 0; i < numRequests; i += n ) {
+        n = numRequests - i;
+        if ( n > MAX_TRACE_BATCH ) {
+            n = MAX_TRACE_BATCH;
+        }
+        searches += SV_TraceBatchEntities( results + i, requests + i, n );
+    }
+
+    return searches;
 }
 
 
@@ -685,3 +1949,487 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 }
 
 
+
+/*
+===============================================================================
+
+TRACE STRESS TEST
+
+===============================================================================
+*/
+
+#define MAX_STRESS_THREADS  32
+
+typedef struct {
+    vec3_t          start, end;
+    vec3_t          mins, maxs;
+    vec3_t          origin;
+    clipHandle_t    model;
+    int             brushmask;
+    int             capsule;
+} stressTrace_t;
+
+typedef struct {
+    const stressTrace_t *traces;
+    const trace_t       *expected;
+    int                 numTraces;
+    int                 first;          // each thread starts at a different trace
+    int                 passes;
+    int                 mismatches;     // written by the thread, read after the join
+    int                 msec;
+} stressThread_t;
+
+/*
+===============
+SV_StressTrace
+===============
+*/
+static void SV_StressTrace( const stressTrace_t *st, trace_t *tr ) {
+    if ( st->model ) {
+        CM_TransformedBoxTrace( tr, st->start, st->end, (float *)st->mins, (float *)st->maxs,
+            st->model, st->brushmask, st->origin, vec3_origin, st->capsule );
+    } else {
+        CM_BoxTrace( tr, st->start, st->end, (float *)st->mins, (float *)st->maxs,
+            0, st->brushmask, st->capsule );
+    }
+}
+
+/*
+===============
+SV_TracesMatch
+===============
+*/
+static qboolean SV_TracesMatch( const trace_t *a, const trace_t *b ) {
+    return a->fraction == b->fraction && VectorCompare( a->endpos, b->endpos )
+        && a->allsolid == b->allsolid && a->startsolid == b->startsolid
+        && a->contents == b->contents && a->surfaceFlags == b->surfaceFlags
+        && ( a->fraction == 1.0f || a->allsolid || VectorCompare( a->plane.normal, b->plane.normal ) );
+}
+
+/*
+===============
+SV_TraceStressThread
+===============
+*/
+static void SV_TraceStressThread( void *arg ) {
+    stressThread_t  *st = arg;
+    trace_t         tr;
+    int             start;
+    int             i, j, n;
+
+    start = Sys_Milliseconds();
+
+    for ( i = 0; i < st->passes; i++ ) {
+        for ( j = 0; j < st->numTraces; j++ ) {
+            n = ( st->first + j ) % st->numTraces;
+
+            SV_StressTrace( &st->traces[n], &tr );
+            if ( !SV_TracesMatch( &tr, &st->expected[n] ) ) {
+                st->mismatches++;
+            }
+        }
+    }
+
+    st->msec = Sys_Milliseconds() - start;
+
+    CM_FreeThreadCheckStamps();
+}
+
+/*
+===============
+SV_TraceStress_f
+
+tracestress [threads] [traces] [passes]
+
+Traces random boxes, points and capsules through the world and the
+inline models, first serially and then from several threads at once,
+and checks every threaded result against the serial one
+===============
+*/
+void SV_TraceStress_f( void ) {
+    stressThread_t  threads[MAX_STRESS_THREADS];
+    sysThread_t     *handles[MAX_STRESS_THREADS];
+    stressTrace_t   *traces, *st;
+    trace_t         *expected;
+    vec3_t          worldMins, worldMaxs;
+    unsigned int    seed;
+    int             numThreads, numTraces, passes;
+    int             numModels, started, mismatches;
+    int             i, j, start, serialMsec, wallMsec;
+
+    if ( !com_sv_running->integer ) {
+        Com_Printf( "Server is not running.\n" );
+        return;
+    }
+
+    numThreads = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 4;
+    numTraces = Cmd_Argc() > 2 ? atoi( Cmd_Argv(2) ) : 20000;
+    passes = Cmd_Argc() > 3 ? atoi( Cmd_Argv(3) ) : 4;
+
+    if ( numThreads < 1 || numThreads > MAX_STRESS_THREADS || numTraces < 1 || passes < 1 ) {
+        Com_Printf( "Usage: tracestress [threads 1-%i] [traces] [passes]\n", MAX_STRESS_THREADS );
+        return;
+    }
+
+    traces = Hunk_AllocateTempMemory( numTraces * sizeof( *traces ) );
+    expected = Hunk_AllocateTempMemory( numTraces * sizeof( *expected ) );
+    Com_Memset( traces, 0, numTraces * sizeof( *traces ) );
+
+    CM_ModelBounds( 0, worldMins, worldMaxs );
+    numModels = CM_NumInlineModels();
+
+    // a fixed seed so runs can be compared
+    seed = 1;
+#define STRESS_RAND()   ( seed = seed * 1664525 + 1013904223, ( seed >> 8 ) / (float)( 1 << 24 ) )
+
+    for ( i = 0, st = traces; i < numTraces; i++, st++ ) {
+        for ( j = 0; j < 3; j++ ) {
+            st->start[j] = worldMins[j] + STRESS_RAND() * ( worldMaxs[j] - worldMins[j] );
+            st->end[j] = st->start[j] + ( STRESS_RAND() - 0.5f ) * 2048;
+        }
+
+        switch ( i & 3 ) {
+        case 0:     // point
+            break;
+        case 3:     // position test
+            VectorCopy( st->start, st->end );
+            // fall through
+        default:    // player sized box
+            VectorSet( st->mins, -15, -15, -46 );
+            VectorSet( st->maxs, 15, 15, 48 );
+            break;
+        }
+
+        st->capsule = ( i % 7 ) == 0;
+        st->brushmask = ( i & 4 ) ? MASK_SHOT : MASK_PLAYERSOLID;
+
+        // every eighth trace hits a random inline model somewhere in the world
+        if ( numModels > 1 && ( i & 7 ) == 5 ) {
+            st->model = CM_InlineModel( 1 + (int)( STRESS_RAND() * ( numModels - 1 ) ) % ( numModels - 1 ) );
+            VectorSubtract( st->start, st->end, st->origin );
+            VectorMA( st->start, STRESS_RAND(), st->origin, st->origin );
+        }
+    }
+#undef STRESS_RAND
+
+    // serial reference
+    start = Sys_Milliseconds();
+    for ( i = 0; i < numTraces; i++ ) {
+        SV_StressTrace( &traces[i], &expected[i] );
+    }
+    serialMsec = Sys_Milliseconds() - start;
+
+    // again on the main thread, stamps must not leak between traces
+    mismatches = 0;
+    for ( i = 0; i < numTraces; i++ ) {
+        trace_t tr;
+
+        SV_StressTrace( &traces[numTraces - 1 - i], &tr );
+        if ( !SV_TracesMatch( &tr, &expected[numTraces - 1 - i] ) ) {
+            mismatches++;
+        }
+    }
+    Com_Printf( "serial: %i traces in %i msec, %i mismatches in reverse order\n", numTraces, serialMsec, mismatches );
+
+    Com_Memset( threads, 0, sizeof( threads ) );
+
+    start = Sys_Milliseconds();
+    for ( started = 0; started < numThreads; started++ ) {
+        threads[started].traces = traces;
+        threads[started].expected = expected;
+        threads[started].numTraces = numTraces;
+        threads[started].first = started * numTraces / numThreads;
+        threads[started].passes = passes;
+
+        handles[started] = Sys_CreateThread( SV_TraceStressThread, &threads[started] );
+        if ( !handles[started] ) {
+            Com_Printf( S_COLOR_YELLOW "WARNING: could only start %i threads\n", started );
+            break;
+        }
+    }
+
+    for ( i = 0; i < started; i++ ) {
+        Sys_JoinThread( handles[i] );
+        mismatches += threads[i].mismatches;
+    }
+    wallMsec = Sys_Milliseconds() - start;
+
+    for ( i = 0; i < started; i++ ) {
+        Com_Printf( "thread %i: %i traces in %i msec, %i mismatches\n",
+            i, numTraces * passes, threads[i].msec, threads[i].mismatches );
+    }
+
+    if ( started ) {
+        Com_Printf( "%i threads: %i traces in %i msec, %.2fx serial throughput\n", started,
+            numTraces * passes * started, wallMsec,
+            wallMsec && serialMsec ? (float)serialMsec * passes * started / wallMsec : 0.0f );
+    }
+
+    if ( mismatches ) {
+        Com_Printf( S_COLOR_RED "FAILED: %i traces differ from the serial results\n", mismatches );
+    } else {
+        Com_Printf( "PASSED: all traces match the serial results\n" );
+    }
+
+    Hunk_FreeTempMemory( expected );
+    Hunk_FreeTempMemory( traces );
+}
+
+/*
+===============
+SV_BenchTraceRequests
+
+Clusters of traces around random points, the way a frame
+of player moves and shots would trace
+===============
+*/
+static void SV_BenchTraceRequests( traceRequest_t *requests, int numRequests ) {
+    traceRequest_t  *req;
+    vec3_t          worldMins, worldMaxs, center;
+    unsigned int    seed;
+    int             i, j;
+
+    Com_Memset( requests, 0, numRequests * sizeof( *requests ) );
+
+    CM_ModelBounds( 0, worldMins, worldMaxs );
+    VectorClear( center );
+
+    // a fixed seed so runs can be compared
+    seed = 1;
+#define BENCH_RAND()    ( seed = seed * 1664525 + 1013904223, ( seed >> 8 ) / (float)( 1 << 24 ) )
+
+    for ( i = 0, req = requests; i < numRequests; i++, req++ ) {
+        // sixteen traces around each point
+        if ( !( i & 15 ) ) {
+            for ( j = 0; j < 3; j++ ) {
+                center[j] = worldMins[j] + BENCH_RAND() * ( worldMaxs[j] - worldMins[j] );
+            }
+        }
+
+        for ( j = 0; j < 3; j++ ) {
+            req->start[j] = center[j] + ( BENCH_RAND() - 0.5f ) * 128;
+        }
+
+        if ( ( i & 3 ) == 3 ) {
+            // shot
+            for ( j = 0; j < 3; j++ ) {
+                req->end[j] = req->start[j] + ( BENCH_RAND() - 0.5f ) * 4096;
+            }
+            req->contentmask = MASK_SHOT;
+        } else {
+            // player move
+            for ( j = 0; j < 3; j++ ) {
+                req->end[j] = req->start[j] + ( BENCH_RAND() - 0.5f ) * 64;
+            }
+            VectorSet( req->mins, -15, -15, -46 );
+            VectorSet( req->maxs, 15, 15, 48 );
+            req->contentmask = MASK_PLAYERSOLID;
+        }
+
+        req->passEntityNum = sv.num_entities > 0 && ( i & 1 ) ? (int)( BENCH_RAND() * sv.num_entities ) % sv.num_entities : ENTITYNUM_NONE;
+        req->capsule = ( i % 7 ) == 0;
+    }
+#undef BENCH_RAND
+}
+
+/*
+===============
+SV_TraceBatchBench_f
+
+tracebatchbench [requests] [passes]
+
+Traces the SV_BenchTraceRequests once with single SV_Trace calls and
+once through SV_TraceBatch, and checks that both give the same results
+===============
+*/
+void SV_TraceBatchBench_f( void ) {
+    traceRequest_t  *requests, *req;
+    trace_t         *single, *batched;
+    int             numRequests, passes;
+    int             searches, mismatches;
+    int             i, j, start, singleMsec, batchMsec;
+
+    if ( !com_sv_running->integer ) {
+        Com_Printf( "Server is not running.\n" );
+        return;
+    }
+
+    numRequests = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 1024;
+    passes = Cmd_Argc() > 2 ? atoi( Cmd_Argv(2) ) : 20;
+
+    if ( numRequests < 1 || passes < 1 ) {
+        Com_Printf( "Usage: tracebatchbench [requests] [passes]\n" );
+        return;
+    }
+
+    requests = Hunk_AllocateTempMemory( numRequests * sizeof( *requests ) );
+    single = Hunk_AllocateTempMemory( numRequests * sizeof( *single ) );
+    batched = Hunk_AllocateTempMemory( numRequests * sizeof( *batched ) );
+
+    SV_BenchTraceRequests( requests, numRequests );
+
+    start = Sys_Milliseconds();
+    for ( i = 0; i < passes; i++ ) {
+        for ( j = 0, req = requests; j < numRequests; j++, req++ ) {
+            SV_Trace( &single[j], req->start, req->mins, req->maxs, req->end,
+                req->passEntityNum, req->contentmask, req->capsule );
+        }
+    }
+    singleMsec = Sys_Milliseconds() - start;
+
+    searches = 0;
+    start = Sys_Milliseconds();
+    for ( i = 0; i < passes; i++ ) {
+        searches = SV_TraceBatch( batched, requests, numRequests );
+    }
+    batchMsec = Sys_Milliseconds() - start;
+
+    mismatches = 0;
+    for ( i = 0; i < numRequests; i++ ) {
+        if ( !SV_TracesMatch( &single[i], &batched[i] ) || single[i].entityNum != batched[i].entityNum ) {
+            mismatches++;
+        }
+    }
+
+    Com_Printf( "%i requests, %i entities, %i job threads\n", numRequests, sv.num_entities,
+        sv_traceBatchJobs->integer > 0 && numRequests >= sv_traceBatchJobs->integer ? Com_JobThreads() : 1 );
+    Com_Printf( "single: %i msec for %i passes\n", singleMsec, passes );
+    Com_Printf( "batch:  %i msec for %i passes, %i sector searches per pass\n", batchMsec, passes, searches );
+    if ( batchMsec ) {
+        Com_Printf( "%.2fx single call throughput\n", (float)singleMsec / batchMsec );
+    }
+
+    if ( mismatches ) {
+        Com_Printf( S_COLOR_RED "FAILED: %i batched traces differ from single calls\n", mismatches );
+    } else {
+        Com_Printf( "PASSED: all batched traces match single calls\n" );
+    }
+
+    Hunk_FreeTempMemory( batched );
+    Hunk_FreeTempMemory( single );
+    Hunk_FreeTempMemory( requests );
+}
+
+/*
+===============
+SV_CollisionBench
+
+Replays the SV_BenchTraceRequests and a point contents test at each
+start against the world alone, once with the collision cvar off and
+once with it on, and checks that both give the same results
+===============
+*/
+static void SV_CollisionBench( const char *cmdName, const char *cvarName, const char *offName, const char *onName ) {
+    traceRequest_t  *requests, *req;
+    trace_t         *results[2];
+    int             *contents[2];
+    int             numRequests, passes;
+    int             msec[2], mismatches;
+    int             wasOn;
+    int             i, j, k, start;
+
+    if ( !com_sv_running->integer ) {
+        Com_Printf( "Server is not running.\n" );
+        return;
+    }
+
+    numRequests = Cmd_Argc() > 1 ? atoi( Cmd_Argv(1) ) : 4096;
+    passes = Cmd_Argc() > 2 ? atoi( Cmd_Argv(2) ) : 20;
+
+    if ( numRequests < 1 || passes < 1 ) {
+        Com_Printf( "Usage: %s [traces] [passes]\n", cmdName );
+        return;
+    }
+
+    requests = Hunk_AllocateTempMemory( numRequests * sizeof( *requests ) );
+    results[0] = Hunk_AllocateTempMemory( numRequests * sizeof( *results[0] ) );
+    results[1] = Hunk_AllocateTempMemory( numRequests * sizeof( *results[1] ) );
+    contents[0] = Hunk_AllocateTempMemory( numRequests * sizeof( *contents[0] ) );
+    contents[1] = Hunk_AllocateTempMemory( numRequests * sizeof( *contents[1] ) );
+
+    SV_BenchTraceRequests( requests, numRequests );
+
+    wasOn = Cvar_VariableIntegerValue( cvarName );
+
+    for ( k = 0; k < 2; k++ ) {
+        Cvar_Set( cvarName, k ? "1" : "0" );
+
+        start = Sys_Milliseconds();
+        for ( i = 0; i < passes; i++ ) {
+            for ( j = 0, req = requests; j < numRequests; j++, req++ ) {
+                CM_BoxTrace( &results[k][j], req->start, req->end, req->mins, req->maxs,
+                    0, req->contentmask, req->capsule );
+                contents[k][j] = CM_PointContents( req->start, 0 );
+            }
+        }
+        msec[k] = Sys_Milliseconds() - start;
+    }
+
+    Cvar_Set( cvarName, wasOn ? "1" : "0" );
+
+    mismatches = 0;
+    for ( i = 0; i < numRequests; i++ ) {
+        if ( !SV_TracesMatch( &results[0][i], &results[1][i] ) || contents[0][i] != contents[1][i] ) {
+            mismatches++;
+        }
+    }
+
+    Com_Printf( "%i traces and point tests, %i passes\n", numRequests, passes );
+    Com_Printf( "%-7s %i msec\n", va( "%s:", offName ), msec[0] );
+    Com_Printf( "%-7s %i msec\n", va( "%s:", onName ), msec[1] );
+    if ( msec[1] ) {
+        Com_Printf( "%.2fx %s throughput\n", (float)msec[0] / msec[1], offName );
+    }
+
+    if ( mismatches ) {
+        Com_Printf( S_COLOR_RED "FAILED: %i results differ between %s and %s\n", mismatches, offName, onName );
+    } else {
+        Com_Printf( "PASSED: %s and %s give the same results\n", offName, onName );
+    }
+
+    Hunk_FreeTempMemory( contents[1] );
+    Hunk_FreeTempMemory( contents[0] );
+    Hunk_FreeTempMemory( results[1] );
+    Hunk_FreeTempMemory( results[0] );
+    Hunk_FreeTempMemory( requests );
+}
+
+/*
+===============
+SV_NodeBench_f
+
+nodebench [traces] [passes]
+
+Compares walking the BSP nodes as loaded with the flattened copy
+===============
+*/
+void SV_NodeBench_f( void ) {
+    SV_CollisionBench( "nodebench", "cm_flatNodes", "nodes", "flat" );
+}
+
+/*
+===============
+SV_BrushBench_f
+
+brushbench [traces] [passes]
+
+Compares testing brush sides one at a time with four at a time
+===============
+*/
+void SV_BrushBench_f( void ) {
+    SV_CollisionBench( "brushbench", "cm_simdBrushes", "scalar", "simd" );
+}
+
+/*
+===============
+SV_TerrainBench_f
+
+terrainbench [traces] [passes]
+
+Compares tracing terrain patch by patch with walking its terxel grid,
+only useful on maps with terrain
+===============
+*/
+void SV_TerrainBench_f( void ) {
+    SV_CollisionBench( "terrainbench", "cm_terrainGrid", "patches", "grid" );
+}
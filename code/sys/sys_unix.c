@@ -38,6 +38,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fcntl.h>
 #include <fenv.h>
 #include <sys/wait.h>
+#include <pthread.h>
 
 qboolean stdinIsATTY;
 
@@ -953,3 +954,188 @@ qboolean Sys_DllExtension( const char *name ) {
 
     return qfalse;
 }
+
+/*
+==============================================================
+
+THREADS
+
+==============================================================
+*/
+
+struct sysThread_s {
+    pthread_t   thread;
+    void        (*func)( void *arg );
+    void        *arg;
+};
+
+struct sysMutex_s {
+    pthread_mutex_t mutex;
+};
+
+struct sysSemaphore_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             count;
+};
+
+/*
+=================
+Sys_ThreadMain
+=================
+*/
+static void *Sys_ThreadMain( void *arg ) {
+    sysThread_t *thread = (sysThread_t *)arg;
+
+    thread->func( thread->arg );
+    return NULL;
+}
+
+/*
+=================
+Sys_ProcessorCount
+=================
+*/
+int Sys_ProcessorCount( void ) {
+    long    count;
+
+    count = sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0 ? (int)count : 1;
+}
+
+/*
+=================
+Sys_CreateThread
+
+Returns NULL if the thread could not be started.
+=================
+*/
+sysThread_t *Sys_CreateThread( void (*func)( void *arg ), void *arg ) {
+    sysThread_t *thread;
+
+    thread = malloc( sizeof( *thread ) );
+    if ( !thread ) {
+        return NULL;
+    }
+
+    thread->func = func;
+    thread->arg = arg;
+
+    if ( pthread_create( &thread->thread, NULL, Sys_ThreadMain, thread ) ) {
+        free( thread );
+        return NULL;
+    }
+
+    return thread;
+}
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( sysThread_t *thread ) {
+    pthread_join( thread->thread, NULL );
+    free( thread );
+}
+
+/*
+=================
+Sys_CreateMutex
+=================
+*/
+sysMutex_t *Sys_CreateMutex( void ) {
+    sysMutex_t *mutex;
+
+    mutex = malloc( sizeof( *mutex ) );
+    if ( !mutex ) {
+        Sys_Error( "Sys_CreateMutex: out of memory" );
+    }
+
+    pthread_mutex_init( &mutex->mutex, NULL );
+    return mutex;
+}
+
+/*
+=================
+Sys_DestroyMutex
+=================
+*/
+void Sys_DestroyMutex( sysMutex_t *mutex ) {
+    pthread_mutex_destroy( &mutex->mutex );
+    free( mutex );
+}
+
+/*
+=================
+Sys_LockMutex
+=================
+*/
+void Sys_LockMutex( sysMutex_t *mutex ) {
+    pthread_mutex_lock( &mutex->mutex );
+}
+
+/*
+=================
+Sys_UnlockMutex
+=================
+*/
+void Sys_UnlockMutex( sysMutex_t *mutex ) {
+    pthread_mutex_unlock( &mutex->mutex );
+}
+
+/*
+=================
+Sys_CreateSemaphore
+=================
+*/
+sysSemaphore_t *Sys_CreateSemaphore( int count ) {
+    sysSemaphore_t *sem;
+
+    sem = malloc( sizeof( *sem ) );
+    if ( !sem ) {
+        Sys_Error( "Sys_CreateSemaphore: out of memory" );
+    }
+
+    pthread_mutex_init( &sem->mutex, NULL );
+    pthread_cond_init( &sem->cond, NULL );
+    sem->count = count;
+    return sem;
+}
+
+/*
+=================
+Sys_DestroySemaphore
+=================
+*/
+void Sys_DestroySemaphore( sysSemaphore_t *sem ) {
+    pthread_cond_destroy( &sem->cond );
+    pthread_mutex_destroy( &sem->mutex );
+    free( sem );
+}
+
+/*
+=================
+Sys_SemaphoreWait
+=================
+*/
+void Sys_SemaphoreWait( sysSemaphore_t *sem ) {
+    pthread_mutex_lock( &sem->mutex );
+    while ( sem->count <= 0 ) {
+        pthread_cond_wait( &sem->cond, &sem->mutex );
+    }
+    sem->count--;
+    pthread_mutex_unlock( &sem->mutex );
+}
+
+/*
+=================
+Sys_SemaphorePost
+=================
+*/
+void Sys_SemaphorePost( sysSemaphore_t *sem ) {
+    pthread_mutex_lock( &sem->mutex );
+    sem->count++;
+    pthread_cond_signal( &sem->cond );
+    pthread_mutex_unlock( &sem->mutex );
+}
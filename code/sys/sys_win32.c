@@ -861,3 +861,181 @@ Check if filename should be allowed to be loaded as a DLL.
 qboolean Sys_DllExtension( const char *name ) {
     return COM_CompareExtension( name, DLL_EXT );
 }
+
+/*
+==============================================================
+
+THREADS
+
+==============================================================
+*/
+
+struct sysThread_s {
+    HANDLE      handle;
+    void        (*func)( void *arg );
+    void        *arg;
+};
+
+struct sysMutex_s {
+    CRITICAL_SECTION    cs;
+};
+
+struct sysSemaphore_s {
+    HANDLE      handle;
+};
+
+/*
+=================
+Sys_ThreadMain
+=================
+*/
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg ) {
+    sysThread_t *thread = (sysThread_t *)arg;
+
+    thread->func( thread->arg );
+    return 0;
+}
+
+/*
+=================
+Sys_ProcessorCount
+=================
+*/
+int Sys_ProcessorCount( void ) {
+    SYSTEM_INFO info;
+
+    GetSystemInfo( &info );
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+/*
+=================
+Sys_CreateThread
+
+Returns NULL if the thread could not be started.
+=================
+*/
+sysThread_t *Sys_CreateThread( void (*func)( void *arg ), void *arg ) {
+    sysThread_t *thread;
+
+    thread = malloc( sizeof( *thread ) );
+    if ( !thread ) {
+        return NULL;
+    }
+
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread( NULL, 0, Sys_ThreadMain, thread, 0, NULL );
+
+    if ( !thread->handle ) {
+        free( thread );
+        return NULL;
+    }
+
+    return thread;
+}
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( sysThread_t *thread ) {
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+    free( thread );
+}
+
+/*
+=================
+Sys_CreateMutex
+=================
+*/
+sysMutex_t *Sys_CreateMutex( void ) {
+    sysMutex_t *mutex;
+
+    mutex = malloc( sizeof( *mutex ) );
+    if ( !mutex ) {
+        Sys_Error( "Sys_CreateMutex: out of memory" );
+    }
+
+    InitializeCriticalSection( &mutex->cs );
+    return mutex;
+}
+
+/*
+=================
+Sys_DestroyMutex
+=================
+*/
+void Sys_DestroyMutex( sysMutex_t *mutex ) {
+    DeleteCriticalSection( &mutex->cs );
+    free( mutex );
+}
+
+/*
+=================
+Sys_LockMutex
+=================
+*/
+void Sys_LockMutex( sysMutex_t *mutex ) {
+    EnterCriticalSection( &mutex->cs );
+}
+
+/*
+=================
+Sys_UnlockMutex
+=================
+*/
+void Sys_UnlockMutex( sysMutex_t *mutex ) {
+    LeaveCriticalSection( &mutex->cs );
+}
+
+/*
+=================
+Sys_CreateSemaphore
+=================
+*/
+sysSemaphore_t *Sys_CreateSemaphore( int count ) {
+    sysSemaphore_t *sem;
+
+    sem = malloc( sizeof( *sem ) );
+    if ( !sem ) {
+        Sys_Error( "Sys_CreateSemaphore: out of memory" );
+    }
+
+    sem->handle = CreateSemaphore( NULL, count, 0x7fffffff, NULL );
+    if ( !sem->handle ) {
+        Sys_Error( "Sys_CreateSemaphore: CreateSemaphore failed" );
+    }
+
+    return sem;
+}
+
+/*
+=================
+Sys_DestroySemaphore
+=================
+*/
+void Sys_DestroySemaphore( sysSemaphore_t *sem ) {
+    CloseHandle( sem->handle );
+    free( sem );
+}
+
+/*
+=================
+Sys_SemaphoreWait
+=================
+*/
+void Sys_SemaphoreWait( sysSemaphore_t *sem ) {
+    WaitForSingleObject( sem->handle, INFINITE );
+}
+
+/*
+=================
+Sys_SemaphorePost
+=================
+*/
+void Sys_SemaphorePost( sysSemaphore_t *sem ) {
+    ReleaseSemaphore( sem->handle, 1, NULL );
+}